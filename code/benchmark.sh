@@ -1,6 +1,9 @@
 #!/bin/bash
 
-num_of_threads=(1 2 4 8 16 32 44 66 88)
+num_of_threads="1,2,4,8,16,32,44,66,88"
+warmups="${WARMUPS:-0}"
+# Pinning keeps the scaling comparable between runs, see the -p option.
+placement="${PLACEMENT:-cores}"
 
 if [[ $# < 3 ]]
 then
@@ -16,17 +19,10 @@ shift
 iterations="$1"
 shift
 
-for i in ${num_of_threads[@]}
-do
-    echo "#threads: $i"
-    sed -i.bak -r "s/NUM_OF_THREADS=([0-9]+)/NUM_OF_THREADS=$i/g" makefile
-    make
-    thread_dir="$bench_dir/$i"
-    mkdir -p "$thread_dir"
-    for (( j=1; j<=iterations; j++))
-    do
-        echo "iteration: $j"
-        ./CiCTrie $@ > "$thread_dir/result_$j.txt"
-    done
-    make clean
-done
+# A single binary sweeps all the thread counts, NUM_OF_THREADS only bounds them.
+make
+if ! ./CiCTrie -t "$num_of_threads" -w "$warmups" -r "$iterations" -p "$placement" -o "$bench_dir/results.csv" $@ > "$bench_dir/output.txt"
+then
+    echo "benchmark $bench_dir failed, its results are incomplete (see output.txt)"
+    exit 1
+fi
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+// Spins of the first backoff window, 0 disables backing off (failures are still counted).
+#ifndef BACKOFF_MIN_SPINS
+#define BACKOFF_MIN_SPINS   (16)
+#endif
+#ifndef BACKOFF_MAX_SPINS
+#define BACKOFF_MAX_SPINS   (16384)
+#endif
+
+// The failure rate is a fixed point fraction in [0, BACKOFF_RATE_ONE], averaged over the last ~2^BACKOFF_RATE_SHIFT CAS attempts.
+#define BACKOFF_RATE_ONE    (256)
+#define BACKOFF_RATE_SHIFT  (3)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX           do {__asm__ __volatile__("pause");} while(0)
+#else
+#define CPU_RELAX           do {} while(0)
+#endif
+
+typedef struct {
+    uint32_t    min_spins;
+    uint32_t    max_spins;
+} backoff_config_t;
+
+typedef struct {
+    uint32_t    window;
+    uint32_t    failure_rate;
+    uint32_t    seed;
+    uint64_t    failures;
+    uint64_t    backoffs;
+    uint64_t    spins;
+} backoff_t;
+
+void backoff_failure(backoff_t* backoff, const backoff_config_t* config, int index);
+void backoff_success(backoff_t* backoff);
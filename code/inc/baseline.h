@@ -0,0 +1,45 @@
+#pragma once
+
+#include "hazard_pointer.h"
+
+// The buckets a baseline map starts with, they double while there are more than BASELINE_LOAD_FACTOR keys per bucket.
+#define BASELINE_INITIAL_BUCKETS    (1024)
+#define BASELINE_LOAD_FACTOR        (2)
+// The locks of a striped map, each guards the buckets whose index is its index modulo BASELINE_STRIPES.
+#ifndef BASELINE_STRIPES
+#define BASELINE_STRIPES            (1024)
+#endif
+
+/**
+ * The concurrent maps the ctrie is compared against, run through the same harness.
+ **/
+typedef enum
+{
+    MAP_CTRIE,
+    // A chained hash table with a lock per stripe of buckets, resized under all of them.
+    MAP_STRIPED,
+    // Shalev and Shavit's lock-free split-ordered list, its removed nodes are reclaimed with hazard pointers.
+    MAP_SPLIT_ORDERED,
+    // A chained hash table under a single reader-writer lock.
+    MAP_RWLOCK,
+} map_type_t;
+
+/**
+ * The operations of a baseline map, with the semantics of the ctrie's.
+ **/
+typedef struct map_t
+{
+    // Sets the value of `key`, returns OK or FAILED.
+    int      (*insert) (struct map_t* map, int key, int value, thread_args_t* thread_args);
+    // Returns the removed value of `key`, NOTFOUND or FAILED.
+    int      (*remove) (struct map_t* map, int key, thread_args_t* thread_args);
+    // Returns the value of `key` or NOTFOUND.
+    int      (*lookup) (struct map_t* map, int key, thread_args_t* thread_args);
+    // Returns the number of keys, while no thread changes the map.
+    int64_t  (*size)   (struct map_t* map);
+    void     (*free)   (struct map_t* map);
+} map_t;
+
+map_t* create_striped_map();
+map_t* create_rwlock_map();
+map_t* create_split_ordered_map();
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "baseline.h"
+#include "contention.h"
+#include "counters.h"
+#include "memory.h"
+#include "input.h"
+#include "parser.h"
+#include "placement.h"
+#include "preemption.h"
+
+// The most thread counts a single sweep can run.
+#define BENCH_MAX_SWEEP             (64)
+#define BENCH_DEFAULT_REPETITIONS   (1)
+// The operations whose latencies are reported, by action_type_t.
+#define BENCH_OP_TYPES              (REMOVE + 1)
+
+typedef enum
+{
+    BENCH_CSV,
+    BENCH_JSON,
+} bench_format_t;
+
+typedef struct
+{
+    // The thread counts to run the phases with, each at most NUM_OF_THREADS.
+    uint32_t        threads[BENCH_MAX_SWEEP];
+    uint32_t        num_of_counts;
+    // Unrecorded runs of all the phases before the recorded ones, for every thread count.
+    uint32_t        warmups;
+    uint32_t        repetitions;
+    bench_format_t  format;
+    // Where the results are written, NULL if only the log is wanted.
+    const char*     output_path;
+    // How the action files are read.
+    input_mode_t    input_mode;
+    // Where the workers are pinned.
+    placement_policy_t placement;
+    // The map the phases run on.
+    map_type_t      map;
+    // Where the traced events are dumped at exit, NULL if they aren't.
+    const char*     trace_path;
+    // How often the resident set size is sampled during the phases, whose memory is reported. 0 reports none.
+    uint32_t        memory_interval_ms;
+    // 1 if the thread counts are per CPU the process can use, to run more threads than CPUs.
+    int             oversubscribe;
+    // How the operations are preempted, only with PREEMPTION_INJECTION.
+    preempt_mode_t  preempt;
+} bench_config_t;
+
+/**
+ * The latency percentiles of an operation type in a phase, in nanoseconds.
+ **/
+typedef struct
+{
+    uint64_t count;
+    double   p50;
+    double   p90;
+    double   p99;
+    double   p999;
+    double   max;
+} bench_latency_t;
+
+/**
+ * A row of the results, one per timed phase of every recorded run.
+ **/
+typedef struct
+{
+    map_type_t  map;
+    uint32_t    threads;
+    placement_policy_t placement;
+    // The CPUs of the threads, see placement_map.
+    const char* cpu_map;
+    uint32_t    repetition;
+    uint32_t    phase;
+    const char* action;
+    const char* arg;
+    int64_t     nsecs;
+    // The operations of the phase, 0 for phases that aren't made of operations (e.g. save).
+    int64_t     ops;
+    uint64_t    cas_failures;
+    uint64_t    backoffs;
+    uint64_t    spins;
+    // The restarts of the phase's ctrie operations, by restart_cause_t.
+    uint64_t    restarts[NUM_OF_RESTART_CAUSES];
+    // The most retired nodes a thread's free list held, the times a full free list slept until hazard pointers let go
+    // of its nodes, and the injected preemptions.
+    uint64_t    peak_retired;
+    uint64_t    reclaim_stalls;
+    uint64_t    preemptions;
+    // Only with memory_interval_ms: the keys in the map after the phase, and the heap's live bytes before and after
+    // the `retired` nodes in the threads' free lists were freed.
+    int64_t     keys;
+    uint64_t    heap_bytes;
+    uint64_t    retired;
+    uint64_t    drained_heap_bytes;
+    // The resident set size after the phase and at its peak.
+    uint64_t    rss;
+    uint64_t    peak_rss;
+    // The hardware counters of the phase's workers, reported per operation.
+    counter_totals_t counters;
+    // Only recorded with LATENCY_HISTOGRAMS, an operation type with a 0 count didn't run.
+    bench_latency_t latencies[BENCH_OP_TYPES];
+} bench_result_t;
+
+typedef struct
+{
+    FILE*           fp;
+    bench_format_t  format;
+    uint64_t        num_of_results;
+} bench_report_t;
+
+int         bench_parse_args(int argc, char* argv[], bench_config_t* config, int* first_phase);
+int         bench_open      (bench_report_t* report, const bench_config_t* config);
+void        bench_record    (bench_report_t* report, const bench_result_t* result);
+void        bench_close     (bench_report_t* report);
+const char* bench_op_name   (action_type_t type);
+const char* bench_restart_name(restart_cause_t cause);
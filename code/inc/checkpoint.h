@@ -0,0 +1,88 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ctrie.h"
+#include "hazard_pointer.h"
+
+// "CTRIECKP" in little-endian.
+#define CHECKPOINT_MAGIC        (0x504b434549525443ULL)
+#define CHECKPOINT_VERSION      (1)
+// The size of the checkpoint's writes.
+#define CHECKPOINT_BUFFER_SIZE  (1 << 20)
+// The `lev` of the record which ends a checkpoint.
+#define CHECKPOINT_END          (0xffffffff)
+// The background checkpointer's defaults.
+#define CHECKPOINT_INTERVAL_MS  (100)
+#define CHECKPOINT_BYTES_PER_SEC (256ULL << 20)
+#define CHECKPOINT_FULL_EVERY   (8)
+
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    // The generation of this checkpoint.
+    uint32_t gen;
+    // The generation of the checkpoint this one is incremental to, or 0 for a full checkpoint.
+    uint32_t base_gen;
+    uint32_t reserved;
+} checkpoint_header_t;
+
+/**
+ * Replaces the entries whose hash has the low `lev` bits of `prefix`, and whose next W hash bits are not in `keep`,
+ * with the `count` entries following the record. The kept positions are unchanged or described by later records.
+ * A checkpoint ends with a record whose `lev` is CHECKPOINT_END and `count` is the number of records, followed by
+ * the FNV-1a checksum of everything before it.
+ **/
+typedef struct
+{
+    uint32_t prefix;
+    uint32_t lev;
+    uint32_t keep;
+    uint32_t count;
+} checkpoint_record_t;
+
+typedef struct
+{
+    int key;
+    int value;
+} checkpoint_entry_t;
+
+typedef struct
+{
+    uint64_t bytes;
+    uint64_t records;
+    uint64_t entries;
+    // How long the checkpoint waited for the operations which were running when it started (none waited for it).
+    int64_t  wait_time;
+    int64_t  time;
+} checkpoint_stats_t;
+
+typedef struct
+{
+    // Checkpoints are written to "<path>.<generation>".
+    const char* path;
+    uint32_t    interval_ms;
+    // 0 means unthrottled.
+    uint64_t    bytes_per_sec;
+    // Every `full_every`th checkpoint is full and the rest are incremental, 0 means they are all full.
+    uint32_t    full_every;
+} checkpoint_config_t;
+
+typedef struct
+{
+    ctrie_t*            ctrie;
+    checkpoint_config_t config;
+    thread_args_t*      thread_args;
+    pthread_t           tid;
+    volatile uint8_t    stop;
+    uint32_t            num_of_checkpoints;
+    checkpoint_stats_t  stats;
+} checkpointer_t;
+
+int             ctrie_checkpoint  (ctrie_t* ctrie, const char* path, int incremental, uint64_t bytes_per_sec,
+                                   thread_args_t* thread_args, checkpoint_stats_t* stats);
+int             checkpoint_restore(ctrie_t* ctrie, const char* path, thread_args_t* thread_args);
+checkpointer_t* checkpoint_start  (ctrie_t* ctrie, const checkpoint_config_t* config, thread_args_t* thread_args);
+uint32_t        checkpoint_stop   (checkpointer_t* checkpointer, checkpoint_stats_t* stats);
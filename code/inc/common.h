@@ -10,6 +10,9 @@
 #include <fcntl.h>
 
 #define MESSAGE_SIZE (4096)
+// The initial hash of fnv1a.
+#define FNV_OFFSET_BASIS    (0xcbf29ce484222325ULL)
+#define NSECS_IN_SEC        (1000000000LL)
 
 #ifdef NO_PRINT
 #define PRINT(fmt, ...)
@@ -50,6 +53,10 @@
     memset(var, 0, sizeof(type));                           \
 } while (0);
 
-void    free_them_all(int count, ...);
-int32_t highest_on_bit(uint32_t num);
+void     free_them_all(int count, ...);
+int32_t  highest_on_bit(uint32_t num);
+uint32_t xorshift32(uint32_t* state);
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash);
+int64_t  monotonic_nsecs();
+void     sleep_nsecs(int64_t nsecs);
 
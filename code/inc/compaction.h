@@ -0,0 +1,53 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "ctrie.h"
+#include "hazard_pointer.h"
+
+// A compaction pass visits the subtrees of level COMPACTION_CHUNK_BITS one at a time, each in one operation.
+// Must be a positive multiple of W.
+#ifndef COMPACTION_CHUNK_BITS
+#define COMPACTION_CHUNK_BITS       (2 * W)
+#endif
+#define COMPACTION_CHUNKS           (1U << COMPACTION_CHUNK_BITS)
+// The background compactor's defaults.
+#define COMPACTION_INTERVAL_MS      (1000)
+#define COMPACTION_CNODES_PER_SEC   (1ULL << 20)
+
+typedef struct
+{
+    uint64_t passes;
+    // The CNodes visited, and the entries found in them (with the sum of their depths, counted in INodes).
+    uint64_t cnodes;
+    uint64_t entries;
+    uint64_t depth_sum;
+    // Tombstones removed: each one freed an INode and its TNode, and lifted its entry by one level.
+    uint64_t resurrected;
+    // Single-entry CNodes entombed, to be resurrected into their parents.
+    uint64_t contracted;
+} compaction_stats_t;
+
+typedef struct
+{
+    // The pause between passes.
+    uint32_t interval_ms;
+    // 0 means unthrottled.
+    uint64_t cnodes_per_sec;
+} compaction_config_t;
+
+typedef struct
+{
+    ctrie_t*            ctrie;
+    compaction_config_t config;
+    thread_args_t*      thread_args;
+    pthread_t           tid;
+    volatile uint8_t    stop;
+    compaction_stats_t  stats;
+} compactor_t;
+
+void         ctrie_compact   (ctrie_t* ctrie, uint32_t* cursor, uint32_t num_of_chunks, thread_args_t* thread_args,
+                              compaction_stats_t* stats);
+compactor_t* compaction_start(ctrie_t* ctrie, const compaction_config_t* config, thread_args_t* thread_args);
+uint64_t     compaction_stop (compactor_t* compactor, compaction_stats_t* stats);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "nodes.h"
+
+// 1 also counts where the operations restart, by trie depth and by the slot of the root's CNode.
+#ifndef CONTENTION_HEATMAP
+#define CONTENTION_HEATMAP  (0)
+#endif
+
+/**
+ * Why an operation resumed from a shallower INode.
+ **/
+typedef enum
+{
+    // The INode was marked when a clean or a compaction unlinked it.
+    RESTART_MARKED_INODE,
+    // The INode's main node (or the CNode's branch) was replaced after it was read.
+    RESTART_CHANGED_MAIN,
+    // The operation's CAS of the main node failed.
+    RESTART_CAS_FAILED,
+    // The main node was a TNode, its parent was cleaned.
+    RESTART_TNODE,
+    // An LNode of the list was marked while it was read or copied.
+    RESTART_LNODE_MARKED,
+    // The main node was a transaction's descriptor, which was read through or helped.
+    RESTART_TXN,
+    NUM_OF_RESTART_CAUSES,
+} restart_cause_t;
+
+/**
+ * The restarts of a thread's operations.
+ **/
+typedef struct {
+    uint64_t    restarts[NUM_OF_RESTART_CAUSES];
+#if CONTENTION_HEATMAP
+    uint64_t    depths[MAX_LEVELS];
+    uint64_t    slots[MAX_BRANCHES];
+#endif
+} contention_t;
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_DTLB_MISSES,
+    COUNTER_BRANCH_MISSES,
+    NUM_OF_COUNTERS,
+} counter_type_t;
+
+/**
+ * The hardware counters of a thread, -1 for those it couldn't open.
+ **/
+typedef struct
+{
+    int         fds[NUM_OF_COUNTERS];
+} counters_t;
+
+/**
+ * The counts of several threads, added up.
+ **/
+typedef struct
+{
+    uint64_t    values[NUM_OF_COUNTERS];
+    // The counters some of the threads couldn't count, by bit, their values are partial.
+    uint32_t    missing;
+} counter_totals_t;
+
+uint32_t    counters_available();
+void        counters_open     (counters_t* counters);
+void        counters_close    (counters_t* counters, counter_totals_t* totals);
+const char* counter_name      (counter_type_t type);
@@ -3,21 +3,73 @@
 #include <stdint.h>
 
 #include "hazard_pointer.h"
+#include "nodes.h"
+#include "transaction.h"
 
 #define OK          (0)
 #define FAILED      (-1)
 #define NOTFOUND    (-2)
 #define RESTART     (-3)
 
+// The hash bits indexing the wide root of a ctrie created with the default configuration, 0 disables it.
+#ifndef WIDE_ROOT_BITS
+#define WIDE_ROOT_BITS      (0)
+#endif
+#define WIDE_ROOT_MAX_BITS  (3 * W)
+// The hash level of the lookup cache of a ctrie created with the default configuration, 0 disables it.
+#ifndef LOOKUP_CACHE_BITS
+#define LOOKUP_CACHE_BITS   (0)
+#endif
+#define LOOKUP_CACHE_MAX_BITS (5 * W)
+// Whether a ctrie created with the default configuration overwrites the values of existing keys in place.
+#ifndef INPLACE_UPDATES
+#define INPLACE_UPDATES     (1)
+#endif
+
+typedef struct
+{
+    backoff_config_t backoff;
+    // The maximum number of entries, 0 means unbounded.
+    uint32_t         capacity;
+    // The levels above `root_bits` are pre-expanded into a wide root of 2^root_bits INodes, which never changes.
+    // Must be a multiple of W, at most WIDE_ROOT_MAX_BITS. 0 means a plain root.
+    uint8_t          root_bits;
+    // Operations start at the INode of level `lookup_cache_bits` of their key, found in a cache of 2^lookup_cache_bits
+    // entries. Must be a multiple of W above `root_bits`, at most LOOKUP_CACHE_MAX_BITS. 0 disables the cache.
+    uint8_t          lookup_cache_bits;
+    // Overwrites of existing keys CAS the value in their snode, instead of copying their CNode. Overwrites in
+    // lnode-lists, and overwrites while a checkpoint runs (which must see the old values), still copy.
+    uint8_t          inplace_updates;
+} ctrie_config_t;
+
 typedef struct ctrie_t
 {
-    inode_t* inode;
-    uint8_t  readonly;
+    inode_t*        inode;
+    uint8_t         readonly;
+    ctrie_config_t  config;
+    // Approximate number of entries, only maintained when the capacity is bounded.
+    volatile int64_t size;
+    // Advanced by every checkpoint, which reads the ctrie as it was at that moment.
+    volatile uint32_t gen;
+    // Set while a checkpoint starts, so only one starts at a time.
+    volatile uint8_t starting;
+    volatile uint8_t checkpointing;
+    // The generation of the last completed checkpoint, the base of the next incremental checkpoint.
+    uint32_t        checkpoint_gen;
+    // The INodes of the wide root by depth, `wide_root[depth]` is indexed by the hash bits above its level.
+    inode_t**       wide_root[WIDE_ROOT_MAX_BITS / W + 1];
+    // The INodes of level `lookup_cache_bits` by the hash bits above it, filled in as operations pass by (NULL if disabled).
+    inode_t* volatile* lookup_cache;
     int      (*insert) (struct ctrie_t* ctrie, int key, int value, thread_args_t* thread_args);
     int      (*remove) (struct ctrie_t* ctrie, int key, thread_args_t* thread_args);
     int      (*lookup) (struct ctrie_t* ctrie, int key, thread_args_t* thread_args);
+    // Applies up to TXN_MAX_OPS operations atomically, see txn_op_type_t.
+    int      (*transaction)(struct ctrie_t* ctrie, txn_op_t* ops, int num_of_ops, thread_args_t* thread_args);
     void     (*free)   (struct ctrie_t* ctrie);
 } ctrie_t;
 
+ctrie_config_t ctrie_default_config();
 ctrie_t* create_ctrie();
+ctrie_t* create_ctrie_with_config(const ctrie_config_t* config);
+int      ctrie_hash(int key);
 
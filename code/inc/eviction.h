@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// 0 means the ctrie is unbounded.
+#ifndef CACHE_CAPACITY
+#define CACHE_CAPACITY              (0)
+#endif
+// Each thread batches its size changes, so the ctrie's size may lag by up to CACHE_SIZE_BATCH per thread.
+#define CACHE_SIZE_BATCH            (32)
+// An insert which finds the ctrie over capacity evicts at most this many entries, so eviction keeps up with inserts.
+#define CACHE_EVICTIONS_PER_INSERT  (2)
+// The number of sampled leaves an insert may look at while evicting.
+#define CACHE_EVICTION_SAMPLES      (16)
+
+typedef struct {
+    uint32_t    seed;
+    int32_t     size_delta;
+    uint64_t    evictions;
+    uint64_t    second_chances;
+} eviction_t;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ctrie.h"
+
+// The root of a frozen ctrie is always the first frozen cnode.
+#define FROZEN_ROOT (0)
+
+/**
+ * A flattened CNode. Its children are `popcount(bmp)` consecutive entries starting at `first`,
+ * the child in position `pos` is at `first + popcount(bmp & ((1 << pos) - 1))`.
+ * Positions set in `inner` hold a child cnode / collision list, the rest hold (key, value) pairs.
+ * `lev` is the hash level of this cnode, single-child chains are skipped so it may grow by more than W.
+ **/
+typedef struct
+{
+    uint32_t bmp;
+    uint32_t inner;
+    uint32_t first;
+    uint32_t lev;
+} frozen_cnode_t;
+
+typedef struct
+{
+    int key;
+    int value;
+} frozen_snode_t;
+
+/**
+ * A child of an inner position.
+ * If `length` is 0, `index` is the frozen cnode index, otherwise the collision list is the `length`
+ * consecutive entries starting at `index`.
+ **/
+typedef struct
+{
+    uint32_t index;
+    uint32_t length;
+} frozen_child_t;
+
+typedef union
+{
+    frozen_snode_t snode;
+    frozen_child_t child;
+} frozen_entry_t;
+
+typedef struct frozen_ctrie_t
+{
+    frozen_cnode_t* cnodes;
+    frozen_entry_t* entries;
+    uint32_t        num_of_cnodes;
+    uint32_t        num_of_entries;
+    // The mapped image which holds `cnodes` and `entries`, or NULL if they were allocated.
+    void*           mapping;
+    size_t          mapping_size;
+    int             (*lookup) (struct frozen_ctrie_t* frozen, int key);
+    void            (*free)   (struct frozen_ctrie_t* frozen);
+} frozen_ctrie_t;
+
+frozen_ctrie_t* create_frozen_ctrie();
+frozen_ctrie_t* ctrie_freeze(ctrie_t* ctrie);
+ctrie_t*        frozen_thaw (frozen_ctrie_t* frozen);
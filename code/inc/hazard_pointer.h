@@ -1,8 +1,19 @@
 #pragma once
 
+#include "nodes.h"
+#include "backoff.h"
+#include "contention.h"
+#include "preemption.h"
+#include "eviction.h"
+#include "transaction.h"
+
 #define MAX_HAZARD_POINTERS                 (4)
 #define MAX_LIST_HAZARD_POINTERS            (2)
-#define NUM_OF_HAZARD_POINTERS              (MAX_HAZARD_POINTERS + MAX_LIST_HAZARD_POINTERS)
+// One per depth, protects the branch which contains the INode of that depth.
+#define MAX_PATH_HAZARD_POINTERS            (MAX_LEVELS)
+// Four per transaction operation, protect its INode and parent INode (their branches and main nodes) until it commits.
+#define MAX_TXN_HAZARD_POINTERS             (4 * TXN_MAX_OPS)
+#define NUM_OF_HAZARD_POINTERS              (MAX_HAZARD_POINTERS + MAX_LIST_HAZARD_POINTERS + MAX_PATH_HAZARD_POINTERS + MAX_TXN_HAZARD_POINTERS)
 #define TOTAL_HAZARD_POINTERS(thread_args)  (thread_args->num_of_threads * NUM_OF_HAZARD_POINTERS)
 #define FREE_LIST_SIZE                      (NUM_OF_THREADS * NUM_OF_HAZARD_POINTERS)
 #define FENCE                               do {__sync_synchronize();} while(0)
@@ -10,17 +21,32 @@
 #define PLACE_LIST_HP(thread_args, arg)     place_list_hazard_pointer((thread_args)->hp_lists[(thread_args)->index], arg)
 #define PLACE_TMP_HP(thread_args, arg)      PLACE_LIST_HP(thread_args, arg)
 #define REPLACE_LAST_HP(thread_args, arg)   replace_last_hazard_pointer((thread_args)->hp_lists[(thread_args)->index], arg)
+#define PLACE_PATH_HP(thread_args, depth, arg) place_path_hazard_pointer((thread_args)->hp_lists[(thread_args)->index], depth, arg)
+#define PLACE_TXN_HP(thread_args, slot, arg) place_txn_hazard_pointer((thread_args)->hp_lists[(thread_args)->index], slot, arg)
 
 typedef struct {
     void*   hazard_pointers[MAX_HAZARD_POINTERS];
     int     next_hp;
     void*   list_hazard_pointers[MAX_LIST_HAZARD_POINTERS];
     int     next_list_hp;
+    void*   path_hazard_pointers[MAX_PATH_HAZARD_POINTERS];
+    void*   txn_hazard_pointers[MAX_TXN_HAZARD_POINTERS];
+    // Set while the thread is in a ctrie operation, with the generation the operation started in, so a checkpoint can
+    // wait for the operations which started before it.
+    volatile uint8_t in_op;
+    volatile uint32_t op_gen;
 } hp_list_t;
 
 typedef struct {
     void*   free_list[FREE_LIST_SIZE];
     int     length;
+    // The longest the list got, and the times it was full of nodes which couldn't be freed (and the thread slept).
+    int     peak_length;
+    uint64_t stalls;
+    // Nodes retired while a checkpoint was running, they may still be read by the checkpoint.
+    void**  deferred;
+    int     num_of_deferred;
+    int     deferred_size;
 } free_list_t;
 
 typedef struct {
@@ -28,10 +54,22 @@ typedef struct {
     free_list_t*    free_list;
     int             index;
     int             num_of_threads;
+    backoff_t       backoff;
+    eviction_t      eviction;
+    contention_t    contention;
+    preemption_t    preemption;
+    // The ctrie's checkpoint generation when the current operation started, and whether a checkpoint was running.
+    uint32_t        op_gen;
+    uint8_t         checkpointing;
 } thread_args_t;
 
 void place_hazard_pointer(hp_list_t* hp_list, void* arg);
 void place_list_hazard_pointer(hp_list_t* hp_list, void* arg);
 void replace_last_hazard_pointer(hp_list_t* hp_list, void* arg);
+void place_path_hazard_pointer(hp_list_t* hp_list, int depth, void* arg);
+void place_txn_hazard_pointer(hp_list_t* hp_list, int slot, void* arg);
+void release_txn_hazard_pointers(hp_list_t* hp_list);
 void release_hazard_pointers(hp_list_t* hp_list);
 void add_to_free_list(thread_args_t* thread_args, void* arg);
+int  reclaim_free_list(thread_args_t* thread_args);
+void release_deferred(thread_args_t* thread_args);
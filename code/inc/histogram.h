@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+// Records the latency of every benchmarked operation, off by default so throughput runs don't pay for the timer.
+#ifndef LATENCY_HISTOGRAMS
+#define LATENCY_HISTOGRAMS          (0)
+#endif
+// Log-linear buckets: values under HISTOGRAM_SUB_BUCKETS have a bucket each, bigger ones share buckets whose width is
+// at most 2 / HISTOGRAM_SUB_BUCKETS of their values.
+#define HISTOGRAM_SUB_BITS          (6)
+#define HISTOGRAM_SUB_BUCKETS       (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS           ((64 - HISTOGRAM_SUB_BITS + 2) * (HISTOGRAM_SUB_BUCKETS / 2))
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define READ_TICKS()                (__rdtsc())
+#else
+#include "common.h"
+#define READ_TICKS()                ((uint64_t) monotonic_nsecs())
+#endif
+
+#if LATENCY_HISTOGRAMS
+#define RECORD_LATENCY(histogram, call) do {                \
+    uint64_t __start = READ_TICKS();                        \
+    call;                                                   \
+    histogram_record((histogram), READ_TICKS() - __start);  \
+} while (0)
+#else
+#define RECORD_LATENCY(histogram, call) do {                \
+    call;                                                   \
+} while (0)
+#endif
+
+/**
+ * Counts values, in ticks of READ_TICKS.
+ **/
+typedef struct
+{
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+double   nsecs_per_tick      ();
+void     histogram_record    (histogram_t* histogram, uint64_t value);
+void     histogram_merge     (histogram_t* histogram, const histogram_t* other);
+uint64_t histogram_percentile(const histogram_t* histogram, double percentile);
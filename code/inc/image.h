@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ctrie.h"
+#include "frozen.h"
+
+// "CTRIEIMG" in little-endian, also tells apart images of the other endianness.
+#define IMAGE_MAGIC     (0x474d494549525443ULL)
+#define IMAGE_VERSION   (1)
+
+/**
+ * The header of a ctrie image, followed by the frozen cnodes and then the frozen entries.
+ * All the nodes refer to each other by index, so the image is position-independent and can be mapped anywhere.
+ **/
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_of_cnodes;
+    uint32_t num_of_entries;
+    uint32_t reserved;
+    uint64_t payload_checksum;
+    uint64_t header_checksum;
+} image_header_t;
+
+int             ctrie_save     (ctrie_t* ctrie, const char* path);
+int             frozen_save    (frozen_ctrie_t* frozen, const char* path);
+frozen_ctrie_t* ctrie_open_mmap(const char* path);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Every action file is an int count followed by its fixed size records, see parser.h.
+#define INPUT_HEADER_SIZE       (sizeof(int))
+// A streamed file is read into a ring of INPUT_RING_CHUNKS chunks of INPUT_CHUNK_RECORDS records each.
+#ifndef INPUT_CHUNK_RECORDS
+#define INPUT_CHUNK_RECORDS     (1 << 20)
+#endif
+#define INPUT_RING_CHUNKS       (4)
+
+typedef enum
+{
+    // The whole file is read into the heap.
+    INPUT_READ,
+    // The file is mapped, with sequential read-ahead.
+    INPUT_MMAP,
+    // The file is mapped and all its pages are read in before it is used.
+    INPUT_POPULATE,
+    // The file is read chunk by chunk by a reader thread, while the previous chunks are used.
+    INPUT_STREAM,
+} input_mode_t;
+
+/**
+ * A slot of the ring, laid out like a whole action file of its chunk's records.
+ **/
+typedef struct
+{
+    void*               data;
+    // The number of chunks which were read into the slot, and the number of them which were used.
+    volatile uint64_t   filled;
+    volatile uint64_t   consumed;
+} input_slot_t;
+
+typedef struct
+{
+    input_mode_t        mode;
+    int                 fd;
+    // The whole file, in the modes that aren't streamed.
+    void*               data;
+    size_t              size;
+    size_t              record_size;
+    uint64_t            num_of_records;
+    uint64_t            num_of_chunks;
+    // The chunk input_next returns next, and whether the last one returned wasn't released yet.
+    uint64_t            next_chunk;
+    uint8_t             in_use;
+    input_slot_t        slots[INPUT_RING_CHUNKS];
+    pthread_t           reader;
+    uint8_t             reading;
+    volatile uint8_t    stop;
+    volatile uint8_t    failed;
+    // The time input_next waited for the reader.
+    int64_t             wait_time;
+} input_t;
+
+int   input_open   (input_t* input, const char* path, input_mode_t mode, size_t record_size);
+void* input_next   (input_t* input);
+void  input_release(input_t* input);
+void  input_close  (input_t* input);
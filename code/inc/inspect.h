@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ctrie.h"
+
+#define NUM_OF_NODE_TYPES   (LNODE + 1)
+// lnode-lists of this length and longer share the last bucket of the chain length histogram.
+#define INSPECT_MAX_CHAIN   (16)
+// The parallel inspection splits the ctrie into the subtrees of the INodes at this depth.
+#define INSPECT_SPLIT_DEPTH (2)
+
+typedef struct
+{
+    // The nodes of every node_type_t. INodes and SNodes are branches, every LNode of an lnode-list is counted.
+    uint64_t nodes[NUM_OF_NODE_TYPES];
+    uint64_t entries;
+    // CNodes by their number of branches.
+    uint64_t fanout[MAX_BRANCHES + 1];
+    // Entries by their depth, the number of INodes on their path.
+    uint64_t depth[MAX_LEVELS + 1];
+    // lnode-lists by their length, the last bucket holds the lists of INSPECT_MAX_CHAIN entries and longer.
+    uint64_t chain[INSPECT_MAX_CHAIN + 1];
+    uint32_t max_depth;
+    uint32_t max_chain;
+    // An estimate of the bytes allocated for the nodes, the wide root and the lookup cache.
+    uint64_t bytes;
+} ctrie_shape_t;
+
+int ctrie_inspect(ctrie_t* ctrie, ctrie_shape_t* shape, int num_of_threads);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 1 interposes malloc and free to count the live heap bytes by size class, which tells the node types apart.
+#ifndef MEMORY_ACCOUNTING
+#define MEMORY_ACCOUNTING   (0)
+#endif
+// The allocations are counted by their usable size in classes of MEMORY_CLASS_BYTES, the last holds the larger ones.
+#define MEMORY_CLASS_BYTES  (16)
+#define MEMORY_CLASSES      (64)
+// The threads add to the counts of one of these shards, by the order they first allocated in.
+#define MEMORY_SHARDS       (64)
+
+typedef struct
+{
+    // The live usable bytes and allocations of every class.
+    int64_t bytes[MEMORY_CLASSES];
+    int64_t allocations[MEMORY_CLASSES];
+} memory_usage_t;
+
+/**
+ * Samples the resident set size of the process while a phase runs.
+ **/
+typedef struct
+{
+    pthread_t           tid;
+    uint32_t            interval_ms;
+    volatile uint8_t    stop;
+    uint64_t            samples;
+    uint64_t            peak_rss;
+    uint64_t            last_rss;
+} memory_sampler_t;
+
+int      memory_usage        (memory_usage_t* usage);
+int      memory_class        (size_t size);
+uint64_t memory_heap_bytes   ();
+uint64_t memory_rss          ();
+int      memory_sampler_start(memory_sampler_t* sampler, uint32_t interval_ms);
+void     memory_sampler_stop (memory_sampler_t* sampler);
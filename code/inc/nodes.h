@@ -5,6 +5,8 @@
 #define W 5
 // The maximun number of branches going out of a CNode. Must match the bitmap size.
 #define MAX_BRANCHES (1 << W)
+// The maximum number of INodes on a path: one per CNode level of the 32-bit hash, and one for the LNode level.
+#define MAX_LEVELS ((MAX_BRANCHES + W - 1) / W + 1)
 
 typedef struct main_node_t main_node_t;
 
@@ -19,8 +21,20 @@ typedef enum
 
 typedef struct
 {
-    int key;
-    int value;
+    // The value shares a word with the sealed flag, so an overwrite in place is a single CAS which fails once the
+    // snode is sealed (before it is copied or removed).
+    union
+    {
+        struct
+        {
+            int      value;
+            uint32_t sealed;
+        };
+        uint64_t slot;
+    };
+    int     key;
+    // CLOCK access bit, set by lookups and cleared by the eviction of a capacity bounded ctrie.
+    uint8_t referenced;
 } snode_t;
 
 typedef struct 
@@ -39,6 +53,10 @@ typedef struct
 {
     main_node_t* main;
     uint8_t marked;
+    // Set for the root and the INodes of a wide root, which are never entombed (so never unlinked or marked).
+    uint8_t fixed;
+    // The checkpoint generation of the last change in this INode's subtree.
+    uint32_t dirty;
 } inode_t;
 
 typedef struct
@@ -62,6 +80,10 @@ typedef struct
 struct main_node_t 
 {
     node_type_t type;
+    // The checkpoint generation in which this main node was created.
+    uint32_t gen;
+    // The main node this one replaced, kept only while a checkpoint of generation `gen` is running.
+    main_node_t* prev;
     union
     {
         cnode_t cnode;
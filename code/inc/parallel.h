@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ctrie.h"
+#include "hazard_pointer.h"
+
+// Must be a power of 2. The owner pops the newest task first, so a deque never holds more than MAX_BRANCHES per level.
+#define PARALLEL_DEQUE_SIZE (512)
+
+typedef void (*ctrie_foreach_fn_t)(int key, int value, void* arg);
+// Folds (`key`, `value`) into `accumulator`.
+typedef void (*ctrie_reduce_fn_t)(void* accumulator, int key, int value, void* arg);
+// Folds `other` (a worker's accumulator) into `accumulator`.
+typedef void (*ctrie_combine_fn_t)(void* accumulator, const void* other, void* arg);
+
+int ctrie_parallel_foreach(ctrie_t* ctrie, ctrie_foreach_fn_t foreach, void* arg, thread_args_t threads_args[], int num_of_threads);
+int ctrie_parallel_reduce (ctrie_t* ctrie, ctrie_reduce_fn_t reduce, ctrie_combine_fn_t combine, void* accumulator, size_t accumulator_size,
+                           void* arg, thread_args_t threads_args[], int num_of_threads);
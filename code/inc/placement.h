@@ -0,0 +1,44 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The most CPUs a placement spreads the threads over, as many as a cpu_set_t holds.
+#define PLACEMENT_MAX_CPUS      (1024)
+
+typedef enum
+{
+    // The threads aren't pinned, the scheduler places them.
+    PLACEMENT_NONE,
+    // Every SMT sibling of a core, then every core of a socket, before the next socket.
+    PLACEMENT_COMPACT,
+    // Round robin over the sockets, a core at a time, before any SMT sibling.
+    PLACEMENT_SCATTER,
+    // Every core of a socket, then the next socket, before any SMT sibling.
+    PLACEMENT_CORES,
+} placement_policy_t;
+
+typedef struct
+{
+    int         cpu;
+    int         package;
+    int         core;
+    // The rank of the core among the cores of its package, and of the CPU among the SMT siblings of its core.
+    int         core_rank;
+    int         sibling;
+} placement_cpu_t;
+
+typedef struct
+{
+    placement_policy_t  policy;
+    uint32_t            num_of_cpus;
+    // The CPUs the process may run on, in the order the threads are placed on them.
+    placement_cpu_t     cpus[PLACEMENT_MAX_CPUS];
+} placement_t;
+
+int  placement_init(placement_t* placement, placement_policy_t policy);
+int  placement_cpu (const placement_t* placement, uint32_t thread);
+int  placement_attr(const placement_t* placement, uint32_t thread, pthread_attr_t* attr);
+void placement_map (const placement_t* placement, uint32_t num_of_threads, char* buffer, size_t size);
+uint32_t placement_available_cpus();
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// 1 lets -P preempt the operations at random points, while they hold hazard pointers (or a baseline's lock).
+#ifndef PREEMPTION_INJECTION
+#define PREEMPTION_INJECTION    (0)
+#endif
+// On average, one in this many preemption points preempts the operation.
+#ifndef PREEMPTION_ONE_IN
+#define PREEMPTION_ONE_IN       (64)
+#endif
+// How long an injected sleep lasts.
+#define PREEMPTION_SLEEP_NSECS  (50000)
+
+typedef enum
+{
+    PREEMPT_NONE,
+    // The thread yields its CPU to any thread waiting for it.
+    PREEMPT_YIELD,
+    // The thread sleeps for PREEMPTION_SLEEP_NSECS, as if it was descheduled.
+    PREEMPT_SLEEP,
+} preempt_mode_t;
+
+typedef struct
+{
+    uint32_t    seed;
+    uint64_t    preemptions;
+} preemption_t;
+
+extern preempt_mode_t preempt_mode;
+
+void preempt(preemption_t* preemption, int index);
+
+#if PREEMPTION_INJECTION
+#define PREEMPTION_POINT(thread_args) do {                              \
+    if (preempt_mode != PREEMPT_NONE)                                   \
+    {                                                                   \
+        preempt(&((thread_args)->preemption), (thread_args)->index);    \
+    }                                                                   \
+} while (0)
+#else
+#define PREEMPTION_POINT(thread_args) do {} while (0)
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "ctrie.h"
+
+typedef enum
+{
+    // The entries of both ctries, the right value wins when a key is in both.
+    SET_UNION,
+    // The entries of the left ctrie whose keys are in the right one.
+    SET_INTERSECTION,
+    // The entries of the left ctrie whose keys are not in the right one.
+    SET_DIFFERENCE,
+} set_op_t;
+
+ctrie_t* ctrie_set_op      (set_op_t op, ctrie_t* left, ctrie_t* right, int num_of_threads);
+ctrie_t* ctrie_union       (ctrie_t* left, ctrie_t* right, int num_of_threads);
+ctrie_t* ctrie_intersection(ctrie_t* left, ctrie_t* right, int num_of_threads);
+ctrie_t* ctrie_difference  (ctrie_t* left, ctrie_t* right, int num_of_threads);
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include "common.h"
+#endif
+
+// 1 records the events of every thread in a ring, which is dumped by the trace phase and at exit (see -T).
+#ifndef TRACING
+#define TRACING             (0)
+#endif
+// The events a thread keeps, its older events are overwritten. A power of 2.
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS   (1 << 16)
+#endif
+// A ring for every worker and the compactor.
+#define TRACE_THREADS       (NUM_OF_THREADS + 1)
+#define TRACE_MAGIC         ("CTRTRACE")
+
+/**
+ * The events, the meaning of an event's key and argument depends on its type.
+ **/
+typedef enum
+{
+    // An operation on `key` started, the argument is its trace_op_t.
+    TRACE_OP_START,
+    // The operation on `key` ended, the argument is its result.
+    TRACE_OP_END,
+    // A CAS of an operation on `key` failed, the argument is the depth of its INode.
+    TRACE_CAS_FAIL,
+    // A node was retired, the argument is its address.
+    TRACE_RETIRE,
+    // The free list was scanned, `key` nodes were freed and the argument is the number of nodes left in it.
+    TRACE_SCAN,
+    // An INode was cleaned, the argument is its hash level.
+    TRACE_CLEAN,
+} trace_type_t;
+
+typedef enum
+{
+    TRACE_LOOKUP,
+    TRACE_INSERT,
+    TRACE_REMOVE,
+    TRACE_TRANSACTION,
+} trace_op_t;
+
+typedef struct
+{
+    uint64_t    ticks;
+    int64_t     arg;
+    int32_t     key;
+    uint16_t    type;
+    uint16_t    thread;
+} trace_event_t;
+
+/**
+ * A dump is this header, followed by the events of every thread (each thread's from the oldest).
+ **/
+typedef struct
+{
+    char        magic[8];
+    uint32_t    event_size;
+    uint32_t    num_of_threads;
+    // Converts the events' ticks to nanoseconds since `start_ticks`.
+    double      ticks_per_nsec;
+    uint64_t    start_ticks;
+    uint64_t    num_of_events;
+} trace_header_t;
+
+typedef struct
+{
+    trace_event_t   events[TRACE_RING_EVENTS];
+    // The events ever written, the next is written at `next` modulo TRACE_RING_EVENTS.
+    uint64_t        next;
+} trace_ring_t;
+
+/**
+ * @return the time stamp counter, or the monotonic clock's nanoseconds where there is none.
+ **/
+static inline uint64_t trace_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_nsecs();
+#endif
+}
+
+#if TRACING
+extern trace_ring_t trace_rings[TRACE_THREADS];
+
+/**
+ * Records an event in the ring of its thread, which only that thread writes.
+ * @param thread: the index of the thread.
+ * @param type: the event's type.
+ * @param key: the event's key.
+ * @param arg: the event's argument.
+ **/
+static inline void trace_event(int thread, trace_type_t type, int key, int64_t arg)
+{
+    trace_ring_t*  ring  = &(trace_rings[thread]);
+    trace_event_t* event = &(ring->events[ring->next & (TRACE_RING_EVENTS - 1)]);
+    event->ticks    = trace_ticks();
+    event->arg      = arg;
+    event->key      = key;
+    event->type     = type;
+    event->thread   = thread;
+    ring->next++;
+}
+
+#define TRACE(thread_args, type, key, arg)  trace_event((thread_args)->index, type, key, (int64_t) (arg))
+#else
+#define TRACE(thread_args, type, key, arg)  do {} while (0)
+#endif
+
+void trace_start(const char* path);
+int  trace_dump (const char* path);
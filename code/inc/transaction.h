@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "nodes.h"
+
+// The maximum number of operations in a transaction.
+#define TXN_MAX_OPS             (4)
+// A transaction changes the INode of every operation, and the parent of every lnode-list it empties.
+#define TXN_MAX_ENTRIES         (2 * TXN_MAX_OPS)
+
+// While a transaction commits, the main nodes it changes point to its descriptor, tagged by the lowest bit.
+#define TXN_TAGGED(main_node)   ((uintptr_t) (main_node) & 1)
+#define TXN_TAG(desc)           ((main_node_t*) ((uintptr_t) (desc) | 1))
+#define TXN_DESC(main_node)     ((txn_desc_t*) ((uintptr_t) (main_node) & ~((uintptr_t) 1)))
+
+typedef enum
+{
+    // Inserts (`key`, `value`), or updates `key`'s value.
+    TXN_INSERT,
+    // Removes `key`, the transaction fails with NOTFOUND if it is missing. `value` is set to the removed value.
+    TXN_REMOVE,
+    // Requires `key` to have `value`, otherwise the transaction fails with NOTFOUND.
+    TXN_EXPECT
+} txn_op_type_t;
+
+typedef struct
+{
+    txn_op_type_t type;
+    int           key;
+    int           value;
+} txn_op_t;
+
+typedef enum
+{
+    TXN_UNDECIDED,
+    TXN_SUCCEEDED,
+    TXN_FAILED
+} txn_status_t;
+
+typedef struct
+{
+    inode_t*     inode;
+    main_node_t* old;
+    main_node_t* new;
+    // Set if the transaction unlinks the INode from its parent (when it empties its lnode-list).
+    uint8_t      unlink;
+} txn_entry_t;
+
+/**
+ * A committing transaction, installed in the main of every INode it changes.
+ * The owner installs it in all the INodes and then decides it, anyone who finds it undecided aborts it.
+ * Once decided, anyone who finds it replaces it with the new main node (or back with the old one).
+ **/
+typedef struct
+{
+    volatile int status;
+    int          num_of_entries;
+    txn_entry_t  entries[TXN_MAX_ENTRIES];
+} txn_desc_t;
+
+txn_entry_t* txn_entry(txn_desc_t* desc, inode_t* inode);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "parser.h"
+
+// The defaults of a workload's specification.
+#define WORKLOAD_OPS            (1000000)
+#define WORKLOAD_KEYS           (1000000)
+#define WORKLOAD_THETA          (0.99)
+#define WORKLOAD_HOT_KEYS       (0.2)
+#define WORKLOAD_HOT_OPS        (0.8)
+#define WORKLOAD_SEED           (1)
+
+typedef enum
+{
+    DIST_UNIFORM,
+    // Key i is picked with probability proportional to 1 / (i + 1)^theta.
+    DIST_ZIPFIAN,
+    // Every thread walks the key space from its first operation on.
+    DIST_SEQUENTIAL,
+    // A `hot_keys` fraction of the key space gets a `hot_ops` fraction of the operations.
+    DIST_HOTSPOT,
+    // Inserts add new keys, and the other operations pick zipfian distances from the newest key.
+    DIST_LATEST,
+} distribution_t;
+
+typedef struct
+{
+    uint64_t        ops;
+    // Keys are picked by their rank in [0, keys), except new ones of DIST_LATEST.
+    uint32_t        keys;
+    distribution_t  distribution;
+    double          theta;
+    double          hot_keys;
+    double          hot_ops;
+    // The percentage of every action_type_t in the operations.
+    uint32_t        mix[REMOVE + 1];
+    uint64_t        seed;
+    // Generate the operations while they are timed, instead of into a buffer before.
+    uint8_t         on_the_fly;
+    // Scatter consecutive ranks over the ctrie (the hash is key / 10), rather than use them as keys.
+    uint8_t         scramble;
+} workload_config_t;
+
+typedef struct
+{
+    workload_config_t config;
+    // The constants of the zipfian generator over `keys` ranks.
+    double            zeta_n;
+    double            alpha;
+    double            eta;
+    double            half_pow_theta;
+} workload_t;
+
+/**
+ * A thread's generator of operations, each thread has an independent random stream.
+ **/
+typedef struct
+{
+    const workload_t*   workload;
+    uint64_t            state;
+    // The index of the next operation in the whole workload.
+    uint64_t            op;
+    // The number of threads generating the workload, DIST_LATEST interleaves their new keys.
+    uint32_t            num_of_threads;
+    uint32_t            thread;
+    uint64_t            inserted;
+} workload_stream_t;
+
+int  workload_init       (workload_t* workload, const char* spec);
+void workload_stream_init(workload_stream_t* stream, const workload_t* workload, uint32_t thread,
+                          uint32_t num_of_threads, uint64_t first_op);
+void workload_next       (workload_stream_t* stream, action_t* action);
@@ -1,9 +1,9 @@
 import collections
+import csv
 import matplotlib
 matplotlib.use('Agg')
 import matplotlib.pyplot as plt
 import numpy
-import os
 import re
 import sys
 
@@ -13,10 +13,7 @@ SCALA_LOOKUP_REGEX = re.compile('lookup in (\d+)')
 SCALA_REMOVE_REGEX = re.compile('remove in (\d+)')
 SCALA_ACTION_REGEX = re.compile('action in (\d+)')
 
-C_INSERT_REGEX = re.compile('Insert took (\d+)')
-C_LOOKUP_REGEX = re.compile('Lookup took (\d+)')
-C_REMOVE_REGEX = re.compile('Remove took (\d+)')
-C_ACTION_REGEX = re.compile('Action took (\d+)')
+C_ACTIONS = ('insert', 'lookup', 'remove', 'action')
 
 Result = collections.namedtuple('Result', 'threads avg var min max')
 
@@ -45,32 +42,15 @@ def plot(xs, ys, colors, x_label, y_label, title, func_labels=None, x_scale=None
     matplotlib.pyplot.close(f)
 
 def c_to_dicts(path):
-    insert_d = collections.defaultdict(list)
-    lookup_d = collections.defaultdict(list)
-    remove_d = collections.defaultdict(list)
-    action_d = collections.defaultdict(list)
+    """Reads the results file of a benchmark (its -o option), the times of every action by the number of threads."""
+    dicts = dict((action, collections.defaultdict(list)) for action in C_ACTIONS)
 
-    for root, dirs, files in os.walk(path):
-        if dirs:
-            continue
-        thread_num = int(os.path.basename(root))
-        for f in files:
-            with open(os.path.join(root, f)) as reader:
-                data = reader.read()
-            m = C_INSERT_REGEX.search(data)
-            if m:
-                insert_d[thread_num].append(int(m.group(1)))
-            m = C_LOOKUP_REGEX.search(data)
-            if m:
-                lookup_d[thread_num].append(int(m.group(1)))
-            m = C_REMOVE_REGEX.search(data)
-            if m:
-                remove_d[thread_num].append(int(m.group(1)))
-            m = C_ACTION_REGEX.search(data)
-            if m:
-                action_d[thread_num].append(int(m.group(1)))
+    with open(path) as reader:
+        for row in csv.DictReader(reader):
+            if row['action'] in dicts:
+                dicts[row['action']][int(row['threads'])].append(int(row['nsecs']))
 
-    return insert_d, lookup_d, remove_d, action_d
+    return tuple(dicts[action] for action in C_ACTIONS)
 
 def scala_to_dicts(path):
     insert_d = collections.defaultdict(list)
@@ -142,6 +122,6 @@ def main(subtitle, scala_path, c_path):
 
 if __name__ == '__main__':
     if len(sys.argv) != 4:
-        print('Usage: {} <subtitle> <scala-file> <c-dir>'.format(sys.argv[0]))
+        print('Usage: {} <subtitle> <scala-file> <c-results.csv>'.format(sys.argv[0]))
         sys.exit(1)
     main(*sys.argv[1:])
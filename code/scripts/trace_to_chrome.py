@@ -0,0 +1,69 @@
+import json
+import struct
+import sys
+
+# trace_header_t and trace_event_t of inc/trace.h.
+header_fmt  = '<8sIIdQQ'
+header_size = struct.calcsize(header_fmt)
+event_fmt   = '<QqiHH'
+magic       = b'CTRTRACE'
+
+class EventType(object):
+    OP_START    = 0
+    OP_END      = 1
+    CAS_FAIL    = 2
+    RETIRE      = 3
+    SCAN        = 4
+    CLEAN       = 5
+
+OP_NAMES    = ('lookup', 'insert', 'remove', 'transaction')
+INSTANTS    = {
+    EventType.CAS_FAIL: ('cas_fail', lambda key, arg: {'key': key, 'depth': arg}),
+    EventType.RETIRE:   ('retire', lambda key, arg: {'node': hex(arg)}),
+    EventType.SCAN:     ('scan', lambda key, arg: {'freed': key, 'left': arg}),
+    EventType.CLEAN:    ('clean', lambda key, arg: {'lev': arg}),
+}
+
+def read_events(path):
+    """Reads a trace dump (the trace phase or -T), returns its header fields and its events."""
+    with open(path, 'rb') as reader:
+        data = reader.read()
+    magic_, event_size, num_of_threads, ticks_per_nsec, start_ticks, num_of_events = \
+        struct.unpack_from(header_fmt, data)
+    if magic_ != magic or event_size != struct.calcsize(event_fmt):
+        raise ValueError('{} is not a trace'.format(path))
+    events = [struct.unpack_from(event_fmt, data, header_size + i * event_size) for i in range(num_of_events)]
+    return ticks_per_nsec, start_ticks, events
+
+def to_chrome(ticks_per_nsec, start_ticks, events):
+    """Converts the events to the Trace Event Format, which chrome://tracing and Perfetto open."""
+    trace   = []
+    # The operations each thread is in, an end whose start was overwritten in the ring is dropped.
+    open_   = {}
+    for ticks, arg, key, type_, thread in events:
+        ts      = (ticks - start_ticks) / ticks_per_nsec / 1000.0
+        common  = {'pid': 0, 'tid': thread, 'ts': ts}
+        if type_ == EventType.OP_START:
+            open_[thread] = open_.get(thread, 0) + 1
+            trace.append(dict(common, ph='B', name=OP_NAMES[arg], args={'key': key}))
+        elif type_ == EventType.OP_END:
+            if open_.get(thread, 0) == 0:
+                continue
+            open_[thread] -= 1
+            trace.append(dict(common, ph='E', args={'result': arg}))
+        elif type_ in INSTANTS:
+            name, args = INSTANTS[type_]
+            trace.append(dict(common, ph='i', s='t', name=name, args=args(key, arg)))
+    for thread in sorted(set(event[4] for event in events)):
+        trace.append({'pid': 0, 'tid': thread, 'ph': 'M', 'name': 'thread_name', 'args': {'name': 'thread {}'.format(thread)}})
+    return {'traceEvents': trace, 'displayTimeUnit': 'ns'}
+
+def main(trace_path, json_path):
+    with open(json_path, 'w') as writer:
+        json.dump(to_chrome(*read_events(trace_path)), writer)
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print('Usage: {} <trace_file> <json_file>'.format(sys.argv[0]))
+        sys.exit(1)
+    main(*sys.argv[1:])
@@ -0,0 +1,71 @@
+#include "backoff.h"
+#include "common.h"
+
+/**
+ * Advances the thread's random generator, used to jitter the backoff.
+ * @param backoff: the thread's backoff state.
+ * @param index: the thread's index, seeds the generator on first use.
+ * @return a pseudo random number.
+ **/
+static uint32_t next_random(backoff_t* backoff, int index)
+{
+    if (backoff->seed == 0)
+    {
+        // Knuth's multiplicative hash, so every thread gets a different (non zero) sequence.
+        backoff->seed = 2654435761u * (uint32_t) (index + 1);
+    }
+    return xorshift32(&(backoff->seed));
+}
+
+/**
+ * Records a failed CAS and backs off before the operation is retried.
+ * The window doubles on consecutive failures, and the actual wait is a random part of it, scaled by the
+ * recent failure rate, so rare conflicts retry right away and hot spots spread the retries out.
+ * @param backoff: the thread's backoff state.
+ * @param config: the ctrie's backoff configuration.
+ * @param index: the thread's index.
+ **/
+void backoff_failure(backoff_t* backoff, const backoff_config_t* config, int index)
+{
+    uint32_t spins  = 0;
+    uint32_t i      = 0;
+
+    backoff->failures++;
+    backoff->failure_rate += (BACKOFF_RATE_ONE - backoff->failure_rate) >> BACKOFF_RATE_SHIFT;
+    if (config->min_spins == 0)
+    {
+        return;
+    }
+
+    if (backoff->window < config->min_spins)
+    {
+        backoff->window = config->min_spins;
+    }
+    else if (backoff->window < config->max_spins / 2)
+    {
+        backoff->window *= 2;
+    }
+    else
+    {
+        backoff->window = config->max_spins;
+    }
+
+    spins = next_random(backoff, index) % (backoff->window + 1);
+    spins = (uint32_t) (((uint64_t) spins * backoff->failure_rate) / BACKOFF_RATE_ONE);
+    backoff->backoffs++;
+    backoff->spins += spins;
+    for (i = 0; i < spins; i++)
+    {
+        CPU_RELAX;
+    }
+}
+
+/**
+ * Records a successful update, decaying the failure rate and the backoff window.
+ * @param backoff: the thread's backoff state.
+ **/
+void backoff_success(backoff_t* backoff)
+{
+    backoff->failure_rate -= backoff->failure_rate >> BACKOFF_RATE_SHIFT;
+    backoff->window >>= 1;
+}
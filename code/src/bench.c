@@ -0,0 +1,501 @@
+#include <getopt.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "bench.h"
+
+#define BENCH_LIST_SEPARATOR    (',')
+
+static const char* op_names[BENCH_OP_TYPES] = { "insert", "lookup", "remove" };
+// By restart_cause_t.
+static const char* restart_names[NUM_OF_RESTART_CAUSES] = {
+    "marked_inode", "changed_main", "cas_failed", "tnode", "lnode_marked", "txn"
+};
+// By input_mode_t.
+static const char* input_mode_names[] = { "read", "mmap", "populate", "stream" };
+// By map_type_t.
+static const char* map_names[] = { "ctrie", "striped", "split", "rwlock" };
+// By placement_policy_t.
+static const char* placement_names[] = { "none", "compact", "scatter", "cores" };
+// By preempt_mode_t.
+static const char* preempt_names[] = { "none", "yield", "sleep" };
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int  parse_count        (const char* str, uint32_t min, uint32_t max, uint32_t* count);
+static int  parse_threads      (const char* str, bench_config_t* config);
+static int  parse_choice       (const char* str, const char* names[], int num_of_names, int* choice);
+static void write_csv_string   (FILE* fp, const char* str);
+static void write_json_string  (FILE* fp, const char* str);
+static void write_csv_latency  (FILE* fp, const bench_latency_t* latency);
+static void write_json_latency (FILE* fp, const char* name, const bench_latency_t* latency);
+static int  counter_per_op     (const bench_result_t* result, counter_type_t type, double* per_op);
+
+/**
+ * Parses a whole decimal number in [min, max].
+ * @param str: the string.
+ * @param min: the smallest allowed number.
+ * @param max: the biggest allowed number.
+ * @param count: an out parameter that is set to the number.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int parse_count(const char* str, uint32_t min, uint32_t max, uint32_t* count)
+{
+    char*         end   = NULL;
+    unsigned long value = strtoul(str, &end, 10);
+    if (end == str || *end != '\0' || value < min || value > max)
+    {
+        FAIL("Invalid number %s, expected %u to %u", str, min, max);
+    }
+    *count = value;
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Parses a comma separated list of thread counts, e.g. "1,2,4,8".
+ * @param str: the list.
+ * @param config: the configuration, its thread counts are set.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int parse_threads(const char* str, bench_config_t* config)
+{
+    char  count[16] = {0};
+    const char* next = NULL;
+    config->num_of_counts = 0;
+    while (*str != '\0')
+    {
+        next = strchr(str, BENCH_LIST_SEPARATOR);
+        size_t length = next == NULL ? strlen(str) : (size_t) (next - str);
+        if (length == 0 || length >= sizeof(count))
+        {
+            FAIL("Invalid thread count in %s", str);
+        }
+        if (config->num_of_counts == BENCH_MAX_SWEEP)
+        {
+            FAIL("More than %d thread counts", BENCH_MAX_SWEEP);
+        }
+        memcpy(count, str, length);
+        count[length] = '\0';
+        if (parse_count(count, 1, NUM_OF_THREADS, &(config->threads[config->num_of_counts])) != OK)
+        {
+            FAIL("Invalid thread count %s", count);
+        }
+        config->num_of_counts++;
+        str += length + (next != NULL);
+    }
+    if (config->num_of_counts == 0)
+    {
+        FAIL("No thread counts");
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Parses one of a list of names.
+ * @param str: the name.
+ * @param names: the allowed names.
+ * @param num_of_names: the number of allowed names.
+ * @param choice: an out parameter that is set to the index of the name.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int parse_choice(const char* str, const char* names[], int num_of_names, int* choice)
+{
+    int i = 0;
+    for (i = 0; i < num_of_names; i++)
+    {
+        if (strcmp(str, names[i]) == 0)
+        {
+            *choice = i;
+            return OK;
+        }
+    }
+    return FAILED;
+}
+
+/**
+ * Parses the options of a benchmark, which precede its phases:
+ *  -t <n,n,..>     the thread counts to sweep, NUM_OF_THREADS by default.
+ *  -w <n>          warm-up runs of the phases, for every thread count.
+ *  -r <n>          recorded runs of the phases, for every thread count.
+ *  -f <csv|json>   the format of the results.
+ *  -o <path>       where the results are written.
+ *  -i <read|mmap|populate|stream>  how the action files are read, mapped by default.
+ *  -p <none|compact|scatter|cores> where the workers are pinned, not at all by default.
+ *  -m <ctrie|striped|split|rwlock> the map the phases run on, the ctrie by default.
+ *  -O <n,n,..>     the thread counts to sweep per CPU the process can use (e.g. 2,4,8), instead of -t.
+ *  -P <none|yield|sleep>   how the operations are preempted at random, with PREEMPTION_INJECTION.
+ * @param argc: the number of arguments.
+ * @param argv: the arguments.
+ * @param config: an out parameter that is set to the configuration.
+ * @param first_phase: an out parameter that is set to the index of the first argument after the options.
+ * @return OK on success, otherwise FAILED.
+ **/
+int bench_parse_args(int argc, char* argv[], bench_config_t* config, int* first_phase)
+{
+    int option = 0;
+    int choice = 0;
+    *config = (bench_config_t) {
+        .threads        = { NUM_OF_THREADS },
+        .num_of_counts  = 1,
+        .repetitions    = BENCH_DEFAULT_REPETITIONS,
+        .format         = BENCH_CSV,
+        .input_mode     = INPUT_MMAP,
+    };
+    // Options end at the first phase.
+    while ((option = getopt(argc, argv, "+t:w:r:f:o:i:p:m:T:M:O:P:")) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            if (parse_threads(optarg, config) != OK)
+            {
+                FAIL("Invalid thread counts: %s", optarg);
+            }
+            config->oversubscribe = 0;
+            break;
+        case 'w':
+            if (parse_count(optarg, 0, UINT32_MAX, &(config->warmups)) != OK)
+            {
+                FAIL("Invalid number of warm-ups: %s", optarg);
+            }
+            break;
+        case 'r':
+            if (parse_count(optarg, 1, UINT32_MAX, &(config->repetitions)) != OK)
+            {
+                FAIL("Invalid number of repetitions: %s", optarg);
+            }
+            break;
+        case 'f':
+            if (strcmp(optarg, "csv") == 0)
+            {
+                config->format = BENCH_CSV;
+            }
+            else if (strcmp(optarg, "json") == 0)
+            {
+                config->format = BENCH_JSON;
+            }
+            else
+            {
+                FAIL("Unknown format: %s", optarg);
+            }
+            break;
+        case 'o':
+            config->output_path = optarg;
+            break;
+        case 'i':
+            if (parse_choice(optarg, input_mode_names, sizeof(input_mode_names) / sizeof(input_mode_names[0]),
+                             &choice) != OK)
+            {
+                FAIL("Unknown input mode: %s", optarg);
+            }
+            config->input_mode = choice;
+            break;
+        case 'p':
+            if (parse_choice(optarg, placement_names, sizeof(placement_names) / sizeof(placement_names[0]),
+                             &choice) != OK)
+            {
+                FAIL("Unknown placement: %s", optarg);
+            }
+            config->placement = choice;
+            break;
+        case 'm':
+            if (parse_choice(optarg, map_names, sizeof(map_names) / sizeof(map_names[0]), &choice) != OK)
+            {
+                FAIL("Unknown map: %s", optarg);
+            }
+            config->map = choice;
+            break;
+        case 'T':
+            config->trace_path = optarg;
+            break;
+        case 'M':
+            if (parse_count(optarg, 1, UINT32_MAX, &(config->memory_interval_ms)) != OK)
+            {
+                FAIL("Invalid memory sampling interval: %s", optarg);
+            }
+            break;
+        case 'O':
+            if (parse_threads(optarg, config) != OK)
+            {
+                FAIL("Invalid threads per CPU: %s", optarg);
+            }
+            config->oversubscribe = 1;
+            break;
+        case 'P':
+            if (parse_choice(optarg, preempt_names, sizeof(preempt_names) / sizeof(preempt_names[0]), &choice) != OK)
+            {
+                FAIL("Unknown preemption: %s", optarg);
+            }
+            config->preempt = choice;
+            break;
+        default:
+            FAIL("Unknown option");
+        }
+    }
+    *first_phase = optind;
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+static void write_csv_string(FILE* fp, const char* str)
+{
+    if (strpbrk(str, ",\"\n") == NULL)
+    {
+        fputs(str, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"')
+        {
+            fputc('"', fp);
+        }
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+static void write_json_string(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fputc('\\', fp);
+        }
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+static void write_csv_latency(FILE* fp, const bench_latency_t* latency)
+{
+    // Operations that didn't run have empty fields.
+    if (latency->count == 0)
+    {
+        fputs(",,,,,,", fp);
+        return;
+    }
+    fprintf(fp, ",%lu,%.0f,%.0f,%.0f,%.0f,%.0f", latency->count, latency->p50, latency->p90, latency->p99,
+            latency->p999, latency->max);
+}
+
+/**
+ * Normalizes a hardware counter of a phase by its operations.
+ * @param result: the phase's result.
+ * @param type: the counter.
+ * @param per_op: an out parameter that is set to the counter's value per operation.
+ * @return OK on success, otherwise FAILED (if the counter wasn't counted by every worker, or there are no operations).
+ **/
+static int counter_per_op(const bench_result_t* result, counter_type_t type, double* per_op)
+{
+    if (result->ops <= 0 || (result->counters.missing & (1 << type)))
+    {
+        return FAILED;
+    }
+    *per_op = (double) result->counters.values[type] / result->ops;
+    return OK;
+}
+
+static void write_json_latency(FILE* fp, const char* name, const bench_latency_t* latency)
+{
+    fprintf(fp, ", \"%s_latency\": ", name);
+    if (latency->count == 0)
+    {
+        fputs("null", fp);
+        return;
+    }
+    fprintf(fp, "{\"count\": %lu, \"p50_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, "
+            "\"max_ns\": %.0f}", latency->count, latency->p50, latency->p90, latency->p99, latency->p999, latency->max);
+}
+
+/**
+ * @param type: an operation type.
+ * @return the operation's name.
+ **/
+const char* bench_op_name(action_type_t type)
+{
+    return op_names[type];
+}
+
+/**
+ * @param cause: a restart cause.
+ * @return the cause's name.
+ **/
+const char* bench_restart_name(restart_cause_t cause)
+{
+    return restart_names[cause];
+}
+
+/**
+ * Opens the results of a benchmark, nothing is written if the configuration has no output path.
+ * @param report: the results.
+ * @param config: the benchmark's configuration.
+ * @return OK on success, otherwise FAILED.
+ **/
+int bench_open(bench_report_t* report, const bench_config_t* config)
+{
+    int i = 0;
+    *report = (bench_report_t) { .format = config->format };
+    if (config->output_path == NULL)
+    {
+        return OK;
+    }
+    report->fp = fopen(config->output_path, "w");
+    if (report->fp == NULL)
+    {
+        FAIL("Failed to fopen %s", config->output_path);
+    }
+    if (report->format == BENCH_CSV)
+    {
+        fputs("map,threads,placement,cpus,repetition,phase,action,arg,nsecs,ops,ops_per_sec", report->fp);
+        for (i = 0; i < NUM_OF_COUNTERS; i++)
+        {
+            fprintf(report->fp, ",%s_per_op", counter_name(i));
+        }
+        fputs(",cas_failures,backoffs,spins,keys,heap_bytes,retired_nodes,drained_heap_bytes,rss_bytes,peak_rss_bytes,"
+              "peak_retired,reclaim_stalls,preemptions",
+              report->fp);
+        for (i = 0; i < NUM_OF_RESTART_CAUSES; i++)
+        {
+            fprintf(report->fp, ",restarts_%s", restart_names[i]);
+        }
+        for (i = 0; i < BENCH_OP_TYPES; i++)
+        {
+            fprintf(report->fp, ",%s_count,%s_p50_ns,%s_p90_ns,%s_p99_ns,%s_p999_ns,%s_max_ns", op_names[i],
+                    op_names[i], op_names[i], op_names[i], op_names[i], op_names[i]);
+        }
+        fputs("\n", report->fp);
+    }
+    else
+    {
+        fputs("[", report->fp);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Writes a row of the results.
+ * @param report: the results.
+ * @param result: the row.
+ **/
+void bench_record(bench_report_t* report, const bench_result_t* result)
+{
+    double ops_per_sec = result->nsecs > 0 ? (double) result->ops * NSECS_IN_SEC / result->nsecs : 0.0;
+    double per_op      = 0.0;
+    int i = 0;
+    if (report->fp == NULL)
+    {
+        return;
+    }
+    if (report->format == BENCH_CSV)
+    {
+        fprintf(report->fp, "%s,%u,%s,", map_names[result->map], result->threads, placement_names[result->placement]);
+        write_csv_string(report->fp, result->cpu_map);
+        fprintf(report->fp, ",%u,%u,", result->repetition, result->phase);
+        write_csv_string(report->fp, result->action);
+        fputc(',', report->fp);
+        write_csv_string(report->fp, result->arg);
+        fprintf(report->fp, ",%ld,%ld,%.0f", result->nsecs, result->ops, ops_per_sec);
+        for (i = 0; i < NUM_OF_COUNTERS; i++)
+        {
+            if (counter_per_op(result, i, &per_op) == OK)
+            {
+                fprintf(report->fp, ",%.3f", per_op);
+            }
+            else
+            {
+                fputs(",", report->fp);
+            }
+        }
+        fprintf(report->fp, ",%lu,%lu,%lu,%ld,%lu,%lu,%lu,%lu,%lu", result->cas_failures, result->backoffs, result->spins,
+                result->keys, result->heap_bytes, result->retired, result->drained_heap_bytes, result->rss,
+                result->peak_rss);
+        fprintf(report->fp, ",%lu,%lu,%lu", result->peak_retired, result->reclaim_stalls, result->preemptions);
+        for (i = 0; i < NUM_OF_RESTART_CAUSES; i++)
+        {
+            fprintf(report->fp, ",%lu", result->restarts[i]);
+        }
+        for (i = 0; i < BENCH_OP_TYPES; i++)
+        {
+            write_csv_latency(report->fp, &(result->latencies[i]));
+        }
+        fputs("\n", report->fp);
+    }
+    else
+    {
+        fprintf(report->fp, "%s\n  {\"map\": \"%s\", \"threads\": %u, \"placement\": \"%s\", \"cpus\": ",
+                report->num_of_results == 0 ? "" : ",", map_names[result->map], result->threads,
+                placement_names[result->placement]);
+        write_json_string(report->fp, result->cpu_map);
+        fprintf(report->fp, ", \"repetition\": %u, \"phase\": %u, \"action\": ", result->repetition, result->phase);
+        write_json_string(report->fp, result->action);
+        fputs(", \"arg\": ", report->fp);
+        write_json_string(report->fp, result->arg);
+        fprintf(report->fp, ", \"nsecs\": %ld, \"ops\": %ld, \"ops_per_sec\": %.0f",
+                result->nsecs, result->ops, ops_per_sec);
+        for (i = 0; i < NUM_OF_COUNTERS; i++)
+        {
+            if (counter_per_op(result, i, &per_op) == OK)
+            {
+                fprintf(report->fp, ", \"%s_per_op\": %.3f", counter_name(i), per_op);
+            }
+            else
+            {
+                fprintf(report->fp, ", \"%s_per_op\": null", counter_name(i));
+            }
+        }
+        fprintf(report->fp, ", \"cas_failures\": %lu, \"backoffs\": %lu, \"spins\": %lu",
+                result->cas_failures, result->backoffs, result->spins);
+        fprintf(report->fp, ", \"keys\": %ld, \"heap_bytes\": %lu, \"retired_nodes\": %lu, \"drained_heap_bytes\": %lu, "
+                "\"rss_bytes\": %lu, \"peak_rss_bytes\": %lu", result->keys, result->heap_bytes, result->retired,
+                result->drained_heap_bytes, result->rss, result->peak_rss);
+        fprintf(report->fp, ", \"peak_retired\": %lu, \"reclaim_stalls\": %lu, \"preemptions\": %lu",
+                result->peak_retired, result->reclaim_stalls, result->preemptions);
+        for (i = 0; i < NUM_OF_RESTART_CAUSES; i++)
+        {
+            fprintf(report->fp, ", \"restarts_%s\": %lu", restart_names[i], result->restarts[i]);
+        }
+        for (i = 0; i < BENCH_OP_TYPES; i++)
+        {
+            write_json_latency(report->fp, op_names[i], &(result->latencies[i]));
+        }
+        fputs("}", report->fp);
+    }
+    report->num_of_results++;
+    // The results survive a crash of a later phase.
+    fflush(report->fp);
+}
+
+/**
+ * Closes the results of a benchmark.
+ * @param report: the results.
+ **/
+void bench_close(bench_report_t* report)
+{
+    if (report->fp == NULL)
+    {
+        return;
+    }
+    if (report->format == BENCH_JSON)
+    {
+        fputs("\n]\n", report->fp);
+    }
+    fclose(report->fp);
+    report->fp = NULL;
+}
@@ -0,0 +1,778 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/membarrier.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "nodes.h"
+#include "common.h"
+#include "ctrie.h"
+#include "hazard_pointer.h"
+#include "checkpoint.h"
+#include "transaction.h"
+
+#define CHECKPOINT_POLL_MS      (10)
+
+/**
+ * A buffered, throttled writer of a checkpoint file.
+ **/
+typedef struct
+{
+    int         fd;
+    char*       buffer;
+    size_t      length;
+    uint64_t    checksum;
+    uint64_t    written;
+    uint64_t    bytes_per_sec;
+    int64_t     start_time;
+} writer_t;
+
+/**
+ * The state of a running checkpoint.
+ **/
+typedef struct
+{
+    writer_t            writer;
+    // The generation of the checkpoint, main nodes of this generation were created after it started.
+    uint32_t            gen;
+    // Subtrees whose INode is dirty from before `base_gen` are unchanged since the base checkpoint.
+    uint32_t            base_gen;
+    checkpoint_stats_t* stats;
+} dump_t;
+
+/**
+ * A growable array of keys.
+ **/
+typedef struct
+{
+    int*    keys;
+    size_t  length;
+    size_t  size;
+} keys_t;
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int          writer_flush(writer_t* writer);
+static int          writer_write(writer_t* writer, const void* data, size_t size);
+
+static int          barrier_all_threads();
+static int          checkpoint_begin(ctrie_t* ctrie, thread_args_t* thread_args);
+static main_node_t* snapshot_main   (inode_t* inode, uint32_t gen);
+static int          dump_inode      (dump_t* dump, inode_t* inode, uint32_t prefix, uint32_t lev);
+
+static uint32_t     hash_prefix     (int key, uint32_t lev);
+static int          collect_key     (int key, checkpoint_record_t* record, keys_t* keys);
+static int          collect_keys    (main_node_t* main_node, uint32_t lev, checkpoint_record_t* record, keys_t* keys);
+static int          apply_record    (ctrie_t* ctrie, checkpoint_record_t* record, checkpoint_entry_t* entries, thread_args_t* thread_args);
+static int          read_checkpoint (ctrie_t* ctrie, FILE* fp, int apply, thread_args_t* thread_args);
+
+static void*        checkpointer_main(checkpointer_t* checkpointer);
+
+/**
+ * Writes the buffered data, and sleeps if the checkpoint is ahead of its rate.
+ * @param writer: the writer.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int writer_flush(writer_t* writer)
+{
+    size_t offset = 0;
+    while (offset < writer->length)
+    {
+        ssize_t res = write(writer->fd, writer->buffer + offset, writer->length - offset);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            FAIL("Failed to write checkpoint (%d)", errno);
+        }
+        offset += res;
+    }
+    writer->written += writer->length;
+    writer->length   = 0;
+    if (writer->bytes_per_sec > 0)
+    {
+        int64_t due = (int64_t) (writer->written * NSECS_IN_SEC / writer->bytes_per_sec);
+        int64_t elapsed = monotonic_nsecs() - writer->start_time;
+        if (due > elapsed)
+        {
+            sleep_nsecs(due - elapsed);
+        }
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Appends data to the checkpoint, it is written in CHECKPOINT_BUFFER_SIZE writes.
+ * @param writer: the writer.
+ * @param data: the data.
+ * @param size: the size of the data.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int writer_write(writer_t* writer, const void* data, size_t size)
+{
+    const char* bytes = data;
+    writer->checksum = fnv1a(data, size, writer->checksum);
+    while (size > 0)
+    {
+        size_t chunk = CHECKPOINT_BUFFER_SIZE - writer->length;
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+        memcpy(writer->buffer + writer->length, bytes, chunk);
+        writer->length += chunk;
+        bytes          += chunk;
+        size           -= chunk;
+        if (writer->length == CHECKPOINT_BUFFER_SIZE && writer_flush(writer) != OK)
+        {
+            return FAILED;
+        }
+    }
+    return OK;
+}
+
+/**
+ * Makes every thread of the process execute a memory barrier, so the operations need none of their own (see op_enter).
+ * Without membarrier (e.g. filtered by seccomp), revoking write access to a touched page makes the kernel interrupt
+ * every CPU which runs the process to flush its TLB, which serializes those CPUs just the same.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int barrier_all_threads()
+{
+    static int  registered  = 0;
+    static char* page       = NULL;
+    if (registered == 0)
+    {
+        registered = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0 ? 1 : -1;
+    }
+    if (registered == 1 && syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0)
+    {
+        return OK;
+    }
+    if (syscall(__NR_membarrier, MEMBARRIER_CMD_GLOBAL, 0, 0) == 0)
+    {
+        return OK;
+    }
+    if (page == NULL)
+    {
+        void* mapped = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+        {
+            FAIL("Failed to map the barrier page (%d)", errno);
+        }
+        page = mapped;
+    }
+    *(volatile char*) page = 1;
+    if (mprotect(page, sysconf(_SC_PAGESIZE), PROT_READ) != 0 ||
+        mprotect(page, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE) != 0)
+    {
+        FAIL("Failed to flush the TLBs (%d)", errno);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Starts a checkpoint: advances the generation, and waits for the operations which started in the previous one.
+ * Operations which start afterwards defer their frees and link the main nodes they replace, and the earlier operations
+ * never write over their main nodes (see CATCH_UP), so once those are done the ctrie can be read as it is at this
+ * moment while the operations continue. Only the checkpoint waits, no operation does.
+ * @param ctrie: the ctrie.
+ * @param thread_args: the thread arguments, used for the hazard pointer lists of all the threads.
+ * @return OK on success, otherwise FAILED (and the checkpoint must be ended).
+ * @note `ctrie->starting` must be held, it is released.
+ **/
+static int checkpoint_begin(ctrie_t* ctrie, thread_args_t* thread_args)
+{
+    uint32_t gen = ctrie->gen + 1;
+    int i = 0;
+    // Operations which see the new generation see that a checkpoint is running.
+    ctrie->checkpointing = 1;
+    ctrie->gen = gen;
+    // Every thread either announced its operation before the barrier, or reads the new generation after it.
+    if (barrier_all_threads() != OK)
+    {
+        ctrie->starting = 0;
+        return FAILED;
+    }
+    for (i = 0; i < thread_args->num_of_threads; i++)
+    {
+        while (thread_args->hp_lists[i]->in_op && thread_args->hp_lists[i]->op_gen != gen)
+        {
+            sched_yield();
+        }
+    }
+    ctrie->starting = 0;
+    return OK;
+}
+
+/**
+ * Finds the main node `inode` had when the checkpoint started.
+ * @param inode: the inode.
+ * @param gen: the checkpoint's generation.
+ * @return the inode's main node at the start of the checkpoint.
+ **/
+static main_node_t* snapshot_main(inode_t* inode, uint32_t gen)
+{
+    main_node_t* main_node = inode->main;
+    // A transaction which commits meanwhile started after the checkpoint, so the inode had the main node it replaces.
+    if (TXN_TAGGED(main_node))
+    {
+        main_node = txn_entry(TXN_DESC(main_node), inode)->old;
+    }
+    // Main nodes replaced during the checkpoint are deferred, so the chain stays valid until it ends.
+    while (main_node->gen == gen && main_node->prev != NULL)
+    {
+        main_node = main_node->prev;
+    }
+    return main_node;
+}
+
+/**
+ * Writes the record of an INode which points to a cnode, followed by the records of its changed child cnodes.
+ * Leaves, tombs and changed lnode-lists are written as entries of the record, unchanged subtrees are kept.
+ * @param dump: the checkpoint.
+ * @param inode: the inode.
+ * @param prefix: the hash bits which lead to the inode.
+ * @param lev: the hash level of the inode.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int dump_inode(dump_t* dump, inode_t* inode, uint32_t prefix, uint32_t lev)
+{
+    cnode_t*            cnode       = &(snapshot_main(inode, dump->gen)->node.cnode);
+    main_node_t*        children[MAX_BRANCHES] = {0};
+    checkpoint_record_t record      = { .prefix = prefix, .lev = lev, .keep = 0, .count = 0 };
+    uint32_t            recurse     = 0;
+    lnode_t*            lnode       = NULL;
+    int i = 0;
+
+    // The children's dirty marks may change while they are written, so decide once.
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        uint32_t flag = 1 << i;
+        if ((cnode->bmp & flag) == 0)
+        {
+            continue;
+        }
+        branch_t* branch = cnode->array[i];
+        if (branch->type == SNODE)
+        {
+            record.count++;
+            continue;
+        }
+        children[i] = snapshot_main(&(branch->node.inode), dump->gen);
+        if (children[i]->type == TNODE)
+        {
+            record.count++;
+        }
+        else if (branch->node.inode.dirty < dump->base_gen)
+        {
+            record.keep |= flag;
+            children[i]  = NULL;
+        }
+        else if (children[i]->type == LNODE)
+        {
+            for (lnode = &(children[i]->node.lnode); lnode != NULL; lnode = lnode->next)
+            {
+                record.count++;
+            }
+        }
+        else
+        {
+            record.keep |= flag;
+            recurse     |= flag;
+        }
+    }
+
+    if (writer_write(&(dump->writer), &record, sizeof(record)) != OK)
+    {
+        return FAILED;
+    }
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        uint32_t flag = 1 << i;
+        checkpoint_entry_t entry = {0};
+        if ((cnode->bmp & flag) == 0 || (record.keep & flag))
+        {
+            continue;
+        }
+        if (children[i] == NULL)
+        {
+            entry = (checkpoint_entry_t) { .key = cnode->array[i]->node.snode.key, .value = cnode->array[i]->node.snode.value };
+        }
+        else if (children[i]->type == TNODE)
+        {
+            entry = (checkpoint_entry_t) { .key = children[i]->node.tnode.snode.key, .value = children[i]->node.tnode.snode.value };
+        }
+        else
+        {
+            for (lnode = &(children[i]->node.lnode); lnode != NULL; lnode = lnode->next)
+            {
+                entry = (checkpoint_entry_t) { .key = lnode->snode.key, .value = lnode->snode.value };
+                if (writer_write(&(dump->writer), &entry, sizeof(entry)) != OK)
+                {
+                    return FAILED;
+                }
+            }
+            continue;
+        }
+        if (writer_write(&(dump->writer), &entry, sizeof(entry)) != OK)
+        {
+            return FAILED;
+        }
+    }
+    dump->stats->records++;
+    dump->stats->entries += record.count;
+
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        if ((recurse & (1 << i)) &&
+            dump_inode(dump, &(cnode->array[i]->node.inode), prefix | ((uint32_t) i << lev), lev + W) != OK)
+        {
+            return FAILED;
+        }
+    }
+    return OK;
+}
+
+/**
+ * Writes a point-in-time checkpoint of `ctrie` to `path`, while the other threads keep operating on it.
+ * An incremental checkpoint writes only the subtrees which changed since the last checkpoint (of this ctrie).
+ * @param ctrie: the ctrie.
+ * @param path: the checkpoint path.
+ * @param incremental: whether to write an incremental checkpoint, the first checkpoint is always full.
+ * @param bytes_per_sec: the maximal write rate, 0 means unthrottled.
+ * @param thread_args: the thread arguments of any thread, used for the hazard pointer lists of all the threads.
+ * @param stats: an optional out parameter, set to the checkpoint's statistics.
+ * @return OK on success, otherwise (or if another checkpoint is running) FAILED.
+ * @note the calling thread must not be in the middle of a ctrie operation.
+ **/
+int ctrie_checkpoint(ctrie_t* ctrie, const char* path, int incremental, uint64_t bytes_per_sec,
+                     thread_args_t* thread_args, checkpoint_stats_t* stats)
+{
+    checkpoint_stats_t  local_stats = {0};
+    checkpoint_record_t end         = { .lev = CHECKPOINT_END };
+    checkpoint_header_t header      = { .magic = CHECKPOINT_MAGIC, .version = CHECKPOINT_VERSION };
+    dump_t              dump        = { .writer = { .fd = -1 }, .stats = stats != NULL ? stats : &local_stats };
+    int64_t             start_time  = monotonic_nsecs();
+    int                 res         = FAILED;
+    uint8_t             started     = 0;
+
+    *(dump.stats) = (checkpoint_stats_t) {0};
+    if (!__sync_bool_compare_and_swap(&(ctrie->starting), 0, 1))
+    {
+        FAIL("Another checkpoint is starting");
+    }
+    if (ctrie->checkpointing)
+    {
+        ctrie->starting = 0;
+        FAIL("Another checkpoint is running");
+    }
+    started = 1;
+    if (checkpoint_begin(ctrie, thread_args) != OK)
+    {
+        FAIL("Failed to start the checkpoint");
+    }
+    dump.stats->wait_time = monotonic_nsecs() - start_time;
+    dump.gen        = ctrie->gen;
+    dump.base_gen   = incremental ? ctrie->checkpoint_gen : 0;
+    header.gen      = dump.gen;
+    header.base_gen = dump.base_gen;
+
+    dump.writer.buffer          = malloc(CHECKPOINT_BUFFER_SIZE);
+    dump.writer.checksum        = FNV_OFFSET_BASIS;
+    dump.writer.bytes_per_sec   = bytes_per_sec;
+    dump.writer.start_time      = monotonic_nsecs();
+    if (dump.writer.buffer == NULL)
+    {
+        FAIL("Failed to allocate the checkpoint buffer");
+    }
+    dump.writer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dump.writer.fd < 0)
+    {
+        FAIL("Failed to open %s (%d)", path, errno);
+    }
+    if (writer_write(&(dump.writer), &header, sizeof(header)) != OK)
+    {
+        FAIL("Failed to write the checkpoint header");
+    }
+    // An unchanged ctrie has no records at all.
+    if (ctrie->inode->dirty >= dump.base_gen && dump_inode(&dump, ctrie->inode, 0, 0) != OK)
+    {
+        FAIL("Failed to dump ctrie %p", ctrie);
+    }
+    end.count = dump.stats->records;
+    if (writer_write(&(dump.writer), &end, sizeof(end)) != OK)
+    {
+        FAIL("Failed to write the checkpoint end");
+    }
+    // The checksum covers everything before it.
+    uint64_t checksum = dump.writer.checksum;
+    if (writer_write(&(dump.writer), &checksum, sizeof(checksum)) != OK || writer_flush(&(dump.writer)) != OK ||
+        fsync(dump.writer.fd) != 0)
+    {
+        FAIL("Failed to write the checkpoint checksum");
+    }
+    ctrie->checkpoint_gen = dump.gen;
+    res = OK;
+
+CLEANUP:
+    if (started)
+    {
+        FENCE;
+        ctrie->checkpointing = 0;
+    }
+    if (dump.writer.fd >= 0)
+    {
+        close(dump.writer.fd);
+    }
+    free(dump.writer.buffer);
+    dump.stats->bytes   = dump.writer.written;
+    dump.stats->time    = monotonic_nsecs() - start_time;
+    return res;
+}
+
+/**
+ * Calculates the low `lev` hash bits of `key`, position by position like the ctrie does.
+ * @param key: the key.
+ * @param lev: the hash level.
+ * @return the hash prefix of the key.
+ **/
+static uint32_t hash_prefix(int key, uint32_t lev)
+{
+    uint32_t prefix = 0;
+    uint32_t l      = 0;
+    for (l = 0; l < lev; l += W)
+    {
+        prefix |= (uint32_t) ((ctrie_hash(key) >> l) & 0x1f) << l;
+    }
+    return prefix;
+}
+
+/**
+ * Adds `key` to the collected keys if it is replaced by `record`.
+ * @param key: the key.
+ * @param record: the record.
+ * @param keys: the collected keys.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int collect_key(int key, checkpoint_record_t* record, keys_t* keys)
+{
+    if (hash_prefix(key, record->lev) != record->prefix || (record->keep & (1 << ((ctrie_hash(key) >> record->lev) & 0x1f))))
+    {
+        return OK;
+    }
+    if (keys->length == keys->size)
+    {
+        size_t size     = keys->size == 0 ? MAX_BRANCHES : keys->size * 2;
+        int*   new_keys = realloc(keys->keys, size * sizeof(int));
+        if (new_keys == NULL)
+        {
+            FAIL("Failed to allocate %ld keys", size);
+        }
+        keys->keys = new_keys;
+        keys->size = size;
+    }
+    keys->keys[keys->length] = key;
+    keys->length++;
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Collects the keys of a subtree which are replaced by a record.
+ * @param main_node: the main node of the subtree.
+ * @param lev: the hash level of the main node.
+ * @param record: the record.
+ * @param keys: the collected keys.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int collect_keys(main_node_t* main_node, uint32_t lev, checkpoint_record_t* record, keys_t* keys)
+{
+    lnode_t* lnode = NULL;
+    int      res   = OK;
+    int i = 0;
+
+    switch (main_node->type)
+    {
+    case CNODE:
+        for (i = 0; i < MAX_BRANCHES && res == OK; i++)
+        {
+            branch_t* branch = main_node->node.cnode.array[i];
+            // Above the record's level, only the branch of its prefix holds replaced keys.
+            if ((main_node->node.cnode.bmp & (1 << i)) == 0 ||
+                (lev < record->lev && (uint32_t) i != ((record->prefix >> lev) & 0x1f)))
+            {
+                continue;
+            }
+            if (branch->type == SNODE)
+            {
+                res = collect_key(branch->node.snode.key, record, keys);
+            }
+            else
+            {
+                res = collect_keys(branch->node.inode.main, lev + W, record, keys);
+            }
+        }
+        return res;
+    case TNODE:
+        return collect_key(main_node->node.tnode.snode.key, record, keys);
+    case LNODE:
+        for (lnode = &(main_node->node.lnode); lnode != NULL && res == OK; lnode = lnode->next)
+        {
+            res = collect_key(lnode->snode.key, record, keys);
+        }
+        return res;
+    default:
+        return OK;
+    }
+}
+
+/**
+ * Applies a record: removes the keys it replaces and inserts its entries.
+ * @param ctrie: the ctrie.
+ * @param record: the record.
+ * @param entries: the record's entries.
+ * @param thread_args: the thread arguments.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int apply_record(ctrie_t* ctrie, checkpoint_record_t* record, checkpoint_entry_t* entries, thread_args_t* thread_args)
+{
+    keys_t   keys = {0};
+    int      res  = FAILED;
+    uint32_t i    = 0;
+
+    if (collect_keys(ctrie->inode->main, 0, record, &keys) != OK)
+    {
+        FAIL("Failed to collect the keys of record %x/%d", record->prefix, record->lev);
+    }
+    for (i = 0; i < keys.length; i++)
+    {
+        if (ctrie->remove(ctrie, keys.keys[i], thread_args) == FAILED)
+        {
+            FAIL("Failed to remove %d", keys.keys[i]);
+        }
+    }
+    for (i = 0; i < record->count; i++)
+    {
+        if (ctrie->insert(ctrie, entries[i].key, entries[i].value, thread_args) != OK)
+        {
+            FAIL("Failed to insert %d", entries[i].key);
+        }
+    }
+    res = OK;
+
+CLEANUP:
+    free(keys.keys);
+    return res;
+}
+
+/**
+ * Reads a checkpoint, and applies it to `ctrie` if requested.
+ * @param ctrie: the ctrie.
+ * @param fp: the checkpoint file, positioned after its header.
+ * @param apply: whether to apply the checkpoint, otherwise it is only verified.
+ * @param thread_args: the thread arguments.
+ * @return OK if the checkpoint is valid (and was applied), otherwise FAILED.
+ **/
+static int read_checkpoint(ctrie_t* ctrie, FILE* fp, int apply, thread_args_t* thread_args)
+{
+    checkpoint_header_t header      = {0};
+    checkpoint_record_t record      = {0};
+    checkpoint_entry_t* entries     = NULL;
+    uint32_t            size        = 0;
+    uint64_t            checksum    = FNV_OFFSET_BASIS;
+    uint64_t            expected    = 0;
+    uint64_t            records     = 0;
+    int                 res         = FAILED;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION)
+    {
+        FAIL("Unknown checkpoint format");
+    }
+    checksum = fnv1a(&header, sizeof(header), checksum);
+    while (1)
+    {
+        if (fread(&record, sizeof(record), 1, fp) != 1)
+        {
+            FAIL("Truncated checkpoint");
+        }
+        checksum = fnv1a(&record, sizeof(record), checksum);
+        if (record.lev == CHECKPOINT_END)
+        {
+            break;
+        }
+        if (record.lev >= MAX_BRANCHES || record.count > size)
+        {
+            checkpoint_entry_t* new_entries = record.lev >= MAX_BRANCHES ? NULL : realloc(entries, record.count * sizeof(checkpoint_entry_t));
+            if (new_entries == NULL)
+            {
+                FAIL("Invalid checkpoint record %x/%d with %d entries", record.prefix, record.lev, record.count);
+            }
+            entries = new_entries;
+            size    = record.count;
+        }
+        if (fread(entries, sizeof(checkpoint_entry_t), record.count, fp) != record.count)
+        {
+            FAIL("Truncated checkpoint");
+        }
+        checksum = fnv1a(entries, record.count * sizeof(checkpoint_entry_t), checksum);
+        records++;
+        if (apply && apply_record(ctrie, &record, entries, thread_args) != OK)
+        {
+            FAIL("Failed to apply checkpoint record %x/%d", record.prefix, record.lev);
+        }
+    }
+    if (fread(&expected, sizeof(expected), 1, fp) != 1 || expected != checksum || record.count != records)
+    {
+        FAIL("Corrupted checkpoint");
+    }
+    res = OK;
+
+CLEANUP:
+    free(entries);
+    return res;
+}
+
+/**
+ * Applies a checkpoint to `ctrie`. A full checkpoint makes the ctrie hold exactly its entries, an incremental one
+ * should be applied after the checkpoint it is incremental to (and the ones in between).
+ * The whole checkpoint is verified before it is applied.
+ * @param ctrie: the ctrie.
+ * @param path: the checkpoint path.
+ * @param thread_args: the thread arguments.
+ * @return OK on success, otherwise FAILED.
+ * @note not thread-safe, the ctrie must be quiescent.
+ **/
+int checkpoint_restore(ctrie_t* ctrie, const char* path, thread_args_t* thread_args)
+{
+    FILE* fp  = NULL;
+    int   res = FAILED;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        FAIL("Failed to fopen %s (%d)", path, errno);
+    }
+    if (read_checkpoint(ctrie, fp, 0, thread_args) != OK)
+    {
+        FAIL("Invalid checkpoint %s", path);
+    }
+    rewind(fp);
+    res = read_checkpoint(ctrie, fp, 1, thread_args);
+
+CLEANUP:
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    return res;
+}
+
+/**
+ * The body of the checkpointer thread, which writes a checkpoint every interval until it is stopped.
+ * @param checkpointer: the checkpointer.
+ * @return NULL.
+ **/
+static void* checkpointer_main(checkpointer_t* checkpointer)
+{
+    checkpoint_config_t* config     = &(checkpointer->config);
+    checkpoint_stats_t   stats      = {0};
+    char*                path       = malloc(strlen(config->path) + sizeof(".4294967295"));
+    int64_t              next_time  = monotonic_nsecs();
+
+    if (path == NULL)
+    {
+        FAIL("Failed to allocate the checkpoint path");
+    }
+    while (!checkpointer->stop)
+    {
+        next_time += config->interval_ms * (NSECS_IN_SEC / 1000);
+        while (!checkpointer->stop && monotonic_nsecs() < next_time)
+        {
+            sleep_nsecs(CHECKPOINT_POLL_MS * (NSECS_IN_SEC / 1000));
+        }
+        if (checkpointer->stop)
+        {
+            break;
+        }
+        int incremental = config->full_every != 0 && checkpointer->num_of_checkpoints % config->full_every != 0;
+        sprintf(path, "%s.%u", config->path, checkpointer->ctrie->gen + 1);
+        if (ctrie_checkpoint(checkpointer->ctrie, path, incremental, config->bytes_per_sec, checkpointer->thread_args, &stats) != OK)
+        {
+            PRINT("Failed to write checkpoint %s", path);
+            continue;
+        }
+        checkpointer->num_of_checkpoints++;
+        checkpointer->stats.bytes       += stats.bytes;
+        checkpointer->stats.records     += stats.records;
+        checkpointer->stats.entries     += stats.entries;
+        checkpointer->stats.wait_time   += stats.wait_time;
+        checkpointer->stats.time        += stats.time;
+    }
+
+CLEANUP:
+    free(path);
+    return NULL;
+}
+
+/**
+ * Starts a thread which writes checkpoints of `ctrie` in the background.
+ * @param ctrie: the ctrie.
+ * @param config: the checkpoints' configuration, its path must stay valid until the checkpointer is stopped.
+ * @param thread_args: the thread arguments of any thread, used for the hazard pointer lists of all the threads.
+ * @return On success the checkpointer is returned, otherwise NULL is returned.
+ **/
+checkpointer_t* checkpoint_start(ctrie_t* ctrie, const checkpoint_config_t* config, thread_args_t* thread_args)
+{
+    checkpointer_t* checkpointer = NULL;
+    MALLOC(checkpointer, checkpointer_t);
+    checkpointer->ctrie         = ctrie;
+    checkpointer->config        = *config;
+    checkpointer->thread_args   = thread_args;
+    if (pthread_create(&(checkpointer->tid), NULL, (void*(*)(void*)) checkpointer_main, checkpointer) != 0)
+    {
+        FAIL("Failed to start the checkpointer");
+    }
+    return checkpointer;
+
+CLEANUP:
+    free(checkpointer);
+    return NULL;
+}
+
+/**
+ * Stops the checkpointer thread, after its current checkpoint is done, and frees it.
+ * @param checkpointer: the checkpointer.
+ * @param stats: an optional out parameter, set to the accumulated statistics of its checkpoints.
+ * @return the number of checkpoints it wrote.
+ **/
+uint32_t checkpoint_stop(checkpointer_t* checkpointer, checkpoint_stats_t* stats)
+{
+    uint32_t num_of_checkpoints = 0;
+    checkpointer->stop = 1;
+    pthread_join(checkpointer->tid, NULL);
+    num_of_checkpoints = checkpointer->num_of_checkpoints;
+    if (stats != NULL)
+    {
+        *stats = checkpointer->stats;
+    }
+    free(checkpointer);
+    return num_of_checkpoints;
+}
@@ -1,3 +1,5 @@
+#include <time.h>
+
 #include "common.h"
 
 #define NUM_OF_BITS_IN_BYTE (8)
@@ -19,6 +21,60 @@ void free_them_all(int count, ...)
     va_end(args);
 }
 
+/**
+ * Advances a xorshift32 pseudo random generator.
+ * @param state: the generator's state, must not be 0.
+ * @return the next pseudo random number.
+ **/
+uint32_t xorshift32(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * Calculates the FNV-1a hash of `data`, used as a checksum.
+ * @param data: the data to hash.
+ * @param size: the size of the data.
+ * @param hash: the hash of the preceding data, or FNV_OFFSET_BASIS.
+ * @return the hash of the data.
+ **/
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash)
+{
+    const uint8_t* bytes = data;
+    size_t i = 0;
+    for (i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @return the monotonic clock, in nanoseconds.
+ **/
+int64_t monotonic_nsecs()
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NSECS_IN_SEC + now.tv_nsec;
+}
+
+/**
+ * Sleeps for `nsecs` nanoseconds, or less if a signal interrupts the sleep.
+ * @param nsecs: the duration.
+ **/
+void sleep_nsecs(int64_t nsecs)
+{
+    struct timespec duration = { .tv_sec = nsecs / NSECS_IN_SEC, .tv_nsec = nsecs % NSECS_IN_SEC };
+    nanosleep(&duration, NULL);
+}
+
 int32_t highest_on_bit(uint32_t num)
 {
     int32_t i;
@@ -0,0 +1,97 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "hazard_pointer.h"
+#include "compaction.h"
+
+#define COMPACTION_POLL_MS      (10)
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static void*    compactor_main(compactor_t* compactor);
+
+/**
+ * The compactor thread, compacts a chunk at a time and sleeps whenever it is ahead of its rate.
+ * @param compactor: the compactor.
+ * @return NULL.
+ **/
+static void* compactor_main(compactor_t* compactor)
+{
+    compaction_config_t* config = &(compactor->config);
+    uint32_t             cursor = 0;
+
+    while (!compactor->stop)
+    {
+        int64_t  start_time     = monotonic_nsecs();
+        uint64_t start_cnodes   = compactor->stats.cnodes;
+        do
+        {
+            ctrie_compact(compactor->ctrie, &cursor, 1, compactor->thread_args, &(compactor->stats));
+            if (config->cnodes_per_sec > 0)
+            {
+                int64_t due     = (int64_t) ((compactor->stats.cnodes - start_cnodes) * NSECS_IN_SEC / config->cnodes_per_sec);
+                int64_t elapsed = monotonic_nsecs() - start_time;
+                if (due > elapsed)
+                {
+                    sleep_nsecs(due - elapsed);
+                }
+            }
+        } while (cursor != 0 && !compactor->stop);
+
+        int64_t next_time = monotonic_nsecs() + config->interval_ms * (NSECS_IN_SEC / 1000);
+        while (!compactor->stop && monotonic_nsecs() < next_time)
+        {
+            sleep_nsecs(COMPACTION_POLL_MS * (NSECS_IN_SEC / 1000));
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Starts a thread which compacts `ctrie` in the background, a pass every `interval_ms`.
+ * @param ctrie: the ctrie.
+ * @param config: the compaction's configuration.
+ * @param thread_args: the thread arguments of the compactor, which no other thread may use meanwhile.
+ * @return On success the compactor is returned, otherwise NULL is returned.
+ **/
+compactor_t* compaction_start(ctrie_t* ctrie, const compaction_config_t* config, thread_args_t* thread_args)
+{
+    compactor_t* compactor = NULL;
+    MALLOC(compactor, compactor_t);
+    compactor->ctrie        = ctrie;
+    compactor->config       = *config;
+    compactor->thread_args  = thread_args;
+    if (pthread_create(&(compactor->tid), NULL, (void*(*)(void*)) compactor_main, compactor) != 0)
+    {
+        FAIL("Failed to start the compactor");
+    }
+    return compactor;
+
+CLEANUP:
+    free(compactor);
+    return NULL;
+}
+
+/**
+ * Stops the compactor thread, after its current chunk is done, and frees it.
+ * @param compactor: the compactor.
+ * @param stats: an optional out parameter, set to the accumulated statistics of its passes.
+ * @return the number of passes it completed.
+ **/
+uint64_t compaction_stop(compactor_t* compactor, compaction_stats_t* stats)
+{
+    uint64_t passes = 0;
+    compactor->stop = 1;
+    pthread_join(compactor->tid, NULL);
+    passes = compactor->stats.passes;
+    if (stats != NULL)
+    {
+        *stats = compactor->stats;
+    }
+    free(compactor);
+    return passes;
+}
@@ -0,0 +1,129 @@
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "counters.h"
+
+#define CACHE_READ_MISS(cache)  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct
+{
+    uint32_t type;
+    uint64_t config;
+} counter_event_t;
+
+// By counter_type_t.
+static const counter_event_t events[NUM_OF_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+static const char* counter_names[NUM_OF_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int open_counter(counter_type_t type);
+
+/**
+ * Opens a counter of the calling thread's user space events, on any CPU.
+ * @param type: the counter.
+ * @return the counter's file descriptor, or -1 if it can't be counted (e.g. in a VM, or by perf_event_paranoid).
+ **/
+static int open_counter(counter_type_t type)
+{
+    struct perf_event_attr attr = {0};
+    attr.size           = sizeof(attr);
+    attr.type           = events[type].type;
+    attr.config         = events[type].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    // Counters that share the PMU are multiplexed, their counts are scaled by the time they ran.
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Finds the counters that can be opened (once).
+ * @return the counters, by bit.
+ **/
+uint32_t counters_available()
+{
+    static int      probed      = 0;
+    static uint32_t available   = 0;
+    int type = 0;
+    if (probed)
+    {
+        return available;
+    }
+    for (type = 0; type < NUM_OF_COUNTERS; type++)
+    {
+        int fd = open_counter(type);
+        if (fd != -1)
+        {
+            available |= 1 << type;
+            close(fd);
+        }
+    }
+    probed = 1;
+    return available;
+}
+
+/**
+ * Starts counting the calling thread's events.
+ * @param counters: the thread's counters.
+ **/
+void counters_open(counters_t* counters)
+{
+    uint32_t available = counters_available();
+    int type = 0;
+    for (type = 0; type < NUM_OF_COUNTERS; type++)
+    {
+        counters->fds[type] = (available & (1 << type)) ? open_counter(type) : -1;
+    }
+}
+
+/**
+ * Stops counting, and adds the counts to the totals, which other threads may add to at the same time.
+ * @param counters: the thread's counters.
+ * @param totals: the totals.
+ **/
+void counters_close(counters_t* counters, counter_totals_t* totals)
+{
+    // The value, and the times the counter was enabled and running.
+    uint64_t counts[3] = {0};
+    int type = 0;
+    for (type = 0; type < NUM_OF_COUNTERS; type++)
+    {
+        if (counters->fds[type] == -1)
+        {
+            __sync_fetch_and_or(&(totals->missing), 1 << type);
+            continue;
+        }
+        if (read(counters->fds[type], counts, sizeof(counts)) != sizeof(counts) || counts[2] == 0)
+        {
+            __sync_fetch_and_or(&(totals->missing), 1 << type);
+        }
+        else
+        {
+            __sync_fetch_and_add(&(totals->values[type]), (uint64_t) ((double) counts[0] * counts[1] / counts[2]));
+        }
+        close(counters->fds[type]);
+        counters->fds[type] = -1;
+    }
+}
+
+const char* counter_name(counter_type_t type)
+{
+    return counter_names[type];
+}
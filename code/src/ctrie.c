@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -5,6 +6,66 @@
 #include "common.h"
 #include "ctrie.h"
 #include "hazard_pointer.h"
+#include "backoff.h"
+#include "transaction.h"
+#include "compaction.h"
+#include "trace.h"
+
+/**
+ * The INodes from the root to the current INode of an operation.
+ * `inodes[depth]` is at hash level `depth * W`, and for depth > 0 it is protected by the path hazard pointer of that depth
+ * (unless it's fixed, fixed INodes are never freed before the ctrie).
+ * A path which starts at an INode of the lookup cache doesn't know the INodes between the wide root and that INode.
+ **/
+typedef struct
+{
+    inode_t* inodes[MAX_LEVELS];
+    int      depth;
+    // The depth of the wide root (0 for a plain root), the INodes up to it are fixed.
+    int      root;
+    // The depth the operation started at, `root` unless it started at a cached INode.
+    int      base;
+} path_t;
+
+/**
+ * Where an operation of a transaction applies: the deepest INode on its key's path as it was read.
+ * For an lnode-list it's also the parent INode, which changes if the transaction empties the list.
+ **/
+typedef struct
+{
+    inode_t*     inode;
+    main_node_t* main;
+    int          lev;
+    inode_t*     parent;
+    main_node_t* parent_main;
+} txn_loc_t;
+
+/**
+ * The change a transaction makes to one INode, prepared before the transaction commits.
+ * `new` is `old` as long as the INode doesn't change (the transaction still requires it to stay `old`).
+ **/
+typedef struct
+{
+    inode_t*     inode;
+    main_node_t* old;
+    main_node_t* new;
+    int          lev;
+    uint8_t      unlink;
+    // The changed positions of a cnode, and the branches the transaction created for them (NULL if emptied).
+    uint32_t     changed;
+    branch_t*    built[MAX_BRANCHES];
+    // An unchanged branch of the cnode, which was entombed.
+    branch_t*    entombed;
+} txn_target_t;
+
+typedef struct
+{
+    txn_loc_t    locs[TXN_MAX_OPS];
+    txn_target_t targets[TXN_MAX_ENTRIES];
+    int          num_of_targets;
+    // The change in the number of entries.
+    int          delta;
+} txn_t;
 
 /*************************
  * Functions Declaration *
@@ -17,7 +78,9 @@
 static int  ctrie_insert(ctrie_t* ctrie, int key, int value, thread_args_t* thread_args);
 static int  ctrie_remove(ctrie_t* ctrie, int key, thread_args_t* thread_args);
 static int  ctrie_lookup(ctrie_t* ctrie, int key, thread_args_t* thread_args);
+static int  ctrie_transaction(ctrie_t* ctrie, txn_op_t* ops, int num_of_ops, thread_args_t* thread_args);
 static void ctrie_free  (ctrie_t* ctrie);
+static int  wide_root_expand(ctrie_t* ctrie);
 
 /******************
  * Free functions *
@@ -32,9 +95,9 @@ static void main_node_free(main_node_t* main_node);
  * Clean functions *
  *******************/
 
-static void         clean        (inode_t* inode, int lev, thread_args_t* thread_args);
-static void         compress(main_node_t **cas_address, main_node_t *old_main_node, int lev, thread_args_t *thread_args);
-static int          to_contracted(main_node_t* main_node, int lev, branch_t** old_branch, thread_args_t* thread_args);
+static void         clean        (ctrie_t* ctrie, inode_t* inode, int lev, thread_args_t* thread_args);
+static void         compress(ctrie_t *ctrie, inode_t *inode, main_node_t *old_main_node, int lev, compaction_stats_t* stats, thread_args_t *thread_args);
+static int          to_contracted(inode_t* inode, main_node_t* old_main_node, main_node_t* main_node, branch_t** old_branch, thread_args_t* thread_args);
 
 /*******************
  * Death functions *
@@ -43,13 +106,60 @@ static int          to_contracted(main_node_t* main_node, int lev, branch_t** ol
 static tnode_t   entomb   (snode_t* snode);
 static branch_t* resurrect(main_node_t* inode);
 
+/*******************
+ * SNode functions *
+ *******************/
+
+static snode_t snode_seal     (snode_t* snode);
+static int     snode_overwrite(snode_t* snode, int value);
+
 /***********************
  * Internals functions *
  ***********************/
 
-static int internal_lookup(inode_t* inode, int key, int lev, inode_t* parent, thread_args_t* thread_args);
-static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t* parent, thread_args_t* thread_args);
-static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, thread_args_t* thread_args);
+static int internal_lookup(ctrie_t* ctrie, int key, int* value, thread_args_t* thread_args);
+static int internal_insert(ctrie_t* ctrie, int key, int value, int* added, thread_args_t* thread_args);
+static int internal_remove(ctrie_t* ctrie, int key, int* value, thread_args_t* thread_args);
+
+static int lookup_step(ctrie_t* ctrie, inode_t* inode, int key, int lev, inode_t* parent, int* value, inode_t** next, thread_args_t* thread_args);
+static int insert_step(ctrie_t* ctrie, inode_t* inode, int key, int value, int lev, inode_t* parent, int* added, inode_t** next, thread_args_t* thread_args);
+static int remove_step(ctrie_t* ctrie, inode_t* inode, int key, int lev, inode_t* parent, int* value, inode_t** next, thread_args_t* thread_args);
+static int count_restart(thread_args_t* thread_args, restart_cause_t cause, int lev, int key);
+
+/******************
+ * Path functions *
+ ******************/
+
+static void path_init      (ctrie_t* ctrie, int key, path_t* path);
+static void path_from_cache(ctrie_t* ctrie, int key, int update, path_t* path, thread_args_t* thread_args);
+static void path_descend   (path_t* path, inode_t* inode);
+static void path_backtrack (path_t* path);
+
+/**************************
+ * Lookup cache functions *
+ **************************/
+
+static int  lookup_cache_create    (ctrie_t* ctrie);
+static void lookup_cache_fill      (ctrie_t* ctrie, int key, path_t* path);
+static void lookup_cache_invalidate(ctrie_t* ctrie, inode_t* inode, int lev);
+
+/*******************
+ * Cache functions *
+ *******************/
+
+static void cache_account(ctrie_t* ctrie, int delta, thread_args_t* thread_args);
+static int  cache_over_capacity(ctrie_t* ctrie, thread_args_t* thread_args);
+static int  sample_victim(ctrie_t* ctrie, int* key, thread_args_t* thread_args);
+static int  second_chance(snode_t* snode, int* key, thread_args_t* thread_args);
+static void evict(ctrie_t* ctrie, thread_args_t* thread_args);
+
+/************************
+ * Compaction functions *
+ ************************/
+
+static void compact_inode  (ctrie_t* ctrie, inode_t* inode, int depth, thread_args_t* thread_args, compaction_stats_t* stats);
+static void compact_subtree(ctrie_t* ctrie, inode_t* inode, int depth, thread_args_t* thread_args, compaction_stats_t* stats);
+static void compact_chunk  (ctrie_t* ctrie, uint32_t chunk, thread_args_t* thread_args, compaction_stats_t* stats);
 
 /*******************
  * CNode functions *
@@ -64,26 +174,90 @@ static main_node_t* cnode_remove(main_node_t* main_node, int pos, int flag);
  * LNode functions *
  *******************/
 
-static int lnode_insert(main_node_t* main_node, snode_t* snode, main_node_t** new_main_node, thread_args_t* thread_args);
+static int lnode_insert(main_node_t* main_node, snode_t* snode, main_node_t** new_main_node, int* added, thread_args_t* thread_args);
 static int lnode_copy  (main_node_t* main_node, main_node_t** new_main_node, thread_args_t* thread_args);
 static int lnode_remove(main_node_t* main_node, int key, main_node_t** new_main_node, int* value, thread_args_t* thread_args);
-static int lnode_lookup(lnode_t* lnode, int key, thread_args_t* thread_args);
+static int lnode_lookup(lnode_t* lnode, int key, int* value, thread_args_t* thread_args);
 
 /*********
  * Other *
  *********/
 
-static int          hash         (int key);
-static branch_t*    create_branch(int lev, snode_t* old_snode, snode_t* new_snode);
+static branch_t*    create_branch(int lev, snode_t* old_snode, snode_t* new_snode, uint32_t gen);
+
+/*************************
+ * Transaction functions *
+ *************************/
+
+static main_node_t*  txn_read      (inode_t* inode, main_node_t* tagged, thread_args_t* thread_args);
+static void          txn_help      (inode_t* inode, main_node_t* tagged, thread_args_t* thread_args);
+static void          txn_resolve   (txn_desc_t* desc, inode_t* inode, main_node_t* tagged);
+static void          txn_locate    (ctrie_t* ctrie, int key, int slot, txn_loc_t* loc, thread_args_t* thread_args);
+static int           txn_target    (txn_t* txn, inode_t* inode, main_node_t* main_node, int lev, txn_target_t** target);
+static int           txn_apply     (snode_t* entries, int* count, txn_op_t* op, int* delta, int* modified);
+static main_node_t*  txn_build_main(snode_t* entries, int count, int lev, uint32_t gen);
+static branch_t*     txn_build     (snode_t* entries, int count, int lev, uint32_t gen);
+static int           txn_copy_cnode(txn_target_t* target);
+static void          txn_set_branch(txn_target_t* target, int pos, branch_t* branch);
+static int           txn_prepare_cnode(txn_t* txn, txn_target_t* target, txn_op_t* ops, int num_of_ops, int* op_targets, thread_args_t* thread_args);
+static int           txn_prepare_lnode(txn_t* txn, txn_target_t* target, txn_op_t* ops, int num_of_ops, int* op_targets, thread_args_t* thread_args);
+static int           txn_unlink    (txn_t* txn, txn_target_t* target, txn_loc_t* loc, int key);
+static int           txn_contract  (txn_target_t* target, thread_args_t* thread_args);
+static int           txn_prepare   (ctrie_t* ctrie, txn_t* txn, txn_op_t* ops, int num_of_ops, thread_args_t* thread_args);
+static int           txn_commit    (txn_t* txn, thread_args_t* thread_args);
+static void          txn_retire    (txn_t* txn, thread_args_t* thread_args);
+static void          txn_discard   (txn_t* txn);
+
+/************************
+ * Checkpoint functions *
+ ************************/
+
+static void op_enter  (ctrie_t* ctrie, thread_args_t* thread_args);
+static void op_exit   (thread_args_t* thread_args);
+static void mark_dirty(path_t* path, thread_args_t* thread_args);
 
 /*******************
  * MACRO FUNCTIONS *
  *******************/
 
+// Returned by the step functions when the operation should continue in the child INode.
+#define DESCEND     (-4)
+// Returned by the step functions when their CAS failed, the operation backs off and resumes.
+#define CONTENDED   (-5)
+// The branch which contains `inode` (every INode but the root is embedded in a branch).
+#define INODE_BRANCH(inode) ((branch_t*) ((char*) (inode) - offsetof(branch_t, node)))
+// The hash level of the INode at `depth` and vice versa.
+#define DEPTH_LEV(depth)    ((depth) * W)
+#define LEV_DEPTH(lev)      ((lev) / W)
+// The depth of the wide root's INodes (0 for a plain root).
+#define WIDE_DEPTH(ctrie)   LEV_DEPTH((ctrie)->config.root_bits)
+// The depth of the INodes at which compaction chunks start.
+#define COMPACTION_CHUNK_DEPTH LEV_DEPTH(COMPACTION_CHUNK_BITS)
+// Sets the access bit of a hit snode, only writing (and dirtying the cache line) on the first hit since the last sweep.
+#define MARK_REFERENCED(snode) do {     \
+    if (!(snode)->referenced)           \
+        (snode)->referenced = 1;        \
+} while (0)
+
+// Stamps a main node which is about to replace `old_main_node`, a running checkpoint follows `prev` back to the old one.
+#define STAMP(new_main_node, old_main_node, thread_args) do {                                   \
+    (new_main_node)->gen    = (thread_args)->op_gen;                                            \
+    (new_main_node)->prev   = (thread_args)->checkpointing ? (old_main_node) : NULL;           \
+} while (0)
+// An operation which read a main node of a later generation than its own started before a checkpoint, and read what
+// was written after it. Whatever it writes next depends on that, so it is written in the checkpoint's generation.
+#define CATCH_UP(main_node, thread_args) do {                           \
+    if ((main_node)->gen > (thread_args)->op_gen)                       \
+    {                                                                   \
+        (thread_args)->op_gen           = (main_node)->gen;             \
+        (thread_args)->checkpointing    = 1;                            \
+    }                                                                   \
+} while (0)
 #define CAS(ptr, old, new) __sync_bool_compare_and_swap(ptr, old, new)
 #define CAS_OR_RESTART(CASed, old, new, msg, thread_args, new_branch) do {   \
     if (new == NULL)                                \
         FAIL(msg);                                  \
+    STAMP(new, old, thread_args);                   \
     if (CAS(CASed, old, new))                       \
     {                                               \
         DEBUG("CASed old %p and new %p", old, new); \
@@ -96,18 +270,57 @@ static branch_t*    create_branch(int lev, snode_t* old_snode, snode_t* new_snod
         DEBUG("CAS failed");                        \
         free(new);                                  \
         branch_free(new_branch);                    \
-        return RESTART;                             \
+        return CONTENDED;                           \
     }                                               \
 } while (0)
 /**
- * Creates CTrie instance.
+ * Returns the default configuration, set at compile time.
+ * @return the default configuration.
+ **/
+ctrie_config_t ctrie_default_config()
+{
+    ctrie_config_t config = {
+        .backoff = {
+            .min_spins = BACKOFF_MIN_SPINS,
+            .max_spins = BACKOFF_MAX_SPINS,
+        },
+        .capacity = CACHE_CAPACITY,
+        .root_bits = WIDE_ROOT_BITS,
+        .lookup_cache_bits = LOOKUP_CACHE_BITS,
+        .inplace_updates = INPLACE_UPDATES,
+    };
+    return config;
+}
+
+/**
+ * Creates CTrie instance with the default configuration.
  * @return On success initialized CTrie instance is returned, otherwise NULL is returned.
  **/
 ctrie_t* create_ctrie()
+{
+    ctrie_config_t config = ctrie_default_config();
+    return create_ctrie_with_config(&config);
+}
+
+/**
+ * Creates CTrie instance.
+ * @param config: the ctrie's configuration.
+ * @return On success initialized CTrie instance is returned, otherwise (or if the configuration is invalid) NULL is returned.
+ **/
+ctrie_t* create_ctrie_with_config(const ctrie_config_t* config)
 {
     ctrie_t*        ctrie       = NULL;
     inode_t*        inode       = NULL;
     main_node_t*    main_node   = NULL;
+    if (config->root_bits % W != 0 || config->root_bits > WIDE_ROOT_MAX_BITS)
+    {
+        FAIL("Invalid wide root bits %d", config->root_bits);
+    }
+    if (config->lookup_cache_bits % W != 0 || config->lookup_cache_bits > LOOKUP_CACHE_MAX_BITS ||
+        (config->lookup_cache_bits != 0 && config->lookup_cache_bits <= config->root_bits))
+    {
+        FAIL("Invalid lookup cache bits %d", config->lookup_cache_bits);
+    }
     MALLOC(ctrie, ctrie_t);
     MALLOC(inode, inode_t);
     MALLOC(main_node, main_node_t);
@@ -116,12 +329,25 @@ ctrie_t* create_ctrie()
     main_node->type         = CNODE;
     main_node->node.cnode   = cnode;
     inode->main             = main_node;
+    inode->fixed            = 1;
     ctrie->inode            = inode;
     ctrie->readonly         = 0;
+    ctrie->config           = *config;
+    ctrie->size             = 0;
+    ctrie->gen              = 0;
+    ctrie->starting         = 0;
+    ctrie->checkpointing    = 0;
+    ctrie->checkpoint_gen   = 0;
     ctrie->insert           = ctrie_insert;
     ctrie->remove           = ctrie_remove;
     ctrie->lookup           = ctrie_lookup;
+    ctrie->transaction      = ctrie_transaction;
     ctrie->free             = ctrie_free;
+    if (wide_root_expand(ctrie) != OK || lookup_cache_create(ctrie) != OK)
+    {
+        ctrie_free(ctrie);
+        return NULL;
+    }
     return ctrie;
 
 CLEANUP:
@@ -129,6 +355,56 @@ CLEANUP:
     return NULL;
 }
 
+/**
+ * Pre-expands the levels above the wide root: every CNode there gets all of its MAX_BRANCHES INodes.
+ * Updates never CAS these CNodes, and operations start at the wide root's INode of their key.
+ * @param ctrie: the new ctrie, its root is still empty.
+ * @return OK on success, otherwise FAILED. The INodes which were added are freed with the ctrie.
+ **/
+static int wide_root_expand(ctrie_t* ctrie)
+{
+    branch_t*       branch      = NULL;
+    main_node_t*    main_node   = NULL;
+    uint32_t        i           = 0;
+    int             depth       = 0;
+    int             pos         = 0;
+    for (depth = 1; depth <= WIDE_DEPTH(ctrie); depth++)
+    {
+        uint32_t num_of_parents = 1 << DEPTH_LEV(depth - 1);
+        ctrie->wide_root[depth] = calloc(num_of_parents * MAX_BRANCHES, sizeof(inode_t*));
+        if (ctrie->wide_root[depth] == NULL)
+        {
+            FAIL("Failed to allocate %d wide root INodes", num_of_parents * MAX_BRANCHES);
+        }
+        for (i = 0; i < num_of_parents; i++)
+        {
+            inode_t* parent = depth == 1 ? ctrie->inode : ctrie->wide_root[depth - 1][i];
+            cnode_t* cnode  = &(parent->main->node.cnode);
+            for (pos = 0; pos < MAX_BRANCHES; pos++)
+            {
+                branch      = NULL;
+                main_node   = NULL;
+                MALLOC(main_node, main_node_t);
+                MALLOC(branch, branch_t);
+                main_node->type             = CNODE;
+                branch->type                = INODE;
+                branch->node.inode.main     = main_node;
+                branch->node.inode.fixed    = 1;
+                cnode->array[pos]           = branch;
+                cnode->bmp                 |= 1 << pos;
+                cnode->length++;
+                // The position is the next W hash bits after the parent's.
+                ctrie->wide_root[depth][i | (pos << DEPTH_LEV(depth - 1))] = &(branch->node.inode);
+            }
+        }
+    }
+    return OK;
+
+CLEANUP:
+    free(main_node);
+    return FAILED;
+}
+
 /**
  * Frees `branch` and all its decendants.
  * @param branch: branch pointer to be freed.
@@ -262,7 +538,13 @@ static void ctrie_free(ctrie_t* ctrie)
 {
     if (ctrie != NULL) 
     {
+        int depth = 0;
         inode_free(ctrie->inode);
+        for (depth = 1; depth <= WIDE_DEPTH(ctrie); depth++)
+        {
+            free(ctrie->wide_root[depth]);
+        }
+        free((void*) ctrie->lookup_cache);
         free(ctrie);
     }
 }
@@ -271,17 +553,20 @@ static void ctrie_free(ctrie_t* ctrie)
  * Searches for `key` in the lnode-list beginning with `lnode`.
  * @param lnode: lnode-list to search in.
  * @param key: the key to search for.
+ * @param value: an out parameter that is set to `key`'s value if it is found.
  * @param thread_args: the thread arguments.
- * @return if key is found returns the related value, returns RESTART if some race occurred, otherwise returns NOTFOUND.
+ * @return if key is found returns OK, returns RESTART if some race occurred, otherwise returns NOTFOUND.
  **/
-static int lnode_lookup(lnode_t* lnode, int key, thread_args_t* thread_args)
+static int lnode_lookup(lnode_t* lnode, int key, int* value, thread_args_t* thread_args)
 {
     lnode_t* ptr = lnode;
     while (ptr != NULL)
     {
         if (ptr->snode.key == key)
         {
-            return ptr->snode.value;
+            *value = ptr->snode.value;
+            MARK_REFERENCED(&(ptr->snode));
+            return OK;
         }
         PLACE_LIST_HP(thread_args, ptr->next);
         if (ptr->marked)
@@ -298,7 +583,7 @@ static int lnode_lookup(lnode_t* lnode, int key, thread_args_t* thread_args)
  * @param key: key to find its hash value.
  * @return the hash of the given key.
  **/
-static int hash(int key)
+int ctrie_hash(int key)
 {
     return key / 10;
     //return key;
@@ -306,12 +591,61 @@ static int hash(int key)
 
 /**
  * Wraps tnode around snode.
- * @param snode: snode pointer which will become tnode.
+ * @param snode: snode pointer which will become tnode, it is sealed.
  * @return tnode that wraps a copy of the given snode.
  **/
 static tnode_t entomb(snode_t* snode)
 {
-    return (tnode_t) {.snode = *snode};
+    return (tnode_t) {.snode = snode_seal(snode)};
+}
+
+/**
+ * Seals an snode which is about to be copied or removed, so it is never overwritten in place again.
+ * Every SNode branch is sealed before it is unlinked, so an overwrite in place which succeeds was made while the
+ * snode was still in the ctrie.
+ * @param snode: the snode.
+ * @return an unsealed copy of the snode, with its final value.
+ **/
+static snode_t snode_seal(snode_t* snode)
+{
+    snode_t current = *snode;
+    snode_t sealed  = {0};
+    while (!current.sealed)
+    {
+        sealed          = current;
+        sealed.sealed   = 1;
+        if (CAS(&(snode->slot), current.slot, sealed.slot))
+        {
+            break;
+        }
+        current.slot = snode->slot;
+    }
+    current         = *snode;
+    current.sealed  = 0;
+    return current;
+}
+
+/**
+ * Overwrites the value of an snode in place.
+ * @param snode: the snode, in a CNode which was valid when its branch was protected.
+ * @param value: the new value.
+ * @return OK if the value was overwritten, or RESTART if the snode is sealed (the caller copies the CNode instead).
+ **/
+static int snode_overwrite(snode_t* snode, int value)
+{
+    snode_t current     = {0};
+    snode_t overwritten = {0};
+    current.slot = snode->slot;
+    while (!current.sealed)
+    {
+        overwritten.value = value;
+        if (CAS(&(snode->slot), current.slot, overwritten.slot))
+        {
+            return OK;
+        }
+        current.slot = snode->slot;
+    }
+    return RESTART;
 }
 
 /**
@@ -340,13 +674,14 @@ CLEANUP:
 
 /**
  * Contracts main node if points to a 1-length CNode.
- * @param main_node: main node pointer to be contracted.
- * @param lev: hash level.
+ * @param inode: the INode of the main node, a fixed INode is never contracted.
+ * @param old_main_node: the INode's current main node, which main_node is about to replace.
+ * @param main_node: main node pointer to be contracted, a private copy of old_main_node.
  * @param old_branch: an out parameter, will contain the replaced branch if the node was contracted. Will be set to NULL if no contraction happened.
  * @param thread_args: the thread arguments.
  * @return RESTART if a race occured, otherwise returns OK.
  **/
-static int to_contracted(main_node_t* main_node, int lev, branch_t** old_branch, thread_args_t* thread_args)
+static int to_contracted(inode_t* inode, main_node_t* old_main_node, main_node_t* main_node, branch_t** old_branch, thread_args_t* thread_args)
 {
     *old_branch = NULL;
     if (main_node->type != CNODE)
@@ -354,12 +689,13 @@ static int to_contracted(main_node_t* main_node, int lev, branch_t** old_branch,
         return OK;
     }
     cnode_t* cnode = &(main_node->node.cnode);
-    if (lev > 0 && cnode->length == 1)
+    if (!inode->fixed && cnode->length == 1)
     {
         int index = highest_on_bit(cnode->bmp);
         branch_t* branch = cnode->array[index];
-        REPLACE_LAST_HP(thread_args, branch);
-        if (cnode->marked || cnode->array[index] != branch)
+        PLACE_HP(thread_args, branch);
+        // main_node is a private copy, so only the INode still pointing to old_main_node keeps the branch from being retired.
+        if (inode->main != old_main_node)
         {
             return RESTART;
         }
@@ -377,17 +713,21 @@ static int to_contracted(main_node_t* main_node, int lev, branch_t** old_branch,
 
 /**
  * Compresses old_main_node and tries to replace it.
- * @param cas_address: the address to be CAS'ed.
+ * @param ctrie: the ctrie, whose lookup cache forgets the INodes which are removed.
+ * @param inode: the inode whose main node is CAS'ed.
  * @param old_main_node: the main node to be compressed.
  * @param lev: hash level.
+ * @param stats: optional, counts the tombstones it resurrected and whether it contracted the CNode.
  * @param thread_args: the thread arguments.
  **/
-static void compress(main_node_t **cas_address, main_node_t *old_main_node, int lev, thread_args_t *thread_args)
+static void compress(ctrie_t *ctrie, inode_t *inode, main_node_t *old_main_node, int lev, compaction_stats_t* stats, thread_args_t *thread_args)
 {
     main_node_t* new_main_node  = NULL;
+    branch_t*    old_branch     = NULL;
     int32_t      delete_map     = 0;
 
     cnode_t* cnode              = &(old_main_node->node.cnode);
+    CATCH_UP(old_main_node, thread_args);
     MALLOC(new_main_node, main_node_t);
     new_main_node->type         = CNODE;
     new_main_node->node.cnode   = *cnode;
@@ -404,18 +744,24 @@ static void compress(main_node_t **cas_address, main_node_t *old_main_node, int
                 DEBUG("Failed compress: m: %d !=: %d", cnode->marked, cnode->array[i] != curr_branch);
                 goto CLEANUP;
             }
-            if (curr_branch->type == INODE && curr_branch->node.inode.main->type == TNODE)
+            main_node_t* tmp_main_node = curr_branch->type == INODE ? curr_branch->node.inode.main : NULL;
+            // A transaction which is committing into the child is left alone.
+            if (tmp_main_node == NULL || TXN_TAGGED(tmp_main_node))
+            {
+                continue;
+            }
+            inode_t*     tmp_inode      = &(curr_branch->node.inode);
+            // The child's main node may be replaced (and retired) meanwhile, it's protected before its type is read.
+            PLACE_TMP_HP(thread_args, tmp_main_node);
+            if (tmp_inode->marked || tmp_inode->main != tmp_main_node)
+            {
+                DEBUG("SHEET");
+                goto CLEANUP;
+            }
+            CATCH_UP(tmp_main_node, thread_args);
+            if (tmp_main_node->type == TNODE)
             {
-                inode_t*     tmp_inode      = &(curr_branch->node.inode);
-                main_node_t* tmp_main_node  = tmp_inode->main;
                 DEBUG("Replacing branch %p - main_node %p", curr_branch, tmp_main_node);
-                PLACE_TMP_HP(thread_args, tmp_main_node);
-                // TODO accessing tmp_inode after replacing HP.
-                if (tmp_inode->marked || tmp_inode->main != tmp_main_node)
-                {
-                    DEBUG("SHEET");
-                    goto CLEANUP;
-                }
                 branch_t* new_branch = resurrect(tmp_main_node);
                 if (new_branch == NULL)
                 {
@@ -426,15 +772,15 @@ static void compress(main_node_t **cas_address, main_node_t *old_main_node, int
             }
         }
     }
-    branch_t* old_branch = NULL;
-    if (to_contracted(new_main_node, lev, &old_branch, thread_args) == RESTART)
+    if (to_contracted(inode, old_main_node, new_main_node, &old_branch, thread_args) == RESTART)
     {
-        PERS_PRINT("REAL SHEET");
+        DEBUG("REAL SHEET");
         // clean is a best effort, if we fail, we clean and return.
         goto CLEANUP;
     }
     DEBUG("to contracted 3");
-    if (!CAS(cas_address, old_main_node, new_main_node))
+    STAMP(new_main_node, old_main_node, thread_args);
+    if (!CAS(&(inode->main), old_main_node, new_main_node))
     {
         goto CLEANUP;
     }
@@ -454,6 +800,7 @@ static void compress(main_node_t **cas_address, main_node_t *old_main_node, int
         if (delete_map & (1 << i))
         {
             branch_t* branch = cnode->array[i];
+            lookup_cache_invalidate(ctrie, &(branch->node.inode), lev + W);
             add_to_free_list(thread_args, branch->node.inode.main);
             add_to_free_list(thread_args, branch);
         }
@@ -463,39 +810,179 @@ static void compress(main_node_t **cas_address, main_node_t *old_main_node, int
     {
         add_to_free_list(thread_args, old_branch);
     }
+    if (stats != NULL)
+    {
+        stats->resurrected  += __builtin_popcount(delete_map);
+        stats->contracted   += old_branch != NULL;
+    }
     return;
 
 CLEANUP:
+    if (old_branch != NULL && delete_map != 0)
+    {
+        // The copy was contracted into a TNode, so its single (resurrected) branch is no longer in its array.
+        branch_free(old_branch);
+    }
     selective_main_node_free(new_main_node, delete_map);
 }
 
 /**
  * Tries to clean inode if it points to a compressable CNode.
- * @param inode: inode to clean.
+ * @param ctrie: the ctrie.
+ * @param inode: inode to clean, NULL if it's unknown (above a path which started at a cached INode).
  * @param lev: hash level.
  * @param thread_args: the thread arguments.
- * @note Assumes that inode and inode->main are protected with HP.
+ * @note Assumes that inode is protected with HP.
  **/
-static void clean(inode_t* inode, int lev, thread_args_t* thread_args)
+static void clean(ctrie_t* ctrie, inode_t* inode, int lev, thread_args_t* thread_args)
 {
+    if (inode == NULL)
+    {
+        return;
+    }
     DEBUG("cleaning inode %p", inode);
+    TRACE(thread_args, TRACE_CLEAN, 0, lev);
     main_node_t* old_main_node = inode->main;
-    if (inode->main->type == CNODE)
+    if (TXN_TAGGED(old_main_node))
+    {
+        // The caller restarts, and the next clean finds the transaction's outcome.
+        txn_help(inode, old_main_node, thread_args);
+        return;
+    }
+    PLACE_HP(thread_args, old_main_node);
+    if (inode->marked || inode->main != old_main_node)
+    {
+        // Someone else has already replaced the main node, cleaning is a best effort.
+        return;
+    }
+    if (old_main_node->type == CNODE)
+    {
+        compress(ctrie, inode, old_main_node, lev, NULL, thread_args);
+    }
+}
+
+/**
+ * Starts the path of an operation on `key`: at the root, or right at the wide root's INode of `key`.
+ * The INodes above are fixed, so they need no hazard pointers and are never backtracked into.
+ * @param ctrie: the ctrie.
+ * @param key: the operation's key.
+ * @param path: an out parameter that is set to the path.
+ **/
+static void path_init(ctrie_t* ctrie, int key, path_t* path)
+{
+    uint32_t hash = ctrie_hash(key);
+    path->inodes[0] = ctrie->inode;
+    for (path->depth = 1; path->depth <= WIDE_DEPTH(ctrie); path->depth++)
+    {
+        path->inodes[path->depth] = ctrie->wide_root[path->depth][hash & ((1 << DEPTH_LEV(path->depth)) - 1)];
+    }
+    path->depth--;
+    path->root = path->depth;
+    path->base = path->depth;
+}
+
+/**
+ * Moves the start of a new path down to the INode of the lookup cache for `key`, if it's cached and valid.
+ * @param ctrie: the ctrie.
+ * @param key: the operation's key.
+ * @param update: whether the operation is an update, which marks its path dirty.
+ * @param path: the path, as set by path_init.
+ * @param thread_args: the thread arguments.
+ **/
+static void path_from_cache(ctrie_t* ctrie, int key, int update, path_t* path, thread_args_t* thread_args)
+{
+    int      lev    = ctrie->config.lookup_cache_bits;
+    inode_t* inode  = NULL;
+    uint32_t slot   = 0;
+    if (ctrie->lookup_cache == NULL)
+    {
+        return;
+    }
+    slot    = ctrie_hash(key) & ((1 << lev) - 1);
+    inode   = ctrie->lookup_cache[slot];
+    if (inode == NULL)
+    {
+        return;
+    }
+    PLACE_PATH_HP(thread_args, LEV_DEPTH(lev), INODE_BRANCH(inode));
+    // An INode is removed from the cache after it's unlinked and marked, and before it's retired.
+    if (ctrie->lookup_cache[slot] != inode || inode->marked)
+    {
+        return;
+    }
+    // The path doesn't know the INodes above, an update relies on an earlier update having marked them dirty already.
+    if (update && inode->dirty != thread_args->op_gen)
+    {
+        return;
+    }
+    path->depth                 = LEV_DEPTH(lev);
+    path->base                  = path->depth;
+    path->inodes[path->depth]   = inode;
+}
+
+/**
+ * Descends from the current INode of `path` into its child `inode`.
+ * @param path: the operation's path.
+ * @param inode: the child INode, its branch must be protected by the path hazard pointer of the next depth.
+ **/
+static void path_descend(path_t* path, inode_t* inode)
+{
+    path->depth++;
+    path->inodes[path->depth] = inode;
+}
+
+/**
+ * Backtracks `path` to the deepest INode which is still valid, so the operation resumes from it instead of the root.
+ * An INode is unlinked only by compress, after it became a TNode, and it is marked right after.
+ * So an unmarked INode is still on the path of the key (and a TNode just sends us one level up).
+ * A path which started at a cached INode can't go above it, so it starts over from the wide root instead.
+ * @param path: the operation's path.
+ **/
+static void path_backtrack(path_t* path)
+{
+    DEBUG("restarting from depth %d", path->depth);
+    while (path->depth > path->base && path->inodes[path->depth]->marked)
+    {
+        path->depth--;
+    }
+    if (path->depth == path->base && path->base > path->root)
     {
-        compress(&(inode->main), old_main_node, lev, thread_args);
+        path->depth = path->root;
+        path->base  = path->root;
     }
 }
 
 /**
- * Searches for `key` in `inode`'s descendants.
+ * Counts a restart of an operation, and with CONTENTION_HEATMAP the depth and the root slot it happened at.
+ * @param thread_args: the thread arguments.
+ * @param cause: why the operation restarts.
+ * @param lev: hash level of the INode the operation restarts from.
+ * @param key: the operation's key.
+ * @return RESTART.
+ **/
+static int count_restart(thread_args_t* thread_args, restart_cause_t cause, int lev, int key)
+{
+    thread_args->contention.restarts[cause]++;
+#if CONTENTION_HEATMAP
+    thread_args->contention.depths[LEV_DEPTH(lev)]++;
+    thread_args->contention.slots[ctrie_hash(key) & (MAX_BRANCHES - 1)]++;
+#endif
+    return RESTART;
+}
+
+/**
+ * Searches for `key` in `inode`'s children.
+ * @param ctrie: the ctrie.
  * @param inode: inode to be searched in.
  * @param key: key to be searched for.
  * @param lev: hash level.
- * @param parent: parent inode pointer.
+ * @param parent: parent inode pointer, NULL if it's unknown.
+ * @param value: an out parameter that is set to the value related to the found key.
+ * @param next: an out parameter that is set to the child inode to continue with.
  * @param thread_args: the thread arguments.
- * @return On success returns the value related to the found key if found, NOTFOUND if the key doesn't exists, or RESTART if the lookup needs to be called again.
+ * @return OK if the key is found, NOTFOUND if the key doesn't exists, DESCEND if the lookup should continue in `next`, or RESTART if the lookup needs to be resumed.
  **/
-static int internal_lookup(inode_t* inode, int key, int lev, inode_t* parent, thread_args_t* thread_args)
+static int lookup_step(ctrie_t* ctrie, inode_t* inode, int key, int lev, inode_t* parent, int* value, inode_t** next, thread_args_t* thread_args)
 {
     main_node_t* main_node = inode->main;
 
@@ -504,22 +991,41 @@ static int internal_lookup(inode_t* inode, int key, int lev, inode_t* parent, th
         return NOTFOUND;
     }
 
-    PLACE_HP(thread_args, main_node);
-    if (inode->marked || inode->main != main_node)
+    if (TXN_TAGGED(main_node))
     {
-        return RESTART;
+        // A transaction is committing, read the main node it replaces or the one it installs without interfering.
+        main_node = txn_read(inode, main_node, thread_args);
+        if (main_node == NULL)
+        {
+            return count_restart(thread_args, RESTART_TXN, lev, key);
+        }
+    }
+    else
+    {
+        PLACE_HP(thread_args, main_node);
+        if (inode->marked)
+        {
+            return count_restart(thread_args, RESTART_MARKED_INODE, lev, key);
+        }
+        if (inode->main != main_node)
+        {
+            return count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
+        }
     }
 
     int pos  = 0;
     int flag = 0;
     branch_t* branch = NULL;
 
+    // An injected preemption holds the main node's hazard pointer (an update's CAS of it follows).
+    PREEMPTION_POINT(thread_args);
+
     // Check the inode's child.
     switch(main_node->type)
     {
     case CNODE:
         // CNode - compute the branch with the relevant hash bits and search in it.
-        pos = (hash(key) >> lev) & 0x1f;
+        pos = (ctrie_hash(key) >> lev) & 0x1f;
         flag = 1 << pos;
         // Check if the branch is empty.
         if ((flag & main_node->node.cnode.bmp) == 0)
@@ -527,21 +1033,24 @@ static int internal_lookup(inode_t* inode, int key, int lev, inode_t* parent, th
             return NOTFOUND;
         }
         branch = main_node->node.cnode.array[pos];
-        PLACE_HP(thread_args, branch);
+        PLACE_PATH_HP(thread_args, LEV_DEPTH(lev) + 1, branch);
         if (main_node->node.cnode.marked || main_node->node.cnode.array[pos] != branch)
         {
-            return RESTART;
+            return count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
         }
         switch (branch->type)
         {
         case INODE:
-            // INode - recursively lookup.
-            return internal_lookup(&(branch->node.inode), key, lev + W, inode, thread_args);
+            // INode - continue the lookup in it.
+            *next = &(branch->node.inode);
+            return DESCEND;
         case SNODE:
             // SNode - simply compare the keys.
             if (key == branch->node.snode.key)
             {
-                return branch->node.snode.value;
+                *value = branch->node.snode.value;
+                MARK_REFERENCED(&(branch->node.snode));
+                return OK;
             }
             return NOTFOUND;
         default:
@@ -549,35 +1058,74 @@ static int internal_lookup(inode_t* inode, int key, int lev, inode_t* parent, th
         }
     case TNODE:
         // TNode - help resurrect it and restart.
-        clean(parent, lev - W, thread_args);
-        return RESTART;
+        clean(ctrie, parent, lev - W, thread_args);
+        return count_restart(thread_args, RESTART_TNODE, lev, key);
     case LNODE:
+    {
         // LNode - search the linked list.
-        return lnode_lookup(&(main_node->node.lnode), key, thread_args);
+        int res = lnode_lookup(&(main_node->node.lnode), key, value, thread_args);
+        if (res == RESTART)
+        {
+            return count_restart(thread_args, RESTART_LNODE_MARKED, lev, key);
+        }
+        return res;
+    }
     default:
         return NOTFOUND;
     }
 }
 
 /**
- * Searches for `key` in the ctrie.
+ * Searches for `key` in the ctrie, descending iteratively and resuming from the deepest valid INode on races.
  * @param ctrie: the ctrie.
  * @param key: the key to be searched for.
+ * @param value: an out parameter that is set to the value related to the found key.
  * @param thread_args: the thread arguments.
- * @return If `key` is found, its value is returned, otherwise NOTFOUND is returned.
+ * @return OK if the key is found, otherwise NOTFOUND.
  **/
-static int ctrie_lookup(struct ctrie_t* ctrie, int key, thread_args_t* thread_args)
+static int internal_lookup(ctrie_t* ctrie, int key, int* value, thread_args_t* thread_args)
 {
-    int res = RESTART;
-    do {
-        res = internal_lookup(ctrie->inode, key, 0, NULL, thread_args);
-        if (res == RESTART)
+    path_t   path;
+    inode_t* next = NULL;
+    path_init(ctrie, key, &path);
+    path_from_cache(ctrie, key, 0, &path, thread_args);
+    while (1)
+    {
+        int depth = path.depth;
+        int res   = lookup_step(ctrie, path.inodes[depth], key, DEPTH_LEV(depth), depth > path.base ? path.inodes[depth - 1] : NULL, value, &next, thread_args);
+        switch (res)
         {
-            DEBUG("restarting lookup!");
+        case DESCEND:
+            path_descend(&path, next);
+            lookup_cache_fill(ctrie, key, &path);
+            break;
+        case RESTART:
+            path_backtrack(&path);
+            break;
+        default:
+            return res;
         }
     }
-    while (res == RESTART);
-    return  res;
+}
+
+/**
+ * Searches for `key` in the ctrie.
+ * @param ctrie: the ctrie.
+ * @param key: the key to be searched for.
+ * @param thread_args: the thread arguments.
+ * @return If `key` is found, its value is returned, otherwise NOTFOUND is returned.
+ **/
+static int ctrie_lookup(struct ctrie_t* ctrie, int key, thread_args_t* thread_args)
+{
+    int value = NOTFOUND;
+    int res   = NOTFOUND;
+    op_enter(ctrie, thread_args);
+    TRACE(thread_args, TRACE_OP_START, key, TRACE_LOOKUP);
+    res = internal_lookup(ctrie, key, &value, thread_args);
+    op_exit(thread_args);
+    res = res == OK ? value : NOTFOUND;
+    TRACE(thread_args, TRACE_OP_END, key, res);
+    return res;
 }
 
 /**
@@ -598,9 +1146,10 @@ static main_node_t* cnode_insert(main_node_t* main_node, int pos, int flag, int
     MALLOC(branch, branch_t);
     MALLOC(new_main_node, main_node_t);
 
-    branch->type                = SNODE;
-    branch->node.snode.key      = key;
-    branch->node.snode.value    = value;
+    branch->type                    = SNODE;
+    branch->node.snode.key          = key;
+    branch->node.snode.value        = value;
+    branch->node.snode.referenced   = 0;
 
     new_main_node->type                     = CNODE;
     new_main_node->node.cnode               = main_node->node.cnode;
@@ -663,9 +1212,10 @@ CLEANUP:
  * @param lev: the hash level.
  * @param old_snode: the old snode.
  * @param new_snode: the new snode.
+ * @param gen: the checkpoint generation of the operation.
  * @return On sucess the created branch is returned, otherwise NULL is reutrned.
  **/
-static branch_t* create_branch(int lev, snode_t* old_snode, snode_t* new_snode)
+static branch_t* create_branch(int lev, snode_t* old_snode, snode_t* new_snode, uint32_t gen)
 {
     branch_t*    branch     = NULL;
     branch_t*    child      = NULL;
@@ -680,12 +1230,12 @@ static branch_t* create_branch(int lev, snode_t* old_snode, snode_t* new_snode)
     if (lev < MAX_BRANCHES)
     {
         cnode_t cnode = {0};
-        int pos1 = (hash(old_snode->key) >> lev) & 0x1f;
-        int pos2 = (hash(new_snode->key) >> lev) & 0x1f;
+        int pos1 = (ctrie_hash(old_snode->key) >> lev) & 0x1f;
+        int pos2 = (ctrie_hash(new_snode->key) >> lev) & 0x1f;
         if (pos1 == pos2)
         {
             DEBUG("calling create_branch recursively");
-            child = create_branch(lev + W, old_snode, new_snode);
+            child = create_branch(lev + W, old_snode, new_snode, gen);
             if (child == NULL)
             {
                 FAIL("failed to create child branch");
@@ -720,9 +1270,12 @@ static branch_t* create_branch(int lev, snode_t* old_snode, snode_t* new_snode)
         main_node->node.lnode.next   = next;
     }
 
+    main_node->gen = gen;
     branch->type = INODE;
     branch->node.inode.main = main_node;
     branch->node.inode.marked = 0;
+    // A new subtree is changed as a whole.
+    branch->node.inode.dirty = gen;
     DEBUG("created branch %p", branch);
     return branch;
 
@@ -732,22 +1285,34 @@ CLEANUP:
 }
 
 /**
- * Attempts to insert `snode` into the lnode list.
+ * Attempts to insert `snode` into the lnode list, if its key is already in the list its value is updated.
  * @param main_node: the main node which contains the lnode.
  * @param snode: the new snode to be inserted.
  * @param new_main_node: an out paramter that is set to the new lnode wrapped by a main node.
+ * @param added: an out parameter that is set to 1 if the key is new, or to 0 if it was updated.
  * @param thread_args: the thread arguments.
  * @return OK is returned on success, RESTART if a race occurred and FAILED is returned otherwise.
  **/
-static int lnode_insert(main_node_t* main_node, snode_t* snode, main_node_t** new_main_node, thread_args_t* thread_args)
+static int lnode_insert(main_node_t* main_node, snode_t* snode, main_node_t** new_main_node, int* added, thread_args_t* thread_args)
 {
     lnode_t* next   = NULL;
+    lnode_t* ptr    = NULL;
     int res = lnode_copy(main_node, new_main_node, thread_args);
     if (res != OK)
     {
         return res;
     }
+    for (ptr = &((*new_main_node)->node.lnode); ptr != NULL; ptr = ptr->next)
+    {
+        if (ptr->snode.key == snode->key)
+        {
+            ptr->snode = *snode;
+            *added     = 0;
+            return OK;
+        }
+    }
     MALLOC(next, lnode_t);
+    *added = 1;
 
     next->snode = (*new_main_node)->node.lnode.snode;
     next->next  = (*new_main_node)->node.lnode.next;
@@ -880,16 +1445,19 @@ CLEANUP:
 }
 
 /**
- * Attempts to insert (`key`, `value`) to the subtree of `inode`.
+ * Attempts to insert (`key`, `value`) to the children of `inode`.
+ * @param ctrie: the ctrie.
  * @param inode: the current inode.
  * @param key: the key to be inserted.
  * @param value: the value to be inserted.
  * @param lev: the hash level.
- * @param parent: the parent inode.
+ * @param parent: the parent inode, NULL if it's unknown.
+ * @param added: an out parameter that is set to 1 if `key` is new, or to 0 if its value was updated.
+ * @param next: an out parameter that is set to the child inode to continue with.
  * @param thread_args: the thread arguments.
- * @return On failure FAILED is returned, otherwise OK is returned if (`key`, `value`) was inserted, or RESTART if the insert should be called again.
+ * @return On failure FAILED is returned, otherwise OK is returned if (`key`, `value`) was inserted, DESCEND if the insert should continue in `next`, CONTENDED if the CAS failed or RESTART if the insert should be resumed.
  */
-static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t* parent, thread_args_t* thread_args)
+static int insert_step(ctrie_t* ctrie, inode_t* inode, int key, int value, int lev, inode_t* parent, int* added, inode_t** next, thread_args_t* thread_args)
 {
     main_node_t* main_node  = inode->main;
 
@@ -903,17 +1471,28 @@ static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t*
     branch_t*    branch     = NULL;
     branch_t*    child      = NULL;
 
+    if (TXN_TAGGED(main_node))
+    {
+        txn_help(inode, main_node, thread_args);
+        return count_restart(thread_args, RESTART_TXN, lev, key);
+    }
     PLACE_HP(thread_args, main_node);
-    if (inode->marked || inode->main != main_node)
+    if (inode->marked)
     {
-        return RESTART;
+        return count_restart(thread_args, RESTART_MARKED_INODE, lev, key);
+    }
+    if (inode->main != main_node)
+    {
+        return count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
     }
+    CATCH_UP(main_node, thread_args);
 
+    PREEMPTION_POINT(thread_args);
     switch(main_node->type)
     {
     case CNODE:
         // CNode - compute the branch with the relevant hash bits and insert in it.
-        pos = (hash(key) >> lev) & 0x1f;
+        pos = (ctrie_hash(key) >> lev) & 0x1f;
         flag = 1 << pos;
         // Check if the branch is empty.
         if ((flag & main_node->node.cnode.bmp) == 0)
@@ -922,35 +1501,47 @@ static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t*
             branch_t* new_branch = NULL;
             main_node_t* new_main_node = cnode_insert(main_node, pos, flag, key, value, &new_branch);
             CAS_OR_RESTART(&(inode->main), main_node, new_main_node, "Failed to insert into cnode", thread_args, new_branch);
+            *added = 1;
             //DEBUG("inode %p key %d bmp %x length %d", inode, key, new_main_node->node.cnode.bmp, new_main_node->node.cnode.length);
             return OK;
         }
         // Check the branch.
         branch = main_node->node.cnode.array[pos];
-        PLACE_HP(thread_args, branch);
+        PLACE_PATH_HP(thread_args, LEV_DEPTH(lev) + 1, branch);
         if (main_node->node.cnode.marked || main_node->node.cnode.array[pos] != branch)
         {
-            return RESTART;
+            return count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
         }
         switch (branch->type)
         {
         case INODE:
-            // INode - recursively insert.
-            return internal_insert(&(branch->node.inode), key, value, lev + W, inode, thread_args);
+            // INode - continue the insert in it.
+            *next = &(branch->node.inode);
+            return DESCEND;
         case SNODE:
             if (key == branch->node.snode.key)
             {
+                // Nothing is allocated or retired, a running checkpoint must see the old value though.
+                if (ctrie->config.inplace_updates && !thread_args->checkpointing &&
+                    snode_overwrite(&(branch->node.snode), value) == OK)
+                {
+                    *added = 0;
+                    return OK;
+                }
+                snode_seal(&(branch->node.snode));
                 branch_t* new_branch = NULL;
                 main_node_t* new_main_node = cnode_update(main_node, pos, key, value, &new_branch);
                 CAS_OR_RESTART(&(inode->main), main_node, new_main_node, "Failed to update cnode", thread_args, new_branch);
                 add_to_free_list(thread_args, branch);
+                *added = 0;
                 //DEBUG("inode %p key %d bmp %x length %d", inode, key, new_main_node->node.cnode.bmp, new_main_node->node.cnode.length);
                 return OK;
             }
             else
             {
                 snode_t new_snode = { .key = key, .value = value };
-                child = create_branch(lev + W, &(branch->node.snode), &new_snode);
+                snode_t old_snode = snode_seal(&(branch->node.snode));
+                child = create_branch(lev + W, &old_snode, &new_snode, thread_args->op_gen);
                 if (child == NULL)
                 {
                     return FAILED;
@@ -958,6 +1549,7 @@ static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t*
                 main_node_t* new_main_node = cnode_update_branch(main_node, pos, child);
                 CAS_OR_RESTART(&(inode->main), main_node, new_main_node, "Failed to update cnode branch", thread_args, child);
                 add_to_free_list(thread_args, branch);
+                *added = 1;
                 //DEBUG("inode %p key %d bmp %x length %d", inode, key, new_main_node->node.cnode.bmp, new_main_node->node.cnode.length);
                 return OK;
             }
@@ -966,19 +1558,20 @@ static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t*
         }
         break;
     case TNODE:
-        clean(parent, lev - W, thread_args);
-        break;
+        clean(ctrie, parent, lev - W, thread_args);
+        return count_restart(thread_args, RESTART_TNODE, lev, key);
     case LNODE:
     {
         snode_t new_snode = { .key = key, .value = value };
         main_node_t* new_main_node = NULL;
-        int res = lnode_insert(main_node, &new_snode, &new_main_node, thread_args);
+        int res = lnode_insert(main_node, &new_snode, &new_main_node, added, thread_args);
         if (res == OK)
         {
             if (NULL == new_main_node)
             {
                 FAIL("failed to insert to lnode list");
             }
+            STAMP(new_main_node, main_node, thread_args);
             if (CAS(&(inode->main), main_node, new_main_node))
             {
                 lnode_t* ptr = main_node->node.lnode.next;
@@ -1003,9 +1596,13 @@ static int internal_insert(inode_t* inode, int key, int value, int lev, inode_t*
             else
             {
                 main_node_free(new_main_node);
-                return RESTART;
+                return CONTENDED;
             }
         }
+        if (res == RESTART)
+        {
+            return count_restart(thread_args, RESTART_LNODE_MARKED, lev, key);
+        }
         return res;
     }
     default:
@@ -1017,25 +1614,80 @@ CLEANUP:
     return FAILED;
 }
 
+/**
+ * Inserts (`key`, `value`) to the ctrie, descending iteratively and resuming from the deepest valid INode on races.
+ * @param ctrie: the ctrie.
+ * @param key: the key to be inserted.
+ * @param value: the value to be inserted.
+ * @param added: an out parameter that is set to 1 if `key` is new, or to 0 if its value was updated.
+ * @param thread_args: the thread arguments.
+ * @return On success, OK is returned, otherwise FAILED is returned.
+ **/
+static int internal_insert(ctrie_t* ctrie, int key, int value, int* added, thread_args_t* thread_args)
+{
+    path_t   path;
+    inode_t* next = NULL;
+    path_init(ctrie, key, &path);
+    path_from_cache(ctrie, key, 1, &path, thread_args);
+    while (1)
+    {
+        int depth = path.depth;
+        int res   = insert_step(ctrie, path.inodes[depth], key, value, DEPTH_LEV(depth), depth > path.base ? path.inodes[depth - 1] : NULL, added, &next, thread_args);
+        switch (res)
+        {
+        case DESCEND:
+            path_descend(&path, next);
+            lookup_cache_fill(ctrie, key, &path);
+            break;
+        case CONTENDED:
+            TRACE(thread_args, TRACE_CAS_FAIL, key, depth);
+            count_restart(thread_args, RESTART_CAS_FAILED, DEPTH_LEV(depth), key);
+            backoff_failure(&(thread_args->backoff), &(ctrie->config.backoff), thread_args->index);
+            path_backtrack(&path);
+            break;
+        case RESTART:
+            path_backtrack(&path);
+            break;
+        case OK:
+            backoff_success(&(thread_args->backoff));
+            mark_dirty(&path, thread_args);
+            return res;
+        default:
+            return res;
+        }
+    }
+}
+
 /**
  * Attempts to insert (`key`, `value`) to the ctrie.
+ * If the ctrie's capacity is bounded and a new key takes it over capacity, some entries are evicted.
  * @param ctrie: the ctrie.
  * @param key: the new key to be inserted.
  * @param value: the new value to be inserted.
  * @param thread_args: the thread arguments.
- * @return On success, OK is returned, otherwise FAILED is returned.
+ * @return On success, OK is returned, otherwise (or if the ctrie is readonly) FAILED is returned.
  **/
 static int ctrie_insert(ctrie_t* ctrie, int key, int value, thread_args_t* thread_args)
 {
-    int res = RESTART;
-    do {
-        res = internal_insert(ctrie->inode, key, value, 0, NULL, thread_args);
-        if (res == RESTART)
+    int added   = 0;
+    int res     = FAILED;
+    if (ctrie->readonly)
+    {
+        return FAILED;
+    }
+    op_enter(ctrie, thread_args);
+    TRACE(thread_args, TRACE_OP_START, key, TRACE_INSERT);
+    res = internal_insert(ctrie, key, value, &added, thread_args);
+    if (res == OK && added && ctrie->config.capacity > 0)
+    {
+        cache_account(ctrie, 1, thread_args);
+        if (cache_over_capacity(ctrie, thread_args))
         {
-            DEBUG("restarting insert!");
+            evict(ctrie, thread_args);
         }
     }
-    while (res == RESTART);
+    op_exit(thread_args);
+    TRACE(thread_args, TRACE_OP_END, key, res);
     return res;
 }
 
@@ -1065,15 +1717,18 @@ CLEANUP:
 }
 
 /**
- * Attempts to remove `key` from the subtree of `inode`.
- * @param inode: subtree from which to remove `key`.
+ * Attempts to remove `key` from the children of `inode`.
+ * @param ctrie: the ctrie.
+ * @param inode: inode from which to remove `key`.
  * @param key: key to be removed.
  * @param lev: hash level.
- * @param parent: parent inode of `inode`.
+ * @param parent: parent inode of `inode`, NULL if it's unknown.
+ * @param value: an out parameter that is set to `key`'s value if it is removed.
+ * @param next: an out parameter that is set to the child inode to continue with.
  * @param thread_args: the thread arguments.
- * @return On failure, FAILED is returned, otherwise if `key` was removed its value is returned, if `key` couldn't be found NOTFOUND is returned, RESTART my be the result if `internal_remove` shoud be called again.
+ * @return On failure, FAILED is returned, otherwise if `key` was removed OK is returned, if `key` couldn't be found NOTFOUND is returned, DESCEND if the remove should continue in `next`, CONTENDED if the CAS failed, RESTART my be the result if the remove shoud be resumed.
  **/
-static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, thread_args_t* thread_args)
+static int remove_step(ctrie_t* ctrie, inode_t* inode, int key, int lev, inode_t* parent, int* value, inode_t** next, thread_args_t* thread_args)
 {
     main_node_t* main_node  = inode->main;
 
@@ -1086,11 +1741,23 @@ static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, th
     int          flag       = 0;
     branch_t*    branch     = NULL;
 
+    if (TXN_TAGGED(main_node))
+    {
+        txn_help(inode, main_node, thread_args);
+        return count_restart(thread_args, RESTART_TXN, lev, key);
+    }
     PLACE_HP(thread_args, main_node);
-    if (inode->marked || inode->main != main_node)
+    if (inode->marked)
     {
-        return RESTART;
+        return count_restart(thread_args, RESTART_MARKED_INODE, lev, key);
     }
+    if (inode->main != main_node)
+    {
+        return count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
+    }
+    CATCH_UP(main_node, thread_args);
+
+    PREEMPTION_POINT(thread_args);
 
     // Check the inode's child.
     switch(main_node->type)
@@ -1099,7 +1766,7 @@ static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, th
         {
             int res = NOTFOUND;
             // CNode - compute the branch with the relevant hash bits and remove from it.
-            pos = (hash(key) >> lev) & 0x1f;
+            pos = (ctrie_hash(key) >> lev) & 0x1f;
             flag = 1 << pos;
             // Check if the branch is empty.
             if ((flag & main_node->node.cnode.bmp) == 0) {
@@ -1109,16 +1776,17 @@ static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, th
             }
             // Check the branch.
             branch = main_node->node.cnode.array[pos];
-            PLACE_HP(thread_args, branch);
+            PLACE_PATH_HP(thread_args, LEV_DEPTH(lev) + 1, branch);
             if (main_node->node.cnode.marked || main_node->node.cnode.array[pos] != branch)
             {
-                return RESTART;
+                return count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
             }
             switch (branch->type)
             {
                 case INODE:
-                    // INode - recursively remove.
-                    res = internal_remove(&(branch->node.inode), key, lev + W, inode, thread_args);
+                    // INode - continue the remove in it.
+                    *next = &(branch->node.inode);
+                    res = DESCEND;
                     break;
                 case SNODE:
                     if (key != branch->node.snode.key)
@@ -1127,23 +1795,25 @@ static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, th
                     }
                     else
                     {
-                        res = branch->node.snode.value;
+                        res = OK;
+                        *value = snode_seal(&(branch->node.snode)).value;
                         main_node_t *new_main_node = cnode_remove(main_node, pos, flag);
                         if (new_main_node == NULL)
                         {
                             FAIL("Failed to remove %d from cnode", key);
                         }
                         branch_t* old_branch = NULL;
-                        if (to_contracted(new_main_node, lev, &old_branch, thread_args) == RESTART)
+                        if (to_contracted(inode, main_node, new_main_node, &old_branch, thread_args) == RESTART)
                         {
-                            res = RESTART;
+                            res = count_restart(thread_args, RESTART_CHANGED_MAIN, lev, key);
                             free(new_main_node);
                             goto DONE;
                         }
                         DEBUG("to contracted 2");
+                        STAMP(new_main_node, main_node, thread_args);
                         if (!CAS(&(inode->main), main_node, new_main_node))
                         {
-                            res = RESTART;
+                            res = CONTENDED;
                             free(new_main_node);
                             goto DONE;
                         }
@@ -1165,20 +1835,23 @@ static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, th
             return res;
         }
         case TNODE:
-            clean(parent, lev - W, thread_args);
-            return RESTART;
+            clean(ctrie, parent, lev - W, thread_args);
+            return count_restart(thread_args, RESTART_TNODE, lev, key);
         case LNODE:
         {
-            int old_value = 0;
             main_node_t* new_main_node = NULL;
-            int res = lnode_remove(main_node, key, &new_main_node, &old_value, thread_args);
+            int res = lnode_remove(main_node, key, &new_main_node, value, thread_args);
             switch (res)
             {
             case NOTFOUND:
                 return NOTFOUND;
+            case RESTART:
+                // The list was replaced while it was copied.
+                return count_restart(thread_args, RESTART_LNODE_MARKED, lev, key);
             case FAILED:
                 FAIL("failed to remove %d from lnode list", key);
             case OK:
+                STAMP(new_main_node, main_node, thread_args);
                 if (CAS(&(inode->main), main_node, new_main_node))
                 {
                     lnode_t* ptr = main_node->node.lnode.next;
@@ -1198,12 +1871,12 @@ static int internal_remove(inode_t* inode, int key, int lev, inode_t* parent, th
                         ptr = tmp;
                     }
                     add_to_free_list(thread_args, main_node);
-                    return old_value;
+                    return OK;
                 }
                 else
                 {
                     main_node_free(new_main_node);
-                    return RESTART;
+                    return CONTENDED;
                 }
             }
         }
@@ -1215,22 +1888,1488 @@ CLEANUP:
     return FAILED;
 }
 
+/**
+ * Removes `key` from the ctrie, descending iteratively and resuming from the deepest valid INode on races.
+ * @param ctrie: ctrie pointer from which key will be removed.
+ * @param key: key to be removed.
+ * @param value: an out parameter that is set to `key`'s value if it is removed.
+ * @param thread_args: the thread arguments.
+ * @return On failure FAILED is returned, otherwise, if `key` was removed OK is returned and if not NOTFOUND is returned.
+ **/
+static int internal_remove(ctrie_t* ctrie, int key, int* value, thread_args_t* thread_args)
+{
+    path_t   path;
+    inode_t* next = NULL;
+    path_init(ctrie, key, &path);
+    path_from_cache(ctrie, key, 1, &path, thread_args);
+    while (1)
+    {
+        int depth = path.depth;
+        int res   = remove_step(ctrie, path.inodes[depth], key, DEPTH_LEV(depth), depth > path.base ? path.inodes[depth - 1] : NULL, value, &next, thread_args);
+        switch (res)
+        {
+        case DESCEND:
+            path_descend(&path, next);
+            lookup_cache_fill(ctrie, key, &path);
+            break;
+        case CONTENDED:
+            TRACE(thread_args, TRACE_CAS_FAIL, key, depth);
+            count_restart(thread_args, RESTART_CAS_FAILED, DEPTH_LEV(depth), key);
+            backoff_failure(&(thread_args->backoff), &(ctrie->config.backoff), thread_args->index);
+            path_backtrack(&path);
+            break;
+        case RESTART:
+            path_backtrack(&path);
+            break;
+        case OK:
+            backoff_success(&(thread_args->backoff));
+            mark_dirty(&path, thread_args);
+            return res;
+        default:
+            return res;
+        }
+    }
+}
+
 /**
  * Removes `key` from `ctrie`.
  * @param ctrie: ctrie pointer from which key will be removed.
  * @param key: key to be removed.
  * @param thread_args: the thread arguments.
- * @return On failure FAILED is returned, otherwise, if `key` was found, its value is returned and if not NOTFOUND is returned.
+ * @return On failure (or if the ctrie is readonly) FAILED is returned, otherwise, if `key` was found, its value is returned and if not NOTFOUND is returned.
  **/
 static int ctrie_remove(ctrie_t* ctrie, int key, thread_args_t* thread_args)
 {
-    int res = RESTART;
-    do {
-        res = internal_remove(ctrie->inode, key, 0, NULL, thread_args);
-        if (res == RESTART)
+    int value   = NOTFOUND;
+    int res     = FAILED;
+    if (ctrie->readonly)
+    {
+        return FAILED;
+    }
+    op_enter(ctrie, thread_args);
+    TRACE(thread_args, TRACE_OP_START, key, TRACE_REMOVE);
+    res = internal_remove(ctrie, key, &value, thread_args);
+    op_exit(thread_args);
+    if (res == OK && ctrie->config.capacity > 0)
+    {
+        cache_account(ctrie, -1, thread_args);
+    }
+    res = res == OK ? value : res;
+    TRACE(thread_args, TRACE_OP_END, key, res);
+    return res;
+}
+
+/**
+ * Applies `ops` to the ctrie atomically: either all of them take effect at once, or none of them does.
+ * The operations are applied in order, each sees the ones before it. For example, moving the value `v` of key `a` to
+ * key `b` is {TXN_EXPECT a v, TXN_REMOVE a, TXN_INSERT b v}.
+ * The new main nodes of the changed INodes are prepared first, then a descriptor is installed in these INodes and the
+ * transaction is decided (like RDCSS). No locks are taken: lookups read through a descriptor, and updates which meet an
+ * undecided one abort it, so a transaction which keeps conflicting with updates retries with backoff.
+ * @param ctrie: the ctrie.
+ * @param ops: the operations, a removed value is returned in its operation.
+ * @param num_of_ops: the number of operations, at most TXN_MAX_OPS.
+ * @param thread_args: the thread arguments.
+ * @return OK if the transaction was applied, NOTFOUND if a removed key was missing or an expected value didn't match,
+ * otherwise (or if the ctrie is readonly) FAILED.
+ **/
+static int ctrie_transaction(ctrie_t* ctrie, txn_op_t* ops, int num_of_ops, thread_args_t* thread_args)
+{
+    txn_t   txn;
+    int     res = FAILED;
+    if (ctrie->readonly || num_of_ops <= 0 || num_of_ops > TXN_MAX_OPS)
+    {
+        return FAILED;
+    }
+    op_enter(ctrie, thread_args);
+    TRACE(thread_args, TRACE_OP_START, ops[0].key, TRACE_TRANSACTION);
+    while (1)
+    {
+        memset(&txn, 0, sizeof(txn));
+        res = txn_prepare(ctrie, &txn, ops, num_of_ops, thread_args);
+        if (res == OK)
+        {
+            res = txn_commit(&txn, thread_args);
+        }
+        else
+        {
+            txn_discard(&txn);
+        }
+        release_txn_hazard_pointers(thread_args->hp_lists[thread_args->index]);
+        if (res == CONTENDED)
+        {
+            TRACE(thread_args, TRACE_CAS_FAIL, ops[0].key, 0);
+            backoff_failure(&(thread_args->backoff), &(ctrie->config.backoff), thread_args->index);
+        }
+        else if (res != RESTART)
+        {
+            break;
+        }
+    }
+    if (res == OK)
+    {
+        backoff_success(&(thread_args->backoff));
+        if (ctrie->config.capacity > 0 && txn.delta != 0)
         {
-            DEBUG("restarting remove!");
+            cache_account(ctrie, txn.delta, thread_args);
+            if (txn.delta > 0 && cache_over_capacity(ctrie, thread_args))
+            {
+                evict(ctrie, thread_args);
+            }
         }
-    } while (res == RESTART);
+    }
+    op_exit(thread_args);
+    TRACE(thread_args, TRACE_OP_END, ops[0].key, res);
     return res;
 }
+
+/**
+ * Finds the entry of `inode` in a transaction's descriptor.
+ * @param desc: the descriptor.
+ * @param inode: an inode the descriptor is installed in.
+ * @return the inode's entry.
+ **/
+txn_entry_t* txn_entry(txn_desc_t* desc, inode_t* inode)
+{
+    int i = 0;
+    // The descriptor is installed only in the inodes of its entries, so the last one is the only one left.
+    for (i = 0; i < desc->num_of_entries - 1; i++)
+    {
+        if (desc->entries[i].inode == inode)
+        {
+            break;
+        }
+    }
+    return &(desc->entries[i]);
+}
+
+/**
+ * Reads the main node of `inode` while a transaction commits into it, without interfering with the transaction.
+ * Until the transaction succeeds the inode still has its old main node.
+ * @param inode: the inode, protected with HP.
+ * @param tagged: the tagged descriptor which was read from the inode's main.
+ * @param thread_args: the thread arguments.
+ * @return the main node protected with HP, or NULL if the inode changed meanwhile.
+ **/
+static main_node_t* txn_read(inode_t* inode, main_node_t* tagged, thread_args_t* thread_args)
+{
+    txn_desc_t*  desc       = TXN_DESC(tagged);
+    main_node_t* main_node  = NULL;
+    PLACE_HP(thread_args, desc);
+    if (inode->marked || inode->main != tagged)
+    {
+        return NULL;
+    }
+    main_node = desc->status == TXN_SUCCEEDED ? txn_entry(desc, inode)->new : txn_entry(desc, inode)->old;
+    PLACE_HP(thread_args, main_node);
+    // Both main nodes are retired only after the descriptor leaves the inode.
+    if (inode->main != tagged)
+    {
+        return NULL;
+    }
+    return main_node;
+}
+
+/**
+ * Gets a transaction which is committing into `inode` out of an update's way: aborts it if it's undecided, and then
+ * replaces its descriptor in `inode`.
+ * @param inode: the inode, protected with HP.
+ * @param tagged: the tagged descriptor which was read from the inode's main.
+ * @param thread_args: the thread arguments.
+ **/
+static void txn_help(inode_t* inode, main_node_t* tagged, thread_args_t* thread_args)
+{
+    txn_desc_t* desc = TXN_DESC(tagged);
+    PLACE_HP(thread_args, desc);
+    if (inode->main != tagged)
+    {
+        return;
+    }
+    CAS(&(desc->status), TXN_UNDECIDED, TXN_FAILED);
+    txn_resolve(desc, inode, tagged);
+}
+
+/**
+ * Replaces the descriptor of a decided transaction in `inode` with the inode's new main node, or back with its old one.
+ * @param desc: the descriptor, protected with HP.
+ * @param inode: an inode of the transaction, protected with HP.
+ * @param tagged: the tagged descriptor.
+ **/
+static void txn_resolve(txn_desc_t* desc, inode_t* inode, main_node_t* tagged)
+{
+    txn_entry_t* entry = txn_entry(desc, inode);
+    if (desc->status != TXN_SUCCEEDED)
+    {
+        CAS(&(inode->main), tagged, entry->old);
+        return;
+    }
+    if (entry->unlink)
+    {
+        // The parent no longer has the inode, operations inside it go back to the parent.
+        inode->marked = 1;
+        FENCE;
+    }
+    CAS(&(inode->main), tagged, entry->new);
+}
+
+/**
+ * Finds the INode in which an operation of a transaction applies (like a lookup), and keeps it protected for the rest
+ * of the transaction.
+ * @param ctrie: the ctrie.
+ * @param key: the operation's key.
+ * @param slot: the operation's index, which owns the transaction hazard pointers from 4 * slot.
+ * @param loc: an out parameter that is set to where the operation applies.
+ * @param thread_args: the thread arguments.
+ **/
+static void txn_locate(ctrie_t* ctrie, int key, int slot, txn_loc_t* loc, thread_args_t* thread_args)
+{
+    path_t       path;
+    main_node_t* mains[MAX_LEVELS]  = {0};
+    path_init(ctrie, key, &path);
+    while (1)
+    {
+        int          depth      = path.depth;
+        int          lev        = DEPTH_LEV(depth);
+        inode_t*     inode      = path.inodes[depth];
+        main_node_t* main_node  = inode->main;
+        if (TXN_TAGGED(main_node))
+        {
+            txn_help(inode, main_node, thread_args);
+            continue;
+        }
+        PLACE_HP(thread_args, main_node);
+        if (inode->marked || inode->main != main_node)
+        {
+            path_backtrack(&path);
+            continue;
+        }
+        if (main_node->type == TNODE)
+        {
+            clean(ctrie, path.inodes[depth - 1], lev - W, thread_args);
+            path_backtrack(&path);
+            continue;
+        }
+        mains[depth] = main_node;
+        if (main_node->type == CNODE)
+        {
+            int pos = (ctrie_hash(key) >> lev) & 0x1f;
+            if (main_node->node.cnode.bmp & (1 << pos))
+            {
+                branch_t* branch = main_node->node.cnode.array[pos];
+                PLACE_PATH_HP(thread_args, depth + 1, branch);
+                if (main_node->node.cnode.marked || main_node->node.cnode.array[pos] != branch)
+                {
+                    path_backtrack(&path);
+                    continue;
+                }
+                if (branch->type == INODE)
+                {
+                    path_descend(&path, &(branch->node.inode));
+                    continue;
+                }
+            }
+        }
+        // Both are still protected by the path and the HP ring, so they are never left unprotected.
+        PLACE_TXN_HP(thread_args, 4 * slot, depth > 0 ? INODE_BRANCH(inode) : NULL);
+        PLACE_TXN_HP(thread_args, 4 * slot + 1, main_node);
+        *loc = (txn_loc_t) { .inode = inode, .main = main_node, .lev = lev };
+        if (main_node->type == LNODE)
+        {
+            loc->parent         = path.inodes[depth - 1];
+            loc->parent_main    = mains[depth - 1];
+            PLACE_TXN_HP(thread_args, 4 * slot + 2, depth > 1 ? INODE_BRANCH(loc->parent) : NULL);
+            PLACE_TXN_HP(thread_args, 4 * slot + 3, loc->parent_main);
+            // The parent's main node may have left the HP ring, it's protected only if it's still the parent's main.
+            if (loc->parent->marked || loc->parent->main != loc->parent_main)
+            {
+                path.depth--;
+                continue;
+            }
+        }
+        // Marked ahead of the commit, an aborted transaction only makes the next incremental checkpoint a bit larger.
+        mark_dirty(&path, thread_args);
+        return;
+    }
+}
+
+/**
+ * Finds the target of a transaction which changes `inode`, or adds it.
+ * @param txn: the transaction.
+ * @param inode: the inode.
+ * @param main_node: the inode's main node, as read by the operation.
+ * @param lev: the inode's hash level.
+ * @param target: an out parameter that is set to the target.
+ * @return OK, or RESTART if another operation read a different main node of the inode.
+ **/
+static int txn_target(txn_t* txn, inode_t* inode, main_node_t* main_node, int lev, txn_target_t** target)
+{
+    int i = 0;
+    for (i = 0; i < txn->num_of_targets; i++)
+    {
+        if (txn->targets[i].inode == inode)
+        {
+            *target = &(txn->targets[i]);
+            return txn->targets[i].old == main_node ? OK : RESTART;
+        }
+    }
+    *target             = &(txn->targets[txn->num_of_targets]);
+    (*target)->inode    = inode;
+    (*target)->old      = main_node;
+    (*target)->new      = main_node;
+    (*target)->lev      = lev;
+    txn->num_of_targets++;
+    return OK;
+}
+
+/**
+ * Applies an operation of a transaction to the entries of a cnode position (or of an lnode-list).
+ * @param entries: the entries, with room for one more.
+ * @param count: in-out parameter, the number of entries.
+ * @param op: the operation, a removed value is returned in it.
+ * @param delta: in-out parameter, the change in the number of entries.
+ * @param modified: an out parameter that is set to 1 if the entries changed.
+ * @return OK, or NOTFOUND if the operation's condition doesn't hold.
+ **/
+static int txn_apply(snode_t* entries, int* count, txn_op_t* op, int* delta, int* modified)
+{
+    int i = 0;
+    while (i < *count && entries[i].key != op->key)
+    {
+        i++;
+    }
+    switch (op->type)
+    {
+    case TXN_INSERT:
+        if (i == *count)
+        {
+            (*count)++;
+            (*delta)++;
+        }
+        entries[i]  = (snode_t) { .key = op->key, .value = op->value };
+        *modified   = 1;
+        return OK;
+    case TXN_REMOVE:
+        if (i == *count)
+        {
+            return NOTFOUND;
+        }
+        op->value   = entries[i].value;
+        entries[i]  = entries[*count - 1];
+        (*count)--;
+        (*delta)--;
+        *modified   = 1;
+        return OK;
+    default:
+        return i < *count && entries[i].value == op->value ? OK : NOTFOUND;
+    }
+}
+
+/**
+ * Builds a new main node which holds `entries`, a cnode which splits them by their hash bits or an lnode-list.
+ * @param entries: the entries, at least 2, and at most TXN_MAX_OPS + 1 above the lnode level.
+ * @param count: the number of entries.
+ * @param lev: the hash level of the main node.
+ * @param gen: the checkpoint generation of the operation.
+ * @return On success the main node is returned, otherwise NULL is returned.
+ **/
+static main_node_t* txn_build_main(snode_t* entries, int count, int lev, uint32_t gen)
+{
+    main_node_t*    main_node   = NULL;
+    lnode_t*        lnode       = NULL;
+    snode_t         group[TXN_MAX_OPS + 1];
+    int i   = 0;
+    int pos = 0;
+
+    MALLOC(main_node, main_node_t);
+    main_node->gen = gen;
+    if (lev >= MAX_BRANCHES)
+    {
+        main_node->type             = LNODE;
+        main_node->node.lnode.snode = entries[0];
+        for (i = count - 1; i > 0; i--)
+        {
+            MALLOC(lnode, lnode_t);
+            lnode->snode                = entries[i];
+            lnode->next                 = main_node->node.lnode.next;
+            main_node->node.lnode.next  = lnode;
+        }
+        return main_node;
+    }
+    main_node->type = CNODE;
+    if (count > TXN_MAX_OPS + 1)
+    {
+        FAIL("Too many entries for one position: %d", count);
+    }
+    for (pos = 0; pos < MAX_BRANCHES; pos++)
+    {
+        int size = 0;
+        for (i = 0; i < count; i++)
+        {
+            if (((ctrie_hash(entries[i].key) >> lev) & 0x1f) == pos)
+            {
+                group[size] = entries[i];
+                size++;
+            }
+        }
+        if (size == 0)
+        {
+            continue;
+        }
+        branch_t* branch = txn_build(group, size, lev + W, gen);
+        if (branch == NULL)
+        {
+            FAIL("Failed to build branch %d", pos);
+        }
+        main_node->node.cnode.bmp       |= 1 << pos;
+        main_node->node.cnode.array[pos] = branch;
+        main_node->node.cnode.length++;
+    }
+    return main_node;
+
+CLEANUP:
+    main_node_free(main_node);
+    return NULL;
+}
+
+/**
+ * Builds a new branch which holds `entries`, an snode or an INode of a new subtree.
+ * @param entries: the entries, see txn_build_main.
+ * @param count: the number of entries, at least 1.
+ * @param lev: the hash level of the branch's subtree.
+ * @param gen: the checkpoint generation of the operation.
+ * @return On success the branch is returned, otherwise NULL is returned.
+ **/
+static branch_t* txn_build(snode_t* entries, int count, int lev, uint32_t gen)
+{
+    branch_t* branch = NULL;
+    MALLOC(branch, branch_t);
+    if (count == 1)
+    {
+        branch->type        = SNODE;
+        branch->node.snode  = entries[0];
+        return branch;
+    }
+    branch->type            = INODE;
+    branch->node.inode.main = txn_build_main(entries, count, lev, gen);
+    if (branch->node.inode.main == NULL)
+    {
+        FAIL("Failed to build a subtree of %d entries", count);
+    }
+    // A new subtree is changed as a whole.
+    branch->node.inode.dirty = gen;
+    return branch;
+
+CLEANUP:
+    free(branch);
+    return NULL;
+}
+
+/**
+ * Copies the old cnode of a target into its new main node, unless it was copied already.
+ * @param target: the target.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int txn_copy_cnode(txn_target_t* target)
+{
+    main_node_t* new_main_node = NULL;
+    if (target->new != target->old)
+    {
+        return OK;
+    }
+    MALLOC(new_main_node, main_node_t);
+    new_main_node->type                 = CNODE;
+    new_main_node->node.cnode           = target->old->node.cnode;
+    new_main_node->node.cnode.marked    = 0;
+    target->new                         = new_main_node;
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Sets the branch in position `pos` of a target's new cnode.
+ * @param target: the target, with a copied cnode.
+ * @param pos: the position.
+ * @param branch: a branch created by the transaction, or NULL to empty the position.
+ **/
+static void txn_set_branch(txn_target_t* target, int pos, branch_t* branch)
+{
+    cnode_t* cnode = &(target->new->node.cnode);
+    uint32_t flag  = 1 << pos;
+    if (branch != NULL && !(cnode->bmp & flag))
+    {
+        cnode->bmp |= flag;
+        cnode->length++;
+    }
+    else if (branch == NULL && (cnode->bmp & flag))
+    {
+        cnode->bmp &= ~flag;
+        cnode->length--;
+    }
+    cnode->array[pos]   = branch;
+    target->built[pos]  = branch;
+    target->changed    |= flag;
+}
+
+/**
+ * Prepares the new cnode of a target: the operations on each position are applied to its snode (if any), and the
+ * position gets a new branch which holds the resulting entries.
+ * @param txn: the transaction.
+ * @param target: the target, whose old main node is a cnode.
+ * @param ops: the transaction's operations.
+ * @param num_of_ops: the number of operations.
+ * @param op_targets: the index of the target of every operation.
+ * @param thread_args: the thread arguments.
+ * @return OK, NOTFOUND if an operation's condition doesn't hold, RESTART if the cnode was replaced, or FAILED.
+ **/
+static int txn_prepare_cnode(txn_t* txn, txn_target_t* target, txn_op_t* ops, int num_of_ops, int* op_targets, thread_args_t* thread_args)
+{
+    cnode_t* cnode  = &(target->old->node.cnode);
+    int      index  = target - txn->targets;
+    uint32_t done   = 0;
+    int i = 0;
+    int j = 0;
+    for (i = 0; i < num_of_ops; i++)
+    {
+        int         pos         = (ctrie_hash(ops[i].key) >> target->lev) & 0x1f;
+        uint32_t    flag        = 1 << pos;
+        snode_t     entries[TXN_MAX_OPS + 1];
+        int         count       = 0;
+        int         modified    = 0;
+        branch_t*   branch      = NULL;
+        if (op_targets[i] != index || (done & flag))
+        {
+            continue;
+        }
+        done |= flag;
+        if (cnode->bmp & flag)
+        {
+            branch = cnode->array[pos];
+            PLACE_TMP_HP(thread_args, branch);
+            // An INode would have been located, so it's there only if the cnode changed.
+            if (cnode->marked || cnode->array[pos] != branch || branch->type != SNODE)
+            {
+                return RESTART;
+            }
+            entries[count] = snode_seal(&(branch->node.snode));
+            count++;
+        }
+        for (j = i; j < num_of_ops; j++)
+        {
+            if (op_targets[j] == index && ((ctrie_hash(ops[j].key) >> target->lev) & 0x1f) == pos)
+            {
+                int res = txn_apply(entries, &count, &(ops[j]), &(txn->delta), &modified);
+                if (res != OK)
+                {
+                    return res;
+                }
+            }
+        }
+        if (!modified)
+        {
+            continue;
+        }
+        if (txn_copy_cnode(target) != OK)
+        {
+            return FAILED;
+        }
+        branch = NULL;
+        if (count > 0)
+        {
+            branch = txn_build(entries, count, target->lev + W, thread_args->op_gen);
+            if (branch == NULL)
+            {
+                return FAILED;
+            }
+        }
+        txn_set_branch(target, pos, branch);
+    }
+    return OK;
+}
+
+/**
+ * Prepares the new main node of a target whose old main node is an lnode-list: a new list, a TNode if a single entry
+ * is left, or an (unreachable) TNode if no entry is left, then the inode is unlinked from its parent.
+ * @param txn: the transaction.
+ * @param target: the target.
+ * @param ops: the transaction's operations.
+ * @param num_of_ops: the number of operations.
+ * @param op_targets: the index of the target of every operation.
+ * @param thread_args: the thread arguments.
+ * @return OK, NOTFOUND if an operation's condition doesn't hold, RESTART if the list was replaced, or FAILED.
+ **/
+static int txn_prepare_lnode(txn_t* txn, txn_target_t* target, txn_op_t* ops, int num_of_ops, int* op_targets, thread_args_t* thread_args)
+{
+    main_node_t*    copy        = NULL;
+    main_node_t*    new_main    = NULL;
+    snode_t*        entries     = NULL;
+    lnode_t*        lnode       = NULL;
+    int             index       = target - txn->targets;
+    int             count       = 0;
+    int             modified    = 0;
+    int             res         = lnode_copy(target->old, &copy, thread_args);
+    int i = 0;
+    if (res != OK)
+    {
+        return res;
+    }
+    res = FAILED;
+    for (lnode = &(copy->node.lnode); lnode != NULL; lnode = lnode->next)
+    {
+        count++;
+    }
+    entries = malloc((count + num_of_ops) * sizeof(snode_t));
+    if (entries == NULL)
+    {
+        FAIL("Failed to allocate %d entries", count + num_of_ops);
+    }
+    count = 0;
+    for (lnode = &(copy->node.lnode); lnode != NULL; lnode = lnode->next)
+    {
+        entries[count] = lnode->snode;
+        count++;
+    }
+    res = OK;
+    for (i = 0; i < num_of_ops && res == OK; i++)
+    {
+        if (op_targets[i] == index)
+        {
+            res = txn_apply(entries, &count, &(ops[i]), &(txn->delta), &modified);
+        }
+    }
+    if (res != OK || !modified)
+    {
+        goto CLEANUP;
+    }
+    res = FAILED;
+    if (count >= 2)
+    {
+        new_main = txn_build_main(entries, count, target->lev, thread_args->op_gen);
+        if (new_main == NULL)
+        {
+            FAIL("Failed to build an lnode-list of %d entries", count);
+        }
+    }
+    else
+    {
+        MALLOC(new_main, main_node_t);
+        new_main->type = TNODE;
+        if (count == 1)
+        {
+            new_main->node.tnode = entomb(&(entries[0]));
+        }
+        target->unlink = count == 0;
+    }
+    target->new = new_main;
+    res         = OK;
+
+CLEANUP:
+    main_node_free(copy);
+    free(entries);
+    return res;
+}
+
+/**
+ * Unlinks the INode of an lnode-list which a transaction empties from the parent's cnode, the parent becomes a target.
+ * @param txn: the transaction.
+ * @param target: the emptied target.
+ * @param loc: the location of an operation on the target.
+ * @param key: the key of that operation.
+ * @return OK, RESTART if the parent changed, or FAILED.
+ **/
+static int txn_unlink(txn_t* txn, txn_target_t* target, txn_loc_t* loc, int key)
+{
+    txn_target_t*   parent  = NULL;
+    int             lev     = target->lev - W;
+    int             pos     = (ctrie_hash(key) >> lev) & 0x1f;
+    int             res     = txn_target(txn, loc->parent, loc->parent_main, lev, &parent);
+    if (res != OK)
+    {
+        return res;
+    }
+    if (!(parent->old->node.cnode.bmp & (1 << pos)) || parent->old->node.cnode.array[pos] != INODE_BRANCH(target->inode))
+    {
+        return RESTART;
+    }
+    if (txn_copy_cnode(parent) != OK)
+    {
+        return FAILED;
+    }
+    txn_set_branch(parent, pos, NULL);
+    return OK;
+}
+
+/**
+ * Entombs the new cnode of a target below the root which is left with a single snode, like to_contracted.
+ * @param target: the target.
+ * @param thread_args: the thread arguments.
+ * @return OK, or RESTART if the target's old cnode was replaced.
+ **/
+static int txn_contract(txn_target_t* target, thread_args_t* thread_args)
+{
+    main_node_t*    main_node   = target->new;
+    branch_t*       branch      = NULL;
+    int             pos         = 0;
+    if (main_node == target->old || main_node->type != CNODE || target->inode->fixed || main_node->node.cnode.length != 1)
+    {
+        return OK;
+    }
+    pos     = highest_on_bit(main_node->node.cnode.bmp);
+    branch  = main_node->node.cnode.array[pos];
+    if (!(target->changed & (1 << pos)))
+    {
+        // An unchanged branch of the old cnode.
+        PLACE_TMP_HP(thread_args, branch);
+        if (target->old->node.cnode.marked || target->old->node.cnode.array[pos] != branch)
+        {
+            return RESTART;
+        }
+    }
+    if (branch->type != SNODE)
+    {
+        return OK;
+    }
+    main_node->type         = TNODE;
+    main_node->node.tnode   = entomb(&(branch->node.snode));
+    if (target->changed & (1 << pos))
+    {
+        free(branch);
+        target->built[pos] = NULL;
+    }
+    else
+    {
+        target->entombed = branch;
+    }
+    return OK;
+}
+
+/**
+ * Prepares a transaction: locates its operations and computes the new main node of every INode it changes.
+ * @param ctrie: the ctrie.
+ * @param txn: the transaction, zeroed.
+ * @param ops: the transaction's operations.
+ * @param num_of_ops: the number of operations.
+ * @param thread_args: the thread arguments.
+ * @return OK, NOTFOUND if an operation's condition doesn't hold, RESTART if the ctrie changed meanwhile, or FAILED.
+ **/
+static int txn_prepare(ctrie_t* ctrie, txn_t* txn, txn_op_t* ops, int num_of_ops, thread_args_t* thread_args)
+{
+    txn_target_t*   target                  = NULL;
+    int             op_targets[TXN_MAX_OPS] = {0};
+    int             num_of_targets          = 0;
+    int             res                     = OK;
+    int i = 0;
+    int j = 0;
+    for (i = 0; i < num_of_ops; i++)
+    {
+        txn_locate(ctrie, ops[i].key, i, &(txn->locs[i]), thread_args);
+        res = txn_target(txn, txn->locs[i].inode, txn->locs[i].main, txn->locs[i].lev, &target);
+        if (res != OK)
+        {
+            return res;
+        }
+        op_targets[i] = target - txn->targets;
+    }
+    num_of_targets = txn->num_of_targets;
+    for (i = 0; i < num_of_targets && res == OK; i++)
+    {
+        target = &(txn->targets[i]);
+        if (target->old->type == LNODE)
+        {
+            res = txn_prepare_lnode(txn, target, ops, num_of_ops, op_targets, thread_args);
+        }
+        else
+        {
+            res = txn_prepare_cnode(txn, target, ops, num_of_ops, op_targets, thread_args);
+        }
+    }
+    for (i = 0; i < num_of_targets && res == OK; i++)
+    {
+        if (txn->targets[i].unlink)
+        {
+            for (j = 0; op_targets[j] != i; j++);
+            res = txn_unlink(txn, &(txn->targets[i]), &(txn->locs[j]), ops[j].key);
+        }
+    }
+    for (i = 0; i < txn->num_of_targets && res == OK; i++)
+    {
+        res = txn_contract(&(txn->targets[i]), thread_args);
+    }
+    return res;
+}
+
+/**
+ * Commits a prepared transaction: installs its descriptor in all its INodes (in address order) and decides it.
+ * Either way the descriptor is then replaced in all the INodes, and the replaced (or unused) nodes are retired.
+ * @param txn: the prepared transaction.
+ * @param thread_args: the thread arguments.
+ * @return OK if the transaction succeeded, CONTENDED if it was aborted, or FAILED.
+ **/
+static int txn_commit(txn_t* txn, thread_args_t* thread_args)
+{
+    txn_desc_t*  desc   = NULL;
+    main_node_t* tagged = NULL;
+    int i = 0;
+    int j = 0;
+
+    MALLOC(desc, txn_desc_t);
+    desc->status = TXN_UNDECIDED;
+    // The new main nodes were built from the old ones, so they are written in the latest generation of any of them.
+    for (i = 0; i < txn->num_of_targets; i++)
+    {
+        CATCH_UP(txn->targets[i].old, thread_args);
+    }
+    for (i = 0; i < txn->num_of_targets; i++)
+    {
+        txn_target_t* target = &(txn->targets[i]);
+        if (target->new != target->old)
+        {
+            STAMP(target->new, target->old, thread_args);
+        }
+        // Transactions which share INodes install their descriptors in the same order, so one of them wins.
+        for (j = desc->num_of_entries; j > 0 && desc->entries[j - 1].inode > target->inode; j--)
+        {
+            desc->entries[j] = desc->entries[j - 1];
+        }
+        desc->entries[j] = (txn_entry_t) { .inode = target->inode, .old = target->old, .new = target->new, .unlink = target->unlink };
+        desc->num_of_entries++;
+    }
+    tagged = TXN_TAG(desc);
+
+    for (i = 0; i < desc->num_of_entries && desc->status == TXN_UNDECIDED; i++)
+    {
+        txn_entry_t* entry = &(desc->entries[i]);
+        while (!CAS(&(entry->inode->main), entry->old, tagged))
+        {
+            main_node_t* main_node = entry->inode->main;
+            if (!TXN_TAGGED(main_node))
+            {
+                // The inode changed since it was read.
+                CAS(&(desc->status), TXN_UNDECIDED, TXN_FAILED);
+                break;
+            }
+            txn_help(entry->inode, main_node, thread_args);
+        }
+    }
+    CAS(&(desc->status), TXN_UNDECIDED, TXN_SUCCEEDED);
+    for (i = 0; i < desc->num_of_entries; i++)
+    {
+        txn_resolve(desc, desc->entries[i].inode, tagged);
+    }
+
+    if (desc->status == TXN_SUCCEEDED)
+    {
+        txn_retire(txn, thread_args);
+        add_to_free_list(thread_args, desc);
+        return OK;
+    }
+    txn_discard(txn);
+    add_to_free_list(thread_args, desc);
+    return CONTENDED;
+
+CLEANUP:
+    txn_discard(txn);
+    return FAILED;
+}
+
+/**
+ * Retires the nodes a successful transaction replaced: the old main nodes, their replaced branches and unlinked INodes.
+ * @param txn: the transaction.
+ * @param thread_args: the thread arguments.
+ **/
+static void txn_retire(txn_t* txn, thread_args_t* thread_args)
+{
+    lnode_t* ptr = NULL;
+    lnode_t* tmp = NULL;
+    int i   = 0;
+    int pos = 0;
+    for (i = 0; i < txn->num_of_targets; i++)
+    {
+        main_node_t* old_main_node = txn->targets[i].old;
+        if (txn->targets[i].new == old_main_node)
+        {
+            continue;
+        }
+        if (old_main_node->type == LNODE)
+        {
+            old_main_node->node.lnode.marked = 1;
+            for (ptr = old_main_node->node.lnode.next; ptr != NULL; ptr = ptr->next)
+            {
+                ptr->marked = 1;
+            }
+        }
+        else
+        {
+            old_main_node->node.cnode.marked = 1;
+        }
+    }
+    FENCE;
+    for (i = 0; i < txn->num_of_targets; i++)
+    {
+        txn_target_t*   target          = &(txn->targets[i]);
+        main_node_t*    old_main_node   = target->old;
+        if (target->new == old_main_node)
+        {
+            continue;
+        }
+        if (old_main_node->type == LNODE)
+        {
+            for (ptr = old_main_node->node.lnode.next; ptr != NULL; ptr = tmp)
+            {
+                tmp = ptr->next;
+                add_to_free_list(thread_args, ptr);
+            }
+        }
+        else
+        {
+            for (pos = 0; pos < MAX_BRANCHES; pos++)
+            {
+                if ((target->changed & old_main_node->node.cnode.bmp) & (1 << pos))
+                {
+                    add_to_free_list(thread_args, old_main_node->node.cnode.array[pos]);
+                }
+            }
+        }
+        if (target->entombed != NULL)
+        {
+            add_to_free_list(thread_args, target->entombed);
+        }
+        if (target->unlink)
+        {
+            add_to_free_list(thread_args, target->new);
+        }
+        add_to_free_list(thread_args, old_main_node);
+    }
+}
+
+/**
+ * Frees the nodes a transaction created, after it failed or before it was committed (they were never reachable).
+ * @param txn: the transaction.
+ **/
+static void txn_discard(txn_t* txn)
+{
+    int i   = 0;
+    int pos = 0;
+    for (i = 0; i < txn->num_of_targets; i++)
+    {
+        txn_target_t* target = &(txn->targets[i]);
+        if (target->new == target->old)
+        {
+            continue;
+        }
+        if (target->new->type == LNODE)
+        {
+            main_node_free(target->new);
+            continue;
+        }
+        for (pos = 0; pos < MAX_BRANCHES; pos++)
+        {
+            if (target->changed & (1 << pos))
+            {
+                branch_free(target->built[pos]);
+            }
+        }
+        free(target->new);
+    }
+}
+
+/**
+ * Allocates the lookup cache of a ctrie configured with one.
+ * @param ctrie: the new ctrie.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int lookup_cache_create(ctrie_t* ctrie)
+{
+    if (ctrie->config.lookup_cache_bits == 0)
+    {
+        return OK;
+    }
+    ctrie->lookup_cache = calloc(1 << ctrie->config.lookup_cache_bits, sizeof(inode_t*));
+    if (ctrie->lookup_cache == NULL)
+    {
+        FAIL("Failed to allocate a lookup cache of %d entries", 1 << ctrie->config.lookup_cache_bits);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Caches the INode an operation has just descended into, if it's at the cache's level.
+ * @param ctrie: the ctrie.
+ * @param key: the operation's key.
+ * @param path: the operation's path, its current INode is protected by the path hazard pointer.
+ **/
+static void lookup_cache_fill(ctrie_t* ctrie, int key, path_t* path)
+{
+    int      lev    = ctrie->config.lookup_cache_bits;
+    inode_t* inode  = path->inodes[path->depth];
+    uint32_t slot   = 0;
+    if (ctrie->lookup_cache == NULL || path->depth != LEV_DEPTH(lev))
+    {
+        return;
+    }
+    slot = ctrie_hash(key) & ((1 << lev) - 1);
+    if (ctrie->lookup_cache[slot] == inode)
+    {
+        return;
+    }
+    ctrie->lookup_cache[slot] = inode;
+    FENCE;
+    // The INode may have been unlinked since we passed it, and compress may have already removed it from the cache.
+    if (inode->marked)
+    {
+        CAS(&(ctrie->lookup_cache[slot]), inode, NULL);
+    }
+}
+
+/**
+ * Removes an INode which was unlinked (and marked) from the lookup cache, before it is retired.
+ * @param ctrie: the ctrie.
+ * @param inode: the INode, its main node is a TNode.
+ * @param lev: the INode's hash level.
+ **/
+static void lookup_cache_invalidate(ctrie_t* ctrie, inode_t* inode, int lev)
+{
+    uint32_t slot = 0;
+    if (ctrie->lookup_cache == NULL || lev != ctrie->config.lookup_cache_bits)
+    {
+        return;
+    }
+    // Any key of the INode's subtree has its prefix.
+    slot = ctrie_hash(inode->main->node.tnode.snode.key) & ((1 << lev) - 1);
+    CAS(&(ctrie->lookup_cache[slot]), inode, NULL);
+}
+
+/**
+ * Accounts for added or removed entries of a capacity bounded ctrie.
+ * The changes are batched per thread, so the shared size is updated only once every CACHE_SIZE_BATCH changes.
+ * @param ctrie: the ctrie.
+ * @param delta: the change in the number of entries.
+ * @param thread_args: the thread arguments.
+ **/
+static void cache_account(ctrie_t* ctrie, int delta, thread_args_t* thread_args)
+{
+    eviction_t* eviction = &(thread_args->eviction);
+    eviction->size_delta += delta;
+    if (eviction->size_delta >= CACHE_SIZE_BATCH || eviction->size_delta <= -CACHE_SIZE_BATCH)
+    {
+        __sync_fetch_and_add(&(ctrie->size), eviction->size_delta);
+        eviction->size_delta = 0;
+    }
+}
+
+/**
+ * Checks whether a capacity bounded ctrie holds more entries than its capacity.
+ * @param ctrie: the ctrie.
+ * @param thread_args: the thread arguments.
+ * @return 1 if the ctrie is (approximately) over capacity, otherwise 0.
+ **/
+static int cache_over_capacity(ctrie_t* ctrie, thread_args_t* thread_args)
+{
+    return ctrie->size + thread_args->eviction.size_delta > (int64_t) ctrie->config.capacity;
+}
+
+/**
+ * Gives a sampled snode a second chance if it was referenced since the last time it was sampled (CLOCK policy).
+ * @param snode: the sampled snode, must be protected by a hazard pointer.
+ * @param key: an out parameter that is set to the snode's key if it should be evicted.
+ * @param thread_args: the thread arguments.
+ * @return OK if the snode should be evicted, otherwise RESTART.
+ **/
+static int second_chance(snode_t* snode, int* key, thread_args_t* thread_args)
+{
+    if (snode->referenced)
+    {
+        snode->referenced = 0;
+        thread_args->eviction.second_chances++;
+        return RESTART;
+    }
+    *key = snode->key;
+    return OK;
+}
+
+/**
+ * Samples an eviction victim by descending from the root through random branches, with the same hazard pointers as a lookup.
+ * @param ctrie: the ctrie.
+ * @param key: an out parameter that is set to the victim's key.
+ * @param thread_args: the thread arguments.
+ * @return OK if a victim was found, NOTFOUND if the sampled subtree is empty, or RESTART if a race occurred or the sampled snode got a second chance.
+ **/
+static int sample_victim(ctrie_t* ctrie, int* key, thread_args_t* thread_args)
+{
+    eviction_t* eviction    = &(thread_args->eviction);
+    inode_t*    inode       = ctrie->inode;
+    int         lev         = 0;
+
+    if (eviction->seed == 0)
+    {
+        // Knuth's multiplicative hash, so every thread samples a different (non zero) sequence.
+        eviction->seed = 2654435761u * (uint32_t) (thread_args->index + 1);
+    }
+    if (WIDE_DEPTH(ctrie) > 0)
+    {
+        // The levels above the wide root are full, so a random INode of the wide root is as good as descending to it.
+        lev     = ctrie->config.root_bits;
+        inode   = ctrie->wide_root[WIDE_DEPTH(ctrie)][xorshift32(&(eviction->seed)) & ((1 << lev) - 1)];
+    }
+    while (1)
+    {
+        main_node_t* main_node = inode->main;
+        if (TXN_TAGGED(main_node))
+        {
+            return RESTART;
+        }
+        PLACE_HP(thread_args, main_node);
+        if (inode->marked || inode->main != main_node)
+        {
+            return RESTART;
+        }
+        switch (main_node->type)
+        {
+        case CNODE:
+        {
+            uint32_t bmp    = main_node->node.cnode.bmp;
+            uint32_t shift  = xorshift32(&(eviction->seed)) & 0x1f;
+            if (bmp == 0)
+            {
+                return NOTFOUND;
+            }
+            // The first set bit at or after a random position, wrapping around.
+            bmp = shift == 0 ? bmp : (bmp >> shift) | (bmp << (MAX_BRANCHES - shift));
+            int pos = (__builtin_ctz(bmp) + shift) & 0x1f;
+            branch_t* branch = main_node->node.cnode.array[pos];
+            PLACE_PATH_HP(thread_args, LEV_DEPTH(lev) + 1, branch);
+            if (main_node->node.cnode.marked || main_node->node.cnode.array[pos] != branch)
+            {
+                return RESTART;
+            }
+            if (branch->type == SNODE)
+            {
+                return second_chance(&(branch->node.snode), key, thread_args);
+            }
+            inode = &(branch->node.inode);
+            lev  += W;
+            break;
+        }
+        case LNODE:
+            return second_chance(&(main_node->node.lnode.snode), key, thread_args);
+        case TNODE:
+            // A tomb is left behind by removing from an LNode of two entries, with colliding keys most leaves are tombs.
+            // Its key is still in the ctrie, and removing it cleans the tomb up on the way.
+            return second_chance(&(main_node->node.tnode.snode), key, thread_args);
+        default:
+            return RESTART;
+        }
+    }
+}
+
+/**
+ * Evicts entries from a capacity bounded ctrie until it is back within its capacity.
+ * Runs incrementally on the inserting thread: at most CACHE_EVICTIONS_PER_INSERT entries are evicted out of at most
+ * CACHE_EVICTION_SAMPLES sampled ones. Victims are removed with internal_remove, so eviction is lock-free too.
+ * @param ctrie: the ctrie.
+ * @param thread_args: the thread arguments.
+ **/
+static void evict(ctrie_t* ctrie, thread_args_t* thread_args)
+{
+    int samples = 0;
+    int evicted = 0;
+    int key     = 0;
+    int value   = 0;
+    for (samples = 0; samples < CACHE_EVICTION_SAMPLES && evicted < CACHE_EVICTIONS_PER_INSERT; samples++)
+    {
+        if (!cache_over_capacity(ctrie, thread_args))
+        {
+            break;
+        }
+        if (sample_victim(ctrie, &key, thread_args) != OK)
+        {
+            continue;
+        }
+        // The victim may already be gone (or replaced), then it simply isn't counted.
+        if (internal_remove(ctrie, key, &value, thread_args) == OK)
+        {
+            DEBUG("evicted key %d", key);
+            cache_account(ctrie, -1, thread_args);
+            thread_args->eviction.evictions++;
+            evicted++;
+        }
+    }
+}
+
+/**
+ * Counts the entries of an INode, and compresses its CNode if it has tombstones or a single entry.
+ * @param ctrie: the ctrie.
+ * @param inode: the INode, protected with HP (or fixed).
+ * @param depth: the INode's depth.
+ * @param thread_args: the thread arguments.
+ * @param stats: the compaction's statistics.
+ **/
+static void compact_inode(ctrie_t* ctrie, inode_t* inode, int depth, thread_args_t* thread_args, compaction_stats_t* stats)
+{
+    main_node_t* main_node  = inode->main;
+    int          needed     = 0;
+    int          i          = 0;
+    if (TXN_TAGGED(main_node))
+    {
+        // A transaction is committing into the INode, the next pass gets to it.
+        return;
+    }
+    PLACE_HP(thread_args, main_node);
+    if (inode->marked || inode->main != main_node)
+    {
+        return;
+    }
+    if (main_node->type == TNODE)
+    {
+        stats->entries++;
+        stats->depth_sum += depth + 1;
+        return;
+    }
+    if (main_node->type == LNODE)
+    {
+        lnode_t* lnode = &(main_node->node.lnode);
+        while (lnode != NULL)
+        {
+            stats->entries++;
+            stats->depth_sum += depth + 1;
+            PLACE_LIST_HP(thread_args, lnode->next);
+            if (lnode->marked)
+            {
+                return;
+            }
+            lnode = lnode->next;
+        }
+        return;
+    }
+    cnode_t* cnode = &(main_node->node.cnode);
+    stats->cnodes++;
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        if (!(cnode->bmp & (1 << i)))
+        {
+            continue;
+        }
+        branch_t* branch = cnode->array[i];
+        PLACE_TMP_HP(thread_args, branch);
+        if (cnode->marked || cnode->array[i] != branch)
+        {
+            return;
+        }
+        if (branch->type == SNODE)
+        {
+            stats->entries++;
+            stats->depth_sum += depth + 1;
+            // A single entry below the wide root is entombed, to be lifted into the parent.
+            needed |= !inode->fixed && cnode->length == 1;
+            continue;
+        }
+        inode_t*     child      = &(branch->node.inode);
+        main_node_t* child_main = child->main;
+        if (TXN_TAGGED(child_main))
+        {
+            continue;
+        }
+        PLACE_TMP_HP(thread_args, child_main);
+        if (child->marked || child->main != child_main)
+        {
+            continue;
+        }
+        needed |= child_main->type == TNODE;
+    }
+    if (needed)
+    {
+        compress(ctrie, inode, main_node, DEPTH_LEV(depth), stats, thread_args);
+    }
+}
+
+/**
+ * Compacts the subtree of an INode bottom-up, so a chain of single-entry CNodes collapses in one pass.
+ * @param ctrie: the ctrie.
+ * @param inode: the INode, protected with the path hazard pointer of its depth.
+ * @param depth: the INode's depth.
+ * @param thread_args: the thread arguments.
+ * @param stats: the compaction's statistics.
+ **/
+static void compact_subtree(ctrie_t* ctrie, inode_t* inode, int depth, thread_args_t* thread_args, compaction_stats_t* stats)
+{
+    int pos = 0;
+    while (pos < MAX_BRANCHES)
+    {
+        main_node_t* main_node = inode->main;
+        if (TXN_TAGGED(main_node))
+        {
+            break;
+        }
+        PLACE_HP(thread_args, main_node);
+        if (inode->marked)
+        {
+            return;
+        }
+        if (inode->main != main_node)
+        {
+            continue;
+        }
+        if (main_node->type != CNODE)
+        {
+            break;
+        }
+        // The CNode is read again for every position, the children's compaction replaces the HP protecting it.
+        cnode_t* cnode = &(main_node->node.cnode);
+        if (cnode->bmp & (1 << pos))
+        {
+            branch_t* branch = cnode->array[pos];
+            PLACE_PATH_HP(thread_args, depth + 1, branch);
+            if (cnode->marked || cnode->array[pos] != branch)
+            {
+                continue;
+            }
+            if (branch->type == INODE)
+            {
+                compact_subtree(ctrie, &(branch->node.inode), depth + 1, thread_args, stats);
+            }
+        }
+        pos++;
+    }
+    compact_inode(ctrie, inode, depth, thread_args, stats);
+}
+
+/**
+ * Compacts the subtree of a chunk, and then the INodes above it whose last chunk it is.
+ * A chunk's number holds the position at depth 0 in its highest bits, so the chunks below an INode are consecutive.
+ * @param ctrie: the ctrie.
+ * @param chunk: the chunk, below COMPACTION_CHUNKS.
+ * @param thread_args: the thread arguments.
+ * @param stats: the compaction's statistics.
+ **/
+static void compact_chunk(ctrie_t* ctrie, uint32_t chunk, thread_args_t* thread_args, compaction_stats_t* stats)
+{
+    inode_t* inodes[COMPACTION_CHUNK_DEPTH + 1] = {ctrie->inode};
+    int      depth = 0;
+    for (depth = 0; depth < COMPACTION_CHUNK_DEPTH; depth++)
+    {
+        inode_t*     inode      = inodes[depth];
+        main_node_t* main_node  = inode->main;
+        int          pos        = (chunk >> DEPTH_LEV(COMPACTION_CHUNK_DEPTH - 1 - depth)) & (MAX_BRANCHES - 1);
+        if (TXN_TAGGED(main_node))
+        {
+            break;
+        }
+        PLACE_HP(thread_args, main_node);
+        if (inode->marked || inode->main != main_node || main_node->type != CNODE)
+        {
+            break;
+        }
+        cnode_t* cnode = &(main_node->node.cnode);
+        if (!(cnode->bmp & (1 << pos)))
+        {
+            break;
+        }
+        branch_t* branch = cnode->array[pos];
+        PLACE_PATH_HP(thread_args, depth + 1, branch);
+        if (cnode->marked || cnode->array[pos] != branch || branch->type != INODE)
+        {
+            break;
+        }
+        inodes[depth + 1] = &(branch->node.inode);
+    }
+    if (depth == COMPACTION_CHUNK_DEPTH)
+    {
+        compact_subtree(ctrie, inodes[depth], depth, thread_args, stats);
+        depth--;
+    }
+    // Bottom-up, so what the deeper INodes entombed is resurrected by the INodes above within the pass.
+    for (; depth >= 0; depth--)
+    {
+        uint32_t below = (1U << DEPTH_LEV(COMPACTION_CHUNK_DEPTH - depth)) - 1;
+        if ((chunk & below) != below)
+        {
+            break;
+        }
+        compact_inode(ctrie, inodes[depth], depth, thread_args, stats);
+    }
+}
+
+/**
+ * Compacts the ctrie incrementally: resurrects the tombstones which removals leave behind, and collapses single-entry
+ * CNodes into their parents. Operations only do that for the INodes they happen to pass by.
+ * Every chunk is compacted within one operation, so a checkpoint waits for one chunk at most.
+ * @param ctrie: the ctrie, a readonly ctrie is left as is.
+ * @param cursor: the next chunk, advanced past the compacted chunks. A pass is done whenever it wraps around to 0.
+ * @param num_of_chunks: the number of chunks to compact, COMPACTION_CHUNKS is a whole pass.
+ * @param thread_args: the thread arguments.
+ * @param stats: accumulates the compaction's statistics.
+ **/
+void ctrie_compact(ctrie_t* ctrie, uint32_t* cursor, uint32_t num_of_chunks, thread_args_t* thread_args,
+                   compaction_stats_t* stats)
+{
+    uint32_t i = 0;
+    if (ctrie->readonly)
+    {
+        return;
+    }
+    for (i = 0; i < num_of_chunks; i++)
+    {
+        op_enter(ctrie, thread_args);
+        compact_chunk(ctrie, *cursor, thread_args, stats);
+        op_exit(thread_args);
+        *cursor = (*cursor + 1) % COMPACTION_CHUNKS;
+        if (*cursor == 0)
+        {
+            stats->passes++;
+        }
+    }
+    release_hazard_pointers(thread_args->hp_lists[thread_args->index]);
+}
+
+/**
+ * Announces that the thread starts an operation, and records the checkpoint state the operation runs under.
+ * Operations never wait for a checkpoint, a starting checkpoint waits for the operations of the previous generation.
+ * @param ctrie: the ctrie.
+ * @param thread_args: the thread arguments.
+ **/
+static void op_enter(ctrie_t* ctrie, thread_args_t* thread_args)
+{
+    hp_list_t* hp_list = thread_args->hp_lists[thread_args->index];
+    // No fence orders the announcement before the generation is read, the starting checkpoint issues the barrier of
+    // all the threads instead (see checkpoint_begin). The generation is read before the checkpoint state it is set after.
+    hp_list->in_op              = 1;
+    thread_args->op_gen         = ctrie->gen;
+    thread_args->checkpointing  = ctrie->checkpointing;
+    hp_list->op_gen             = thread_args->op_gen;
+    if (!thread_args->checkpointing && thread_args->free_list->num_of_deferred > 0)
+    {
+        release_deferred(thread_args);
+    }
+}
+
+/**
+ * Announces that the thread finished its operation.
+ * @param thread_args: the thread arguments.
+ **/
+static void op_exit(thread_args_t* thread_args)
+{
+    __sync_lock_release(&(thread_args->hp_lists[thread_args->index]->in_op));
+}
+
+/**
+ * Marks the INodes of a changed path with the operation's generation, so incremental checkpoints find the changed subtrees.
+ * @param path: the path of the operation, from the root to the changed INode.
+ * @param thread_args: the thread arguments.
+ **/
+static void mark_dirty(path_t* path, thread_args_t* thread_args)
+{
+    int depth = 0;
+    // A path which started at a cached INode started at a dirty one, whose ancestors are dirty as well.
+    for (depth = path->base > path->root ? path->base : 0; depth <= path->depth; depth++)
+    {
+        // Upper levels are usually marked already, so most changes don't write them.
+        if (path->inodes[depth]->dirty != thread_args->op_gen)
+        {
+            path->inodes[depth]->dirty = thread_args->op_gen;
+        }
+    }
+}
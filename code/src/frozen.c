@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "nodes.h"
+#include "common.h"
+#include "ctrie.h"
+#include "frozen.h"
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int          frozen_lookup(frozen_ctrie_t* frozen, int key);
+static void         frozen_free  (frozen_ctrie_t* frozen);
+
+static main_node_t* skip_chain   (main_node_t* main_node, uint32_t* lev);
+static void         count_cnode  (main_node_t* main_node, uint32_t lev, uint32_t* num_of_cnodes, uint32_t* num_of_entries);
+static uint32_t     freeze_cnode (frozen_ctrie_t* frozen, main_node_t* main_node, uint32_t lev);
+static void         freeze_lnode (frozen_ctrie_t* frozen, lnode_t* lnode, frozen_child_t* child);
+
+static int          any_key      (frozen_ctrie_t* frozen, uint32_t index);
+static int          thaw_cnode   (frozen_ctrie_t* frozen, main_node_t* main_node, uint32_t index, uint32_t lev);
+static int          thaw_lnode   (frozen_ctrie_t* frozen, main_node_t* main_node, frozen_child_t* child);
+
+/**
+ * Skips a chain of CNodes which have a single INode child pointing to another CNode.
+ * Such chains carry no information for lookups, since leaves hold the full key anyway.
+ * @param main_node: main node which contains the first cnode of the chain.
+ * @param lev: in-out parameter, the hash level of `main_node`, updated to the level of the returned main node.
+ * @return the main node of the last cnode in the chain.
+ **/
+static main_node_t* skip_chain(main_node_t* main_node, uint32_t* lev)
+{
+    while (main_node->node.cnode.length == 1)
+    {
+        branch_t* branch = main_node->node.cnode.array[highest_on_bit(main_node->node.cnode.bmp)];
+        if (branch->type != INODE || branch->node.inode.main->type != CNODE)
+        {
+            break;
+        }
+        main_node = branch->node.inode.main;
+        *lev += W;
+    }
+    return main_node;
+}
+
+/**
+ * Counts the frozen cnodes and entries needed for the subtree of `main_node`.
+ * @param main_node: main node which contains a cnode.
+ * @param lev: hash level.
+ * @param num_of_cnodes: an out parameter which is increased by the number of needed cnodes.
+ * @param num_of_entries: an out parameter which is increased by the number of needed entries.
+ **/
+static void count_cnode(main_node_t* main_node, uint32_t lev, uint32_t* num_of_cnodes, uint32_t* num_of_entries)
+{
+    main_node = skip_chain(main_node, &lev);
+    cnode_t* cnode = &(main_node->node.cnode);
+    lnode_t* lnode = NULL;
+    int i = 0;
+
+    *num_of_cnodes  += 1;
+    *num_of_entries += __builtin_popcount(cnode->bmp);
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        if ((cnode->bmp & (1 << i)) == 0 || cnode->array[i]->type != INODE)
+        {
+            continue;
+        }
+        main_node_t* child = cnode->array[i]->node.inode.main;
+        switch (child->type)
+        {
+        case CNODE:
+            count_cnode(child, lev + W, num_of_cnodes, num_of_entries);
+            break;
+        case LNODE:
+            for (lnode = &(child->node.lnode); lnode != NULL; lnode = lnode->next)
+            {
+                (*num_of_entries)++;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * Appends the lnode-list beginning with `lnode` to the frozen entries.
+ * @param frozen: the frozen ctrie being built.
+ * @param lnode: lnode-list to freeze.
+ * @param child: an out parameter, set to the appended entries range.
+ **/
+static void freeze_lnode(frozen_ctrie_t* frozen, lnode_t* lnode, frozen_child_t* child)
+{
+    child->index  = frozen->num_of_entries;
+    child->length = 0;
+    for (; lnode != NULL; lnode = lnode->next)
+    {
+        frozen->entries[frozen->num_of_entries].snode = (frozen_snode_t) { .key = lnode->snode.key, .value = lnode->snode.value };
+        frozen->num_of_entries++;
+        child->length++;
+    }
+}
+
+/**
+ * Freezes the subtree of `main_node` in depth-first order.
+ * @param frozen: the frozen ctrie being built, its arrays must be large enough (see count_cnode).
+ * @param main_node: main node which contains a cnode.
+ * @param lev: hash level.
+ * @return the index of the frozen cnode.
+ **/
+static uint32_t freeze_cnode(frozen_ctrie_t* frozen, main_node_t* main_node, uint32_t lev)
+{
+    main_node = skip_chain(main_node, &lev);
+    cnode_t*        cnode   = &(main_node->node.cnode);
+    uint32_t        index   = frozen->num_of_cnodes;
+    frozen_cnode_t* fcnode  = &(frozen->cnodes[index]);
+    uint32_t        entry   = frozen->num_of_entries;
+    int i = 0;
+
+    frozen->num_of_cnodes++;
+    fcnode->bmp     = cnode->bmp;
+    fcnode->inner   = 0;
+    fcnode->first   = entry;
+    fcnode->lev     = lev;
+    // Reserve the children block before descending, so the children stay consecutive.
+    frozen->num_of_entries += __builtin_popcount(cnode->bmp);
+
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        if ((cnode->bmp & (1 << i)) == 0)
+        {
+            continue;
+        }
+        branch_t*       branch  = cnode->array[i];
+        frozen_entry_t* fentry  = &(frozen->entries[entry]);
+        entry++;
+        if (branch->type == SNODE)
+        {
+            fentry->snode = (frozen_snode_t) { .key = branch->node.snode.key, .value = branch->node.snode.value };
+            continue;
+        }
+        main_node_t* child = branch->node.inode.main;
+        switch (child->type)
+        {
+        case TNODE:
+            // A tomb is logically an snode of its parent.
+            fentry->snode = (frozen_snode_t) { .key = child->node.tnode.snode.key, .value = child->node.tnode.snode.value };
+            break;
+        case LNODE:
+            fcnode->inner |= 1 << i;
+            freeze_lnode(frozen, &(child->node.lnode), &(fentry->child));
+            break;
+        case CNODE:
+            fcnode->inner |= 1 << i;
+            fentry->child = (frozen_child_t) { .index = freeze_cnode(frozen, child, lev + W), .length = 0 };
+            break;
+        default:
+            break;
+        }
+    }
+    return index;
+}
+
+/**
+ * Creates an empty frozen ctrie instance, its nodes should be set by the caller.
+ * @return On success the frozen ctrie is returned, otherwise NULL is returned.
+ **/
+frozen_ctrie_t* create_frozen_ctrie()
+{
+    frozen_ctrie_t* frozen = NULL;
+    MALLOC(frozen, frozen_ctrie_t);
+    frozen->lookup  = frozen_lookup;
+    frozen->free    = frozen_free;
+    return frozen;
+
+CLEANUP:
+    return NULL;
+}
+
+/**
+ * Converts `ctrie` into an immutable, flattened ctrie.
+ * The cnodes are laid out in depth-first order, and the children of every cnode are consecutive entries.
+ * @param ctrie: the ctrie to freeze, it is marked as readonly so it will keep matching the frozen ctrie.
+ * @return On success the frozen ctrie is returned, otherwise NULL is returned.
+ * @note not thread-safe, the ctrie must be quiescent.
+ **/
+frozen_ctrie_t* ctrie_freeze(ctrie_t* ctrie)
+{
+    frozen_ctrie_t* frozen          = NULL;
+    uint32_t        num_of_cnodes   = 0;
+    uint32_t        num_of_entries  = 0;
+
+    ctrie->readonly = 1;
+    frozen = create_frozen_ctrie();
+    if (frozen == NULL)
+    {
+        FAIL("Failed to create frozen ctrie");
+    }
+
+    count_cnode(ctrie->inode->main, 0, &num_of_cnodes, &num_of_entries);
+    frozen->cnodes = malloc(num_of_cnodes * sizeof(frozen_cnode_t));
+    if (frozen->cnodes == NULL)
+    {
+        FAIL("Failed to allocate %d frozen cnodes", num_of_cnodes);
+    }
+    // An empty trie still needs a valid (even if zero-sized) entries array.
+    frozen->entries = malloc((num_of_entries + 1) * sizeof(frozen_entry_t));
+    if (frozen->entries == NULL)
+    {
+        FAIL("Failed to allocate %d frozen entries", num_of_entries);
+    }
+
+    freeze_cnode(frozen, ctrie->inode->main, 0);
+    DEBUG("froze ctrie %p: %d cnodes %d entries", ctrie, frozen->num_of_cnodes, frozen->num_of_entries);
+    return frozen;
+
+CLEANUP:
+    frozen_free(frozen);
+    return NULL;
+}
+
+/**
+ * Searches for `key` in the frozen ctrie.
+ * @param frozen: the frozen ctrie.
+ * @param key: the key to be searched for.
+ * @return If `key` is found, its value is returned, otherwise NOTFOUND is returned.
+ * @note thread-safe, no hazard pointers are needed since the frozen ctrie never changes.
+ **/
+static int frozen_lookup(frozen_ctrie_t* frozen, int key)
+{
+    int             hash    = ctrie_hash(key);
+    frozen_cnode_t* cnode   = &(frozen->cnodes[FROZEN_ROOT]);
+    uint32_t        i       = 0;
+
+    while (1)
+    {
+        uint32_t flag = 1 << ((hash >> cnode->lev) & 0x1f);
+        if ((cnode->bmp & flag) == 0)
+        {
+            return NOTFOUND;
+        }
+        frozen_entry_t* entry = &(frozen->entries[cnode->first + __builtin_popcount(cnode->bmp & (flag - 1))]);
+        if ((cnode->inner & flag) == 0)
+        {
+            return entry->snode.key == key ? entry->snode.value : NOTFOUND;
+        }
+        if (entry->child.length == 0)
+        {
+            cnode = &(frozen->cnodes[entry->child.index]);
+            continue;
+        }
+        for (i = 0; i < entry->child.length; i++)
+        {
+            frozen_snode_t* snode = &(frozen->entries[entry->child.index + i].snode);
+            if (snode->key == key)
+            {
+                return snode->value;
+            }
+        }
+        return NOTFOUND;
+    }
+}
+
+/**
+ * Frees the frozen ctrie.
+ * @param frozen: frozen ctrie pointer to be freed.
+ * @note not thread-safe.
+ **/
+static void frozen_free(frozen_ctrie_t* frozen)
+{
+    if (frozen == NULL)
+    {
+        return;
+    }
+    if (frozen->mapping != NULL)
+    {
+        munmap(frozen->mapping, frozen->mapping_size);
+        free(frozen);
+        return;
+    }
+    free_them_all(3, frozen->cnodes, frozen->entries, frozen);
+}
+
+/**
+ * Finds some key in the subtree of a frozen cnode, all its keys share the hash bits of the skipped levels above it.
+ * @param frozen: the frozen ctrie.
+ * @param index: the frozen cnode index.
+ * @return a key of the subtree.
+ **/
+static int any_key(frozen_ctrie_t* frozen, uint32_t index)
+{
+    while (1)
+    {
+        frozen_cnode_t* cnode = &(frozen->cnodes[index]);
+        frozen_entry_t* entry = &(frozen->entries[cnode->first]);
+        if ((cnode->inner & cnode->bmp & -cnode->bmp) == 0)
+        {
+            return entry->snode.key;
+        }
+        if (entry->child.length != 0)
+        {
+            return frozen->entries[entry->child.index].snode.key;
+        }
+        index = entry->child.index;
+    }
+}
+
+/**
+ * Rebuilds an lnode-list from a frozen collision list.
+ * @param frozen: the frozen ctrie.
+ * @param main_node: an allocated main node, which becomes the lnode.
+ * @param child: the frozen collision list.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int thaw_lnode(frozen_ctrie_t* frozen, main_node_t* main_node, frozen_child_t* child)
+{
+    lnode_t* lnode = &(main_node->node.lnode);
+    uint32_t i = 0;
+
+    main_node->type = LNODE;
+    for (i = 0; i < child->length; i++)
+    {
+        frozen_snode_t* snode = &(frozen->entries[child->index + i].snode);
+        if (i > 0)
+        {
+            MALLOC(lnode->next, lnode_t);
+            lnode = lnode->next;
+        }
+        lnode->snode = (snode_t) { .key = snode->key, .value = snode->value };
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Rebuilds the subtree of a frozen cnode into `main_node`, including the single-child chains skipped by the freeze.
+ * The main node is linked into the ctrie before its children are added, so on failure the whole ctrie can be freed.
+ * @param frozen: the frozen ctrie.
+ * @param main_node: an allocated (empty cnode) main node, at level `lev`.
+ * @param index: the frozen cnode index.
+ * @param lev: the hash level of `main_node`.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int thaw_cnode(frozen_ctrie_t* frozen, main_node_t* main_node, uint32_t index, uint32_t lev)
+{
+    frozen_cnode_t* fcnode  = &(frozen->cnodes[index]);
+    cnode_t*        cnode   = NULL;
+    branch_t*       branch  = NULL;
+    uint32_t        entry   = fcnode->first;
+    int i = 0;
+
+    // Recreate the skipped chain, one cnode with a single inode per level.
+    for (; lev < fcnode->lev; lev += W)
+    {
+        int pos = (ctrie_hash(any_key(frozen, index)) >> lev) & 0x1f;
+        MALLOC(branch, branch_t);
+        branch->type = INODE;
+        MALLOC(branch->node.inode.main, main_node_t);
+        main_node->type                     = CNODE;
+        main_node->node.cnode.array[pos]    = branch;
+        main_node->node.cnode.bmp           = 1 << pos;
+        main_node->node.cnode.length        = 1;
+        main_node = branch->node.inode.main;
+        branch = NULL;
+    }
+
+    main_node->type = CNODE;
+    cnode = &(main_node->node.cnode);
+    for (i = 0; i < MAX_BRANCHES; i++)
+    {
+        uint32_t flag = 1 << i;
+        if ((fcnode->bmp & flag) == 0)
+        {
+            continue;
+        }
+        frozen_entry_t* fentry = &(frozen->entries[entry]);
+        entry++;
+        MALLOC(branch, branch_t);
+        if ((fcnode->inner & flag) == 0)
+        {
+            branch->type        = SNODE;
+            branch->node.snode  = (snode_t) { .key = fentry->snode.key, .value = fentry->snode.value };
+        }
+        else
+        {
+            branch->type = INODE;
+            MALLOC(branch->node.inode.main, main_node_t);
+        }
+        cnode->array[i] = branch;
+        cnode->bmp     |= flag;
+        cnode->length++;
+        branch = NULL;
+        if ((fcnode->inner & flag) == 0)
+        {
+            continue;
+        }
+        main_node_t* child = cnode->array[i]->node.inode.main;
+        int res = fentry->child.length == 0 ?
+            thaw_cnode(frozen, child, fentry->child.index, lev + W) :
+            thaw_lnode(frozen, child, &(fentry->child));
+        if (res != OK)
+        {
+            return res;
+        }
+    }
+    return OK;
+
+CLEANUP:
+    free(branch);
+    return FAILED;
+}
+
+/**
+ * Converts a frozen ctrie back into a mutable ctrie, by copying all its nodes.
+ * @param frozen: the frozen ctrie, it is left untouched.
+ * @return On success the new ctrie is returned (with the default configuration but a plain root, as the nodes are copied
+ * from the root), otherwise NULL is returned.
+ **/
+ctrie_t* frozen_thaw(frozen_ctrie_t* frozen)
+{
+    ctrie_config_t  config  = ctrie_default_config();
+    ctrie_t*        ctrie   = NULL;
+    uint32_t        i       = 0;
+    uint32_t        j       = 0;
+    config.root_bits = 0;
+    ctrie = create_ctrie_with_config(&config);
+    if (ctrie == NULL)
+    {
+        FAIL("Failed to create ctrie");
+    }
+    if (thaw_cnode(frozen, ctrie->inode->main, FROZEN_ROOT, 0) != OK)
+    {
+        FAIL("Failed to thaw frozen ctrie %p", frozen);
+    }
+    // Count the entries, in case the ctrie's capacity is bounded.
+    for (i = 0; i < frozen->num_of_cnodes; i++)
+    {
+        frozen_cnode_t* cnode = &(frozen->cnodes[i]);
+        frozen_entry_t* entry = &(frozen->entries[cnode->first]);
+        for (j = 0; j < MAX_BRANCHES; j++)
+        {
+            if ((cnode->bmp & (1 << j)) == 0)
+            {
+                continue;
+            }
+            // Positions of child cnodes add 0.
+            ctrie->size += (cnode->inner & (1 << j)) ? entry->child.length : 1;
+            entry++;
+        }
+    }
+    DEBUG("thawed frozen ctrie %p into %p", frozen, ctrie);
+    return ctrie;
+
+CLEANUP:
+    if (ctrie != NULL)
+    {
+        ctrie->free(ctrie);
+    }
+    return NULL;
+}
@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include "hazard_pointer.h"
 #include "common.h"
+#include "trace.h"
 
 void replace_last_hazard_pointer(hp_list_t* hp_list, void* arg)
 {
@@ -45,6 +46,18 @@ void place_list_hazard_pointer(hp_list_t* hp_list, void* arg)
     FENCE;
 }
 
+void place_path_hazard_pointer(hp_list_t* hp_list, int depth, void* arg)
+{
+    hp_list->path_hazard_pointers[depth] = arg;
+    FENCE;
+}
+
+void place_txn_hazard_pointer(hp_list_t* hp_list, int slot, void* arg)
+{
+    hp_list->txn_hazard_pointers[slot] = arg;
+    FENCE;
+}
+
 static int compare(const void* left_pointer, const void* right_pointer)
 {
     void* left = *((void**)left_pointer);
@@ -91,6 +104,16 @@ static void** prepare_hazard_pointers(thread_args_t* thread_args)
             hazard_pointers[j] = thread_args->hp_lists[i]->list_hazard_pointers[k];
             j++;
         }
+        for (k = 0; k < MAX_PATH_HAZARD_POINTERS; k++)
+        {
+            hazard_pointers[j] = thread_args->hp_lists[i]->path_hazard_pointers[k];
+            j++;
+        }
+        for (k = 0; k < MAX_TXN_HAZARD_POINTERS; k++)
+        {
+            hazard_pointers[j] = thread_args->hp_lists[i]->txn_hazard_pointers[k];
+            j++;
+        }
     }
 
     qsort(hazard_pointers, TOTAL_HAZARD_POINTERS(thread_args), sizeof(void*), compare);     
@@ -141,6 +164,7 @@ static int scan(thread_args_t* thread_args)
         thread_args->free_list->free_list[i] = failed_list[i];
     }
     thread_args->free_list->length = failed_length;
+    TRACE(thread_args, TRACE_SCAN, count, failed_length);
     
 CLEANUP:
     if (hazard_pointers != NULL)
@@ -150,18 +174,76 @@ CLEANUP:
     return count;
 }
 
+/**
+ * Keeps a node retired during a checkpoint until the checkpoint is over.
+ * If the deferred list can't grow, the node is leaked rather than freed under the checkpoint's feet.
+ */
+static void defer(free_list_t* free_list, void* arg)
+{
+    if (free_list->num_of_deferred == free_list->deferred_size)
+    {
+        int    size     = free_list->deferred_size == 0 ? FREE_LIST_SIZE : free_list->deferred_size * 2;
+        void** deferred = realloc(free_list->deferred, size * sizeof(void*));
+        if (deferred == NULL)
+        {
+            PERS_PRINT("Failed to defer %p, leaking it", arg);
+            return;
+        }
+        free_list->deferred         = deferred;
+        free_list->deferred_size    = size;
+    }
+    free_list->deferred[free_list->num_of_deferred] = arg;
+    free_list->num_of_deferred++;
+}
+
+/**
+ * Retires the nodes which were deferred during a checkpoint, must be called only once the checkpoint is over.
+ */
+void release_deferred(thread_args_t* thread_args)
+{
+    free_list_t* free_list = thread_args->free_list;
+    int i = 0;
+    // The thread's last operation may have run during the checkpoint, the nodes would be deferred all over again.
+    thread_args->checkpointing = 0;
+    for (i = 0; i < free_list->num_of_deferred; i++)
+    {
+        add_to_free_list(thread_args, free_list->deferred[i]);
+    }
+    free_list->num_of_deferred = 0;
+}
+
 void add_to_free_list(thread_args_t* thread_args, void* arg)
 {
     free_list_t* free_list = thread_args->free_list;
     DEBUG("adding %p to free_list", arg);
+    TRACE(thread_args, TRACE_RETIRE, 0, arg);
+
+    if (thread_args->checkpointing)
+    {
+        defer(free_list, arg);
+        return;
+    }
 
     while ((free_list->length == FREE_LIST_SIZE) && (scan(thread_args) == 0))
     {
         PERS_PRINT("sleeping! free_list length is %d, FREE_LIST_SIZE is %d", free_list->length, FREE_LIST_SIZE);
+        free_list->stalls++;
         sleep(1);
     }
     free_list->free_list[free_list->length] = arg;
     free_list->length++;
+    if (free_list->length > free_list->peak_length)
+    {
+        free_list->peak_length = free_list->length;
+    }
+}
+
+/**
+ * Frees the nodes in the free list which no thread protects, the rest stay in it. Returns the number of freed nodes.
+ */
+int reclaim_free_list(thread_args_t* thread_args)
+{
+    return scan(thread_args);
 }
 
 void release_hazard_pointers(hp_list_t* hp_list)
@@ -175,4 +257,18 @@ void release_hazard_pointers(hp_list_t* hp_list)
     {
         hp_list->list_hazard_pointers[i] = NULL;
     }
+    for (i = 0; i < MAX_PATH_HAZARD_POINTERS; i++)
+    {
+        hp_list->path_hazard_pointers[i] = NULL;
+    }
+    release_txn_hazard_pointers(hp_list);
+}
+
+void release_txn_hazard_pointers(hp_list_t* hp_list)
+{
+    int i = 0;
+    for (i = 0; i < MAX_TXN_HAZARD_POINTERS; i++)
+    {
+        hp_list->txn_hazard_pointers[i] = NULL;
+    }
 }
@@ -0,0 +1,125 @@
+#include "common.h"
+#include "histogram.h"
+
+// How long the ticks are counted against the monotonic clock, to find their length.
+#define CALIBRATION_NSECS           (20000000ULL)
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static uint32_t bucket_index(uint64_t value);
+static uint64_t bucket_upper(uint32_t index);
+
+/**
+ * Finds the length of a tick of READ_TICKS, by counting ticks for CALIBRATION_NSECS (once).
+ * @return the nanoseconds in a tick.
+ **/
+double nsecs_per_tick()
+{
+    static double length = 0.0;
+    if (length == 0.0)
+    {
+        uint64_t start_nsecs = monotonic_nsecs();
+        uint64_t start_ticks = READ_TICKS();
+        uint64_t nsecs       = 0;
+        while ((nsecs = monotonic_nsecs() - start_nsecs) < CALIBRATION_NSECS);
+        length = (double) nsecs / (READ_TICKS() - start_ticks);
+    }
+    return length;
+}
+
+/**
+ * Finds the bucket of a value: small values have a bucket each, bigger ones are bucketed by their
+ * HISTOGRAM_SUB_BITS most significant bits.
+ * @param value: the value.
+ * @return the bucket's index.
+ **/
+static uint32_t bucket_index(uint64_t value)
+{
+    uint32_t shift = 0;
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return value;
+    }
+    shift = 63 - __builtin_clzll(value) - (HISTOGRAM_SUB_BITS - 1);
+    return shift * (HISTOGRAM_SUB_BUCKETS / 2) + (value >> shift);
+}
+
+/**
+ * @param index: a bucket's index.
+ * @return the biggest value in the bucket.
+ **/
+static uint64_t bucket_upper(uint32_t index)
+{
+    uint32_t shift = 0;
+    if (index < HISTOGRAM_SUB_BUCKETS)
+    {
+        return index;
+    }
+    shift = index / (HISTOGRAM_SUB_BUCKETS / 2) - 1;
+    return ((uint64_t) (index - shift * (HISTOGRAM_SUB_BUCKETS / 2) + 1) << shift) - 1;
+}
+
+/**
+ * Counts a value.
+ * @param histogram: the histogram.
+ * @param value: the value.
+ **/
+void histogram_record(histogram_t* histogram, uint64_t value)
+{
+    histogram->buckets[bucket_index(value)]++;
+    histogram->count++;
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+/**
+ * Adds the values counted by `other` to `histogram`.
+ * @param histogram: the histogram.
+ * @param other: the other histogram.
+ **/
+void histogram_merge(histogram_t* histogram, const histogram_t* other)
+{
+    int i = 0;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        histogram->buckets[i] += other->buckets[i];
+    }
+    histogram->count += other->count;
+    if (other->max > histogram->max)
+    {
+        histogram->max = other->max;
+    }
+}
+
+/**
+ * Finds a percentile of the counted values, up to the width of its bucket.
+ * @param histogram: the histogram.
+ * @param percentile: the percentile, in [0, 100].
+ * @return a value that at least `percentile` percent of the values don't exceed, or 0 if the histogram is empty.
+ **/
+uint64_t histogram_percentile(const histogram_t* histogram, double percentile)
+{
+    double   exact   = percentile / 100 * histogram->count;
+    uint64_t rank    = exact;
+    uint64_t counted = 0;
+    int i = 0;
+    // The rank of the percentile, rounded up.
+    if (rank < exact || rank == 0)
+    {
+        rank++;
+    }
+    for (i = 0; i < HISTOGRAM_BUCKETS && histogram->count > 0; i++)
+    {
+        counted += histogram->buckets[i];
+        if (counted >= rank)
+        {
+            uint64_t upper = bucket_upper(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "frozen.h"
+#include "image.h"
+
+#define TMP_SUFFIX          ".tmp"
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static uint64_t header_checksum(const image_header_t* header);
+
+/**
+ * Calculates the checksum of an image header, which covers all its fields but the checksum itself.
+ * @param header: the image header.
+ * @return the header's checksum.
+ **/
+static uint64_t header_checksum(const image_header_t* header)
+{
+    return fnv1a(header, offsetof(image_header_t, header_checksum), FNV_OFFSET_BASIS);
+}
+
+/**
+ * Writes the image of a frozen ctrie to `path`.
+ * The image is written to a temporary file which then replaces `path`, so readers never map a partial image.
+ * @param frozen: the frozen ctrie.
+ * @param path: the image path.
+ * @return OK on success, otherwise FAILED.
+ **/
+int frozen_save(frozen_ctrie_t* frozen, const char* path)
+{
+    FILE*           fp           = NULL;
+    char*           tmp_path     = NULL;
+    size_t          cnodes_size  = frozen->num_of_cnodes * sizeof(frozen_cnode_t);
+    size_t          entries_size = frozen->num_of_entries * sizeof(frozen_entry_t);
+    image_header_t  header       = {
+        .magic          = IMAGE_MAGIC,
+        .version        = IMAGE_VERSION,
+        .num_of_cnodes  = frozen->num_of_cnodes,
+        .num_of_entries = frozen->num_of_entries,
+    };
+
+    header.payload_checksum = fnv1a(frozen->entries, entries_size, fnv1a(frozen->cnodes, cnodes_size, FNV_OFFSET_BASIS));
+    header.header_checksum  = header_checksum(&header);
+
+    tmp_path = malloc(strlen(path) + sizeof(TMP_SUFFIX));
+    if (tmp_path == NULL)
+    {
+        FAIL("Failed to allocate the temporary path of %s", path);
+    }
+    sprintf(tmp_path, "%s%s", path, TMP_SUFFIX);
+    fp = fopen(tmp_path, "wb");
+    if (fp == NULL)
+    {
+        FAIL("Failed to fopen %s (%d)", tmp_path, errno);
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(frozen->cnodes, 1, cnodes_size, fp) != cnodes_size ||
+        fwrite(frozen->entries, 1, entries_size, fp) != entries_size)
+    {
+        FAIL("Failed to write image %s", tmp_path);
+    }
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+    {
+        FAIL("Failed to sync image %s (%d)", tmp_path, errno);
+    }
+    fclose(fp);
+    fp = NULL;
+    if (rename(tmp_path, path) != 0)
+    {
+        FAIL("Failed to rename %s to %s (%d)", tmp_path, path, errno);
+    }
+    DEBUG("saved frozen ctrie %p to %s", frozen, path);
+    free(tmp_path);
+    return OK;
+
+CLEANUP:
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    if (tmp_path != NULL)
+    {
+        unlink(tmp_path);
+        free(tmp_path);
+    }
+    return FAILED;
+}
+
+/**
+ * Writes the image of `ctrie` to `path`.
+ * @param ctrie: the ctrie to save.
+ * @param path: the image path.
+ * @return OK on success, otherwise FAILED.
+ * @note not thread-safe, the ctrie must be quiescent.
+ **/
+int ctrie_save(ctrie_t* ctrie, const char* path)
+{
+    uint8_t         readonly    = ctrie->readonly;
+    frozen_ctrie_t* frozen      = ctrie_freeze(ctrie);
+    int             res         = FAILED;
+
+    // The image is a copy, so the ctrie may keep changing after it is saved.
+    ctrie->readonly = readonly;
+    if (frozen == NULL)
+    {
+        FAIL("Failed to freeze ctrie %p", ctrie);
+    }
+    res = frozen_save(frozen, path);
+    frozen->free(frozen);
+    return res;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Maps the image at `path` read-only, lookups are served straight from the page cache and the pages are shared
+ * by all the processes which map the same image.
+ * Only the header is validated, define IMAGE_VERIFY_PAYLOAD to also verify the payload (which reads the whole image).
+ * @param path: the image path.
+ * @return On success a frozen ctrie backed by the image is returned, otherwise NULL is returned.
+ * @note use frozen_thaw for a mutable copy.
+ **/
+frozen_ctrie_t* ctrie_open_mmap(const char* path)
+{
+    frozen_ctrie_t* frozen  = NULL;
+    image_header_t* header  = NULL;
+    void*           mapping = MAP_FAILED;
+    struct stat     status  = {0};
+    int             fd      = -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        FAIL("Failed to open %s (%d)", path, errno);
+    }
+    if (fstat(fd, &status) < 0)
+    {
+        FAIL("Failed to stat %s (%d)", path, errno);
+    }
+    if ((size_t) status.st_size < sizeof(image_header_t))
+    {
+        FAIL("Image %s is too small: %ld bytes", path, status.st_size);
+    }
+    mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        FAIL("Failed to mmap %s (%d)", path, errno);
+    }
+    // The mapping keeps the file referenced.
+    close(fd);
+    fd = -1;
+
+    header = mapping;
+    if (header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION)
+    {
+        FAIL("Image %s has an unknown format", path);
+    }
+    if (header->header_checksum != header_checksum(header))
+    {
+        FAIL("Image %s has a corrupted header", path);
+    }
+    if (header->num_of_cnodes == 0 || (size_t) status.st_size != sizeof(image_header_t) +
+        (size_t) header->num_of_cnodes * sizeof(frozen_cnode_t) + (size_t) header->num_of_entries * sizeof(frozen_entry_t))
+    {
+        FAIL("Image %s is truncated", path);
+    }
+    frozen = create_frozen_ctrie();
+    if (frozen == NULL)
+    {
+        FAIL("Failed to create frozen ctrie");
+    }
+    frozen->mapping         = mapping;
+    frozen->mapping_size    = status.st_size;
+    frozen->num_of_cnodes   = header->num_of_cnodes;
+    frozen->num_of_entries  = header->num_of_entries;
+    frozen->cnodes          = (frozen_cnode_t*) (header + 1);
+    frozen->entries         = (frozen_entry_t*) (frozen->cnodes + frozen->num_of_cnodes);
+#ifdef IMAGE_VERIFY_PAYLOAD
+    if (header->payload_checksum != fnv1a(frozen->entries, frozen->num_of_entries * sizeof(frozen_entry_t),
+        fnv1a(frozen->cnodes, frozen->num_of_cnodes * sizeof(frozen_cnode_t), FNV_OFFSET_BASIS)))
+    {
+        FAIL("Image %s has a corrupted payload", path);
+    }
+#endif
+    DEBUG("mapped image %s: %d cnodes %d entries", path, frozen->num_of_cnodes, frozen->num_of_entries);
+    return frozen;
+
+CLEANUP:
+    if (frozen != NULL)
+    {
+        frozen->free(frozen);
+    }
+    else if (mapping != MAP_FAILED)
+    {
+        munmap(mapping, status.st_size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return NULL;
+}
@@ -0,0 +1,278 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "input.h"
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int      read_fully  (int fd, void* buffer, size_t size);
+static int      read_chunk  (input_t* input, uint64_t chunk);
+static void*    reader_main (input_t* input);
+
+/**
+ * Reads exactly `size` bytes.
+ * @param fd: the file.
+ * @param buffer: the buffer.
+ * @param size: the number of bytes.
+ * @return OK on success, otherwise FAILED (also if the file ends first).
+ **/
+static int read_fully(int fd, void* buffer, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size)
+    {
+        ssize_t res = read(fd, (char*) buffer + offset, size - offset);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            FAIL("Failed to read %lu bytes (%d)", size - offset, errno);
+        }
+        offset += res;
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Reads a chunk into its slot, once the chunk which used the slot before it was released.
+ * @param input: the streamed input.
+ * @param chunk: the chunk's index.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int read_chunk(input_t* input, uint64_t chunk)
+{
+    input_slot_t* slot      = &(input->slots[chunk % INPUT_RING_CHUNKS]);
+    uint64_t      turn      = chunk / INPUT_RING_CHUNKS;
+    uint64_t      first     = chunk * INPUT_CHUNK_RECORDS;
+    uint64_t      length    = input->num_of_records - first;
+    length = length < INPUT_CHUNK_RECORDS ? length : INPUT_CHUNK_RECORDS;
+
+    while (slot->consumed < turn && !input->stop)
+    {
+        sched_yield();
+    }
+    if (input->stop)
+    {
+        return FAILED;
+    }
+    if (read_fully(input->fd, (char*) slot->data + INPUT_HEADER_SIZE, length * input->record_size) != OK)
+    {
+        FAIL("Failed to read chunk %lu", chunk);
+    }
+    *(int*) slot->data = length;
+    FENCE;
+    slot->filled = turn + 1;
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * The reader thread of a streamed input, stays up to INPUT_RING_CHUNKS chunks ahead of their use.
+ * @param input: the streamed input.
+ * @return NULL.
+ **/
+static void* reader_main(input_t* input)
+{
+    uint64_t chunk = 0;
+    for (chunk = 0; chunk < input->num_of_chunks; chunk++)
+    {
+        if (read_chunk(input, chunk) != OK)
+        {
+            input->failed = 1;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Opens an action file: an int count followed by `count` records of `record_size` bytes.
+ * @param input: the input.
+ * @param path: the file's path.
+ * @param mode: how the file is read.
+ * @param record_size: the size of the file's records.
+ * @return OK on success, otherwise FAILED.
+ **/
+int input_open(input_t* input, const char* path, input_mode_t mode, size_t record_size)
+{
+    struct stat status  = {0};
+    int         count   = 0;
+    int         flags   = MAP_PRIVATE;
+    int i = 0;
+
+    *input = (input_t) { .mode = mode, .fd = -1, .record_size = record_size };
+    input->fd = open(path, O_RDONLY);
+    if (input->fd < 0)
+    {
+        FAIL("Failed to open %s (%d)", path, errno);
+    }
+    if (fstat(input->fd, &status) < 0)
+    {
+        FAIL("Failed to stat file: %s (%d)", path, errno);
+    }
+    input->size = status.st_size;
+    if (read_fully(input->fd, &count, sizeof(count)) != OK || count < 0 ||
+        input->size < INPUT_HEADER_SIZE + (size_t) count * record_size)
+    {
+        FAIL("File %s is truncated", path);
+    }
+    input->num_of_records   = count;
+    input->num_of_chunks    = mode == INPUT_STREAM ? (count + INPUT_CHUNK_RECORDS - 1) / INPUT_CHUNK_RECORDS : 1;
+
+    switch (mode)
+    {
+    case INPUT_READ:
+        input->data = malloc(input->size);
+        if (input->data == NULL)
+        {
+            FAIL("Failed to allocate %lu bytes for data", input->size);
+        }
+        if (pread(input->fd, input->data, input->size, 0) != (ssize_t) input->size)
+        {
+            FAIL("Failed to read %lu bytes from %s", input->size, path);
+        }
+        break;
+    case INPUT_POPULATE:
+        flags |= MAP_POPULATE;
+        // Fall through.
+    case INPUT_MMAP:
+        input->data = mmap(NULL, input->size, PROT_READ, flags, input->fd, 0);
+        if (input->data == MAP_FAILED)
+        {
+            input->data = NULL;
+            FAIL("Failed to mmap %s (%d)", path, errno);
+        }
+        // The threads read their shares front to back.
+        madvise(input->data, input->size, MADV_SEQUENTIAL);
+        break;
+    case INPUT_STREAM:
+        posix_fadvise(input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        for (i = 0; i < INPUT_RING_CHUNKS; i++)
+        {
+            input->slots[i].data = malloc(INPUT_HEADER_SIZE + INPUT_CHUNK_RECORDS * record_size);
+            if (input->slots[i].data == NULL)
+            {
+                FAIL("Failed to allocate chunk %d", i);
+            }
+        }
+        if (pthread_create(&(input->reader), NULL, (void*(*)(void*)) reader_main, input) != 0)
+        {
+            FAIL("Failed to start the reader of %s", path);
+        }
+        input->reading = 1;
+        break;
+    default:
+        FAIL("Unknown input mode %d", mode);
+    }
+    return OK;
+
+CLEANUP:
+    input_close(input);
+    return FAILED;
+}
+
+/**
+ * Returns the next part of the input, laid out like a whole action file: the whole file, or the next chunk of a
+ * streamed one. Must be released before the next call.
+ * @param input: the input.
+ * @return the next part, or NULL when the input is over (or failed).
+ **/
+void* input_next(input_t* input)
+{
+    input_slot_t* slot  = NULL;
+    uint64_t      turn  = 0;
+    int64_t       start = 0;
+
+    if (input->next_chunk >= input->num_of_chunks)
+    {
+        return NULL;
+    }
+    input->in_use = 1;
+    if (input->mode != INPUT_STREAM)
+    {
+        return input->data;
+    }
+    slot  = &(input->slots[input->next_chunk % INPUT_RING_CHUNKS]);
+    turn  = input->next_chunk / INPUT_RING_CHUNKS;
+    start = monotonic_nsecs();
+    while (slot->filled <= turn)
+    {
+        if (input->failed)
+        {
+            input->in_use = 0;
+            return NULL;
+        }
+        sched_yield();
+    }
+    input->wait_time += monotonic_nsecs() - start;
+    FENCE;
+    return slot->data;
+}
+
+/**
+ * Releases the part of the input returned by input_next, a streamed input reuses its slot for a later chunk.
+ * @param input: the input.
+ **/
+void input_release(input_t* input)
+{
+    if (!input->in_use)
+    {
+        return;
+    }
+    if (input->mode == INPUT_STREAM)
+    {
+        FENCE;
+        input->slots[input->next_chunk % INPUT_RING_CHUNKS].consumed = input->next_chunk / INPUT_RING_CHUNKS + 1;
+    }
+    input->in_use = 0;
+    input->next_chunk++;
+}
+
+void input_close(input_t* input)
+{
+    int i = 0;
+    if (input->reading)
+    {
+        input->stop = 1;
+        pthread_join(input->reader, NULL);
+        input->reading = 0;
+    }
+    for (i = 0; i < INPUT_RING_CHUNKS; i++)
+    {
+        free(input->slots[i].data);
+        input->slots[i].data = NULL;
+    }
+    if (input->data != NULL)
+    {
+        if (input->mode == INPUT_READ)
+        {
+            free(input->data);
+        }
+        else
+        {
+            munmap(input->data, input->size);
+        }
+        input->data = NULL;
+    }
+    if (input->fd >= 0)
+    {
+        close(input->fd);
+        input->fd = -1;
+    }
+}
@@ -0,0 +1,249 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes.h"
+#include "common.h"
+#include "ctrie.h"
+#include "inspect.h"
+
+/**
+ * The subtrees of a parallel inspection, the workers take them one at a time.
+ **/
+typedef struct
+{
+    inode_t**           inodes;
+    uint32_t            num_of_inodes;
+    volatile uint32_t   next;
+} frontier_t;
+
+typedef struct
+{
+    frontier_t*     frontier;
+    ctrie_shape_t   shape;
+} inspector_t;
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static void  count_entries (ctrie_shape_t* shape, uint32_t depth, uint64_t count);
+static void  inspect_inode (inode_t* inode, uint32_t depth, ctrie_shape_t* shape, frontier_t* frontier);
+static void* inspector_main(inspector_t* inspector);
+static void  shape_merge   (ctrie_shape_t* shape, const ctrie_shape_t* other);
+
+/**
+ * Accounts for entries found at `depth`.
+ * @param shape: the shape.
+ * @param depth: the entries' depth.
+ * @param count: the number of entries.
+ **/
+static void count_entries(ctrie_shape_t* shape, uint32_t depth, uint64_t count)
+{
+    shape->entries      += count;
+    shape->depth[depth] += count;
+    if (depth > shape->max_depth)
+    {
+        shape->max_depth = depth;
+    }
+}
+
+/**
+ * Accounts for the main node of `inode` and everything below it, the INode itself is accounted for by its parent.
+ * @param inode: the INode.
+ * @param depth: the INode's depth.
+ * @param shape: the shape.
+ * @param frontier: if not NULL, the INodes of depth INSPECT_SPLIT_DEPTH are added to it instead of being inspected.
+ **/
+static void inspect_inode(inode_t* inode, uint32_t depth, ctrie_shape_t* shape, frontier_t* frontier)
+{
+    main_node_t* main_node  = inode->main;
+    cnode_t*     cnode      = NULL;
+    lnode_t*     lnode      = NULL;
+    uint32_t     length     = 0;
+    int i = 0;
+
+    if (frontier != NULL && depth == INSPECT_SPLIT_DEPTH)
+    {
+        frontier->inodes[frontier->num_of_inodes] = inode;
+        frontier->num_of_inodes++;
+        return;
+    }
+    shape->bytes += sizeof(main_node_t);
+    switch (main_node->type)
+    {
+    case CNODE:
+        cnode = &(main_node->node.cnode);
+        shape->nodes[CNODE]++;
+        shape->fanout[cnode->length]++;
+        for (i = 0; i < MAX_BRANCHES; i++)
+        {
+            if ((cnode->bmp & (1 << i)) == 0)
+            {
+                continue;
+            }
+            branch_t* branch = cnode->array[i];
+            shape->nodes[branch->type]++;
+            shape->bytes += sizeof(branch_t);
+            if (branch->type == INODE)
+            {
+                inspect_inode(&(branch->node.inode), depth + 1, shape, frontier);
+            }
+            else
+            {
+                count_entries(shape, depth + 1, 1);
+            }
+        }
+        break;
+    case TNODE:
+        shape->nodes[TNODE]++;
+        count_entries(shape, depth + 1, 1);
+        break;
+    case LNODE:
+        for (lnode = &(main_node->node.lnode); lnode != NULL; lnode = lnode->next)
+        {
+            length++;
+        }
+        // The first LNode is embedded in the main node.
+        shape->bytes            += (length - 1) * sizeof(lnode_t);
+        shape->nodes[LNODE]     += length;
+        shape->chain[length < INSPECT_MAX_CHAIN ? length : INSPECT_MAX_CHAIN]++;
+        if (length > shape->max_chain)
+        {
+            shape->max_chain = length;
+        }
+        count_entries(shape, depth + 1, length);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * The body of a worker thread of a parallel inspection.
+ * @param inspector: the worker.
+ * @return NULL.
+ **/
+static void* inspector_main(inspector_t* inspector)
+{
+    frontier_t* frontier = inspector->frontier;
+    uint32_t    next     = 0;
+    while ((next = __sync_fetch_and_add(&(frontier->next), 1)) < frontier->num_of_inodes)
+    {
+        inspect_inode(frontier->inodes[next], INSPECT_SPLIT_DEPTH, &(inspector->shape), NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Adds the shape of other subtrees to `shape`.
+ * @param shape: the shape.
+ * @param other: the other subtrees' shape.
+ **/
+static void shape_merge(ctrie_shape_t* shape, const ctrie_shape_t* other)
+{
+    int i = 0;
+    for (i = 0; i < NUM_OF_NODE_TYPES; i++)
+    {
+        shape->nodes[i] += other->nodes[i];
+    }
+    for (i = 0; i <= MAX_BRANCHES; i++)
+    {
+        shape->fanout[i] += other->fanout[i];
+    }
+    for (i = 0; i <= MAX_LEVELS; i++)
+    {
+        shape->depth[i] += other->depth[i];
+    }
+    for (i = 0; i <= INSPECT_MAX_CHAIN; i++)
+    {
+        shape->chain[i] += other->chain[i];
+    }
+    shape->entries  += other->entries;
+    shape->bytes    += other->bytes;
+    if (other->max_depth > shape->max_depth)
+    {
+        shape->max_depth = other->max_depth;
+    }
+    if (other->max_chain > shape->max_chain)
+    {
+        shape->max_chain = other->max_chain;
+    }
+}
+
+/**
+ * Describes the structure of the ctrie: how many nodes of every type it has, how full its CNodes are, how deep its
+ * entries are and how long its lnode-lists are. Skewed depths and long lists point at a poorly distributed hash.
+ * With more than one thread, the subtrees at INSPECT_SPLIT_DEPTH are inspected in parallel.
+ * @param ctrie: the ctrie.
+ * @param shape: an out parameter that is set to the ctrie's shape.
+ * @param num_of_threads: the number of threads, including the calling one.
+ * @return OK on success, otherwise FAILED.
+ * @note the ctrie must be quiescent, it is readonly during the inspection.
+ **/
+int ctrie_inspect(ctrie_t* ctrie, ctrie_shape_t* shape, int num_of_threads)
+{
+    frontier_t   frontier   = {0};
+    inspector_t* inspectors = NULL;
+    pthread_t*   tids       = NULL;
+    uint8_t      readonly   = ctrie->readonly;
+    int          res        = FAILED;
+    int          started    = 1;
+    int i = 0;
+
+    memset(shape, 0, sizeof(*shape));
+    shape->nodes[INODE] = 1;
+    shape->bytes        = sizeof(ctrie_t) + sizeof(inode_t);
+    for (i = 1; i <= ctrie->config.root_bits / W; i++)
+    {
+        shape->bytes += (1ULL << (i * W)) * sizeof(inode_t*);
+    }
+    if (ctrie->config.lookup_cache_bits != 0)
+    {
+        shape->bytes += (1ULL << ctrie->config.lookup_cache_bits) * sizeof(inode_t*);
+    }
+
+    ctrie->readonly = 1;
+    if (num_of_threads <= 1)
+    {
+        inspect_inode(ctrie->inode, 0, shape, NULL);
+        res = OK;
+        goto CLEANUP;
+    }
+    frontier.inodes = malloc((1 << (INSPECT_SPLIT_DEPTH * W)) * sizeof(inode_t*));
+    inspectors      = calloc(num_of_threads, sizeof(inspector_t));
+    tids            = calloc(num_of_threads, sizeof(pthread_t));
+    if (frontier.inodes == NULL || inspectors == NULL || tids == NULL)
+    {
+        FAIL("Failed to allocate %d inspectors", num_of_threads);
+    }
+    inspect_inode(ctrie->inode, 0, shape, &frontier);
+    for (i = 0; i < num_of_threads; i++)
+    {
+        inspectors[i].frontier = &frontier;
+    }
+    // The calling thread is the first worker, the others only speed it up.
+    for (started = 1; started < num_of_threads; started++)
+    {
+        if (pthread_create(&(tids[started]), NULL, (void*(*)(void*)) inspector_main, &(inspectors[started])) != 0)
+        {
+            PRINT("Failed to start inspector %d", started);
+            break;
+        }
+    }
+    inspector_main(&(inspectors[0]));
+    for (i = 1; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    for (i = 0; i < started; i++)
+    {
+        shape_merge(shape, &(inspectors[i].shape));
+    }
+    res = OK;
+
+CLEANUP:
+    ctrie->readonly = readonly;
+    free_them_all(3, frontier.inodes, inspectors, tids);
+    return res;
+}
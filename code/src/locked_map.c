@@ -0,0 +1,429 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "baseline.h"
+
+#define CACHE_LINE_SIZE     (64)
+
+typedef struct chain_node_t
+{
+    int                     key;
+    int                     value;
+    struct chain_node_t*    next;
+} chain_node_t;
+
+/**
+ * A chained hash table, its callers lock it.
+ **/
+typedef struct
+{
+    chain_node_t**  buckets;
+    // A power of two, at least BASELINE_STRIPES.
+    uint32_t        num_of_buckets;
+} chain_table_t;
+
+/**
+ * A lock of a striped map and the number of keys in its buckets, on a cache line of its own.
+ **/
+typedef struct
+{
+    pthread_mutex_t lock;
+    int64_t         size;
+} __attribute__((aligned(CACHE_LINE_SIZE))) stripe_t;
+
+typedef struct
+{
+    map_t           map;
+    chain_table_t   table;
+    stripe_t        stripes[BASELINE_STRIPES];
+} striped_map_t;
+
+typedef struct
+{
+    map_t               map;
+    chain_table_t       table;
+    pthread_rwlock_t    lock;
+    int64_t             size;
+} rwlock_map_t;
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static uint32_t hash_key        (int key);
+static int      table_init      (chain_table_t* table);
+static int      table_lookup    (chain_table_t* table, int key, uint32_t hash);
+static int      table_insert    (chain_table_t* table, int key, int value, uint32_t hash, uint8_t* added);
+static int      table_remove    (chain_table_t* table, int key, uint32_t hash);
+static void     table_resize    (chain_table_t* table);
+static void     table_free      (chain_table_t* table);
+static int      striped_insert  (map_t* map, int key, int value, thread_args_t* thread_args);
+static int      striped_remove  (map_t* map, int key, thread_args_t* thread_args);
+static int      striped_lookup  (map_t* map, int key, thread_args_t* thread_args);
+static void     striped_resize  (striped_map_t* striped, uint32_t num_of_buckets);
+static int64_t  striped_size    (map_t* map);
+static void     striped_free    (map_t* map);
+static int      rwlock_insert   (map_t* map, int key, int value, thread_args_t* thread_args);
+static int      rwlock_remove   (map_t* map, int key, thread_args_t* thread_args);
+static int      rwlock_lookup   (map_t* map, int key, thread_args_t* thread_args);
+static int64_t  rwlock_size     (map_t* map);
+static void     rwlock_free     (map_t* map);
+
+/**
+ * Mixes the bits of a key (murmur3's finalizer), so consecutive keys spread over the buckets.
+ * @param key: the key.
+ * @return the key's hash.
+ **/
+static uint32_t hash_key(int key)
+{
+    uint32_t hash = key;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static int table_init(chain_table_t* table)
+{
+    table->num_of_buckets   = BASELINE_INITIAL_BUCKETS < BASELINE_STRIPES ? BASELINE_STRIPES : BASELINE_INITIAL_BUCKETS;
+    table->buckets          = calloc(table->num_of_buckets, sizeof(chain_node_t*));
+    if (table->buckets == NULL)
+    {
+        FAIL("Failed to allocate %u buckets", table->num_of_buckets);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+static int table_lookup(chain_table_t* table, int key, uint32_t hash)
+{
+    chain_node_t* node = table->buckets[hash & (table->num_of_buckets - 1)];
+    for (; node != NULL; node = node->next)
+    {
+        if (node->key == key)
+        {
+            return node->value;
+        }
+    }
+    return NOTFOUND;
+}
+
+/**
+ * Sets the value of a key.
+ * @param table: the table.
+ * @param key: the key.
+ * @param value: the value.
+ * @param hash: the key's hash.
+ * @param added: an out parameter that is set to whether the key is new.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int table_insert(chain_table_t* table, int key, int value, uint32_t hash, uint8_t* added)
+{
+    chain_node_t** bucket   = &(table->buckets[hash & (table->num_of_buckets - 1)]);
+    chain_node_t*  node     = *bucket;
+    *added = 0;
+    for (; node != NULL; node = node->next)
+    {
+        if (node->key == key)
+        {
+            node->value = value;
+            return OK;
+        }
+    }
+    MALLOC(node, chain_node_t);
+    *node = (chain_node_t) { .key = key, .value = value, .next = *bucket };
+    *bucket = node;
+    *added  = 1;
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+static int table_remove(chain_table_t* table, int key, uint32_t hash)
+{
+    chain_node_t** link = &(table->buckets[hash & (table->num_of_buckets - 1)]);
+    for (; *link != NULL; link = &((*link)->next))
+    {
+        chain_node_t* node = *link;
+        if (node->key == key)
+        {
+            int value = node->value;
+            *link = node->next;
+            free(node);
+            return value;
+        }
+    }
+    return NOTFOUND;
+}
+
+/**
+ * Doubles the buckets of a table, it stays as it is if they can't be allocated.
+ * @param table: the table.
+ **/
+static void table_resize(chain_table_t* table)
+{
+    uint32_t        num_of_buckets  = table->num_of_buckets * 2;
+    chain_node_t**  buckets         = calloc(num_of_buckets, sizeof(chain_node_t*));
+    uint32_t i = 0;
+    if (buckets == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < table->num_of_buckets; i++)
+    {
+        chain_node_t* node = table->buckets[i];
+        while (node != NULL)
+        {
+            chain_node_t*  next     = node->next;
+            chain_node_t** bucket   = &(buckets[hash_key(node->key) & (num_of_buckets - 1)]);
+            node->next = *bucket;
+            *bucket = node;
+            node = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets          = buckets;
+    table->num_of_buckets   = num_of_buckets;
+}
+
+static void table_free(chain_table_t* table)
+{
+    uint32_t i = 0;
+    for (i = 0; i < table->num_of_buckets && table->buckets != NULL; i++)
+    {
+        chain_node_t* node = table->buckets[i];
+        while (node != NULL)
+        {
+            chain_node_t* next = node->next;
+            free(node);
+            node = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = NULL;
+}
+
+/**
+ * The keys of a stripe are those whose hash modulo BASELINE_STRIPES is its index, so a stripe's lock guards the same
+ * keys whatever the number of buckets is, and every stripe checks the load factor of its own buckets.
+ **/
+static int striped_insert(map_t* map, int key, int value, thread_args_t* thread_args)
+{
+    striped_map_t*  striped         = (striped_map_t*) map;
+    uint32_t        hash            = hash_key(key);
+    stripe_t*       stripe          = &(striped->stripes[hash & (BASELINE_STRIPES - 1)]);
+    uint32_t        num_of_buckets  = 0;
+    uint8_t         added           = 0;
+    uint8_t         overloaded      = 0;
+    int             res             = FAILED;
+
+    pthread_mutex_lock(&(stripe->lock));
+    PREEMPTION_POINT(thread_args);
+    res = table_insert(&(striped->table), key, value, hash, &added);
+    stripe->size    += added;
+    num_of_buckets  = striped->table.num_of_buckets;
+    overloaded      = stripe->size > (int64_t) (num_of_buckets / BASELINE_STRIPES) * BASELINE_LOAD_FACTOR;
+    pthread_mutex_unlock(&(stripe->lock));
+    if (overloaded)
+    {
+        striped_resize(striped, num_of_buckets);
+    }
+    return res;
+}
+
+static int striped_remove(map_t* map, int key, thread_args_t* thread_args)
+{
+    striped_map_t*  striped = (striped_map_t*) map;
+    uint32_t        hash    = hash_key(key);
+    stripe_t*       stripe  = &(striped->stripes[hash & (BASELINE_STRIPES - 1)]);
+    int             value   = NOTFOUND;
+
+    pthread_mutex_lock(&(stripe->lock));
+    PREEMPTION_POINT(thread_args);
+    value = table_remove(&(striped->table), key, hash);
+    stripe->size -= value != NOTFOUND;
+    pthread_mutex_unlock(&(stripe->lock));
+    return value;
+}
+
+static int striped_lookup(map_t* map, int key, thread_args_t* thread_args)
+{
+    striped_map_t*  striped = (striped_map_t*) map;
+    uint32_t        hash    = hash_key(key);
+    stripe_t*       stripe  = &(striped->stripes[hash & (BASELINE_STRIPES - 1)]);
+    int             value   = NOTFOUND;
+
+    pthread_mutex_lock(&(stripe->lock));
+    PREEMPTION_POINT(thread_args);
+    value = table_lookup(&(striped->table), key, hash);
+    pthread_mutex_unlock(&(stripe->lock));
+    return value;
+}
+
+/**
+ * Doubles the buckets under all the locks, unless another thread already did since `num_of_buckets` was seen.
+ * @param striped: the map.
+ * @param num_of_buckets: the number of buckets the caller found overloaded.
+ **/
+static void striped_resize(striped_map_t* striped, uint32_t num_of_buckets)
+{
+    int i = 0;
+    // Always in the same order, so resizers don't deadlock.
+    for (i = 0; i < BASELINE_STRIPES; i++)
+    {
+        pthread_mutex_lock(&(striped->stripes[i].lock));
+    }
+    if (striped->table.num_of_buckets == num_of_buckets)
+    {
+        table_resize(&(striped->table));
+    }
+    for (i = BASELINE_STRIPES - 1; i >= 0; i--)
+    {
+        pthread_mutex_unlock(&(striped->stripes[i].lock));
+    }
+}
+
+static int64_t striped_size(map_t* map)
+{
+    striped_map_t* striped = (striped_map_t*) map;
+    int64_t size = 0;
+    int i = 0;
+    for (i = 0; i < BASELINE_STRIPES; i++)
+    {
+        size += striped->stripes[i].size;
+    }
+    return size;
+}
+
+static void striped_free(map_t* map)
+{
+    striped_map_t* striped = (striped_map_t*) map;
+    int i = 0;
+    table_free(&(striped->table));
+    for (i = 0; i < BASELINE_STRIPES; i++)
+    {
+        pthread_mutex_destroy(&(striped->stripes[i].lock));
+    }
+    free(striped);
+}
+
+map_t* create_striped_map()
+{
+    striped_map_t* striped = NULL;
+    int i = 0;
+    // The stripes are aligned to cache lines.
+    if (posix_memalign((void**) &striped, CACHE_LINE_SIZE, sizeof(striped_map_t)) != 0)
+    {
+        FAIL("Failed to allocate %lu bytes for a striped map", sizeof(striped_map_t));
+    }
+    memset(striped, 0, sizeof(striped_map_t));
+    striped->map.insert = striped_insert;
+    striped->map.remove = striped_remove;
+    striped->map.lookup = striped_lookup;
+    striped->map.size   = striped_size;
+    striped->map.free   = striped_free;
+    for (i = 0; i < BASELINE_STRIPES; i++)
+    {
+        pthread_mutex_init(&(striped->stripes[i].lock), NULL);
+    }
+    if (table_init(&(striped->table)) != OK)
+    {
+        FAIL("Failed to create the table");
+    }
+    return &(striped->map);
+
+CLEANUP:
+    if (striped != NULL)
+    {
+        striped_free(&(striped->map));
+    }
+    return NULL;
+}
+
+static int rwlock_insert(map_t* map, int key, int value, thread_args_t* thread_args)
+{
+    rwlock_map_t*   locked  = (rwlock_map_t*) map;
+    uint8_t         added   = 0;
+    int             res     = FAILED;
+
+    pthread_rwlock_wrlock(&(locked->lock));
+    PREEMPTION_POINT(thread_args);
+    res = table_insert(&(locked->table), key, value, hash_key(key), &added);
+    locked->size += added;
+    if (locked->size > (int64_t) locked->table.num_of_buckets * BASELINE_LOAD_FACTOR)
+    {
+        table_resize(&(locked->table));
+    }
+    pthread_rwlock_unlock(&(locked->lock));
+    return res;
+}
+
+static int rwlock_remove(map_t* map, int key, thread_args_t* thread_args)
+{
+    rwlock_map_t*   locked  = (rwlock_map_t*) map;
+    int             value   = NOTFOUND;
+
+    pthread_rwlock_wrlock(&(locked->lock));
+    PREEMPTION_POINT(thread_args);
+    value = table_remove(&(locked->table), key, hash_key(key));
+    locked->size -= value != NOTFOUND;
+    pthread_rwlock_unlock(&(locked->lock));
+    return value;
+}
+
+static int rwlock_lookup(map_t* map, int key, thread_args_t* thread_args)
+{
+    rwlock_map_t*   locked  = (rwlock_map_t*) map;
+    int             value   = NOTFOUND;
+
+    pthread_rwlock_rdlock(&(locked->lock));
+    PREEMPTION_POINT(thread_args);
+    value = table_lookup(&(locked->table), key, hash_key(key));
+    pthread_rwlock_unlock(&(locked->lock));
+    return value;
+}
+
+static int64_t rwlock_size(map_t* map)
+{
+    return ((rwlock_map_t*) map)->size;
+}
+
+static void rwlock_free(map_t* map)
+{
+    rwlock_map_t* locked = (rwlock_map_t*) map;
+    table_free(&(locked->table));
+    pthread_rwlock_destroy(&(locked->lock));
+    free(locked);
+}
+
+map_t* create_rwlock_map()
+{
+    rwlock_map_t* locked = NULL;
+    MALLOC(locked, rwlock_map_t);
+    locked->map.insert  = rwlock_insert;
+    locked->map.remove  = rwlock_remove;
+    locked->map.lookup  = rwlock_lookup;
+    locked->map.size    = rwlock_size;
+    locked->map.free    = rwlock_free;
+    pthread_rwlock_init(&(locked->lock), NULL);
+    if (table_init(&(locked->table)) != OK)
+    {
+        FAIL("Failed to create the table");
+    }
+    return &(locked->map);
+
+CLEANUP:
+    if (locked != NULL)
+    {
+        rwlock_free(&(locked->map));
+    }
+    return NULL;
+}
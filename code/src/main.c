@@ -9,9 +9,57 @@
 #include "nodes.h"
 #include "common.h"
 #include "ctrie.h"
+#include "frozen.h"
+#include "parallel.h"
+#include "image.h"
+#include "checkpoint.h"
+#include "compaction.h"
+#include "inspect.h"
+#include "set_ops.h"
 #include "parser.h"
+#include "bench.h"
+#include "histogram.h"
+#include "workload.h"
+#include "input.h"
+#include "placement.h"
+#include "counters.h"
+#include "baseline.h"
+#include "trace.h"
+#include "memory.h"
 
-ctrie_t* ctrie = NULL;
+// The thread arguments of the compactor follow those of the workers.
+#define COMPACTOR_INDEX (NUM_OF_THREADS)
+#define NUM_OF_THREAD_ARGS (NUM_OF_THREADS + 1)
+
+ctrie_t*        ctrie   = NULL;
+frozen_ctrie_t* frozen  = NULL;
+checkpointer_t* checkpointer = NULL;
+// The map the phases run on instead of the ctrie, if any.
+map_t*          baseline = NULL;
+compactor_t*    compactor = NULL;
+// The threads running the current phases, at most NUM_OF_THREADS.
+int             num_of_threads = NUM_OF_THREADS;
+// How the action files are read.
+input_mode_t    input_mode = INPUT_MMAP;
+// The CPUs the workers are pinned to, by their index.
+placement_t     placement = {0};
+// How often the memory is sampled during a phase, 0 if it isn't.
+uint32_t        memory_interval_ms = 0;
+// The result of the current phase, filled in by its handler.
+bench_result_t  phase_result = {0};
+#if LATENCY_HISTOGRAMS
+// The latencies of the current phase's operations, by thread and action_type_t.
+histogram_t     latencies[NUM_OF_THREADS][BENCH_OP_TYPES];
+#endif
+#define LATENCIES(thread_arg, type) (&(latencies[(thread_arg)->index][(type)]))
+
+typedef struct {
+    void*           (*start)(void*);
+    void*           arg;
+} worker_t;
+
+// The workers of the running test, by index.
+worker_t        workers[NUM_OF_THREADS];
 
 typedef struct {
     thread_args_t*  thread_arg;
@@ -39,6 +87,8 @@ typedef struct {
     actions_t*      actions;
     int             offset;
     int             size;
+    // The generated workload, if the actions are generated rather than read.
+    const workload_t* workload;
 } action_thread_arg_t;
 
 int64_t get_time()
@@ -54,6 +104,159 @@ CLEANUP:
     return -1;
 }
 
+/**
+ * Splits `total` operations between the running threads, the first `total % num_of_threads` threads take one more.
+ * @param total: the number of operations.
+ * @param thread: the thread's index.
+ * @param offset: an out parameter that is set to the thread's first operation.
+ * @param size: an out parameter that is set to the thread's number of operations.
+ **/
+void thread_share(int total, int thread, int* offset, int* size)
+{
+    int share   = total / num_of_threads;
+    int extra   = total % num_of_threads;
+    *offset = thread * share + (thread < extra ? thread : extra);
+    *size   = share + (thread < extra);
+}
+
+/**
+ * Runs a worker, counting its hardware events into the phase's result.
+ * @param worker: the worker.
+ * @return NULL.
+ **/
+void* worker_main(worker_t* worker)
+{
+    counters_t counters = {0};
+    counters_open(&counters);
+    worker->start(worker->arg);
+    counters_close(&counters, &(phase_result.counters));
+    return NULL;
+}
+
+/**
+ * Starts a worker on the CPU of its index, see placement_cpu.
+ * @param tid: an out parameter that is set to the worker's thread.
+ * @param index: the worker's index.
+ * @param start: the worker's function.
+ * @param arg: the worker's argument.
+ **/
+void start_worker(pthread_t* tid, int index, void* (*start)(void*), void* arg)
+{
+    pthread_attr_t attr;
+    workers[index] = (worker_t) { .start = start, .arg = arg };
+    pthread_attr_init(&attr);
+    if (placement_attr(&placement, index, &attr) != OK)
+    {
+        PRINT("Starting worker %d unpinned", index);
+    }
+    pthread_create(tid, &attr, (void*(*)(void*)) worker_main, &(workers[index]));
+    pthread_attr_destroy(&attr);
+}
+
+void reset_latencies()
+{
+#if LATENCY_HISTOGRAMS
+    memset(latencies, 0, num_of_threads * sizeof(latencies[0]));
+#endif
+}
+
+/**
+ * Merges the latencies the threads recorded in the phase, prints their percentiles and adds them to its result.
+ * @param name: the phase's name.
+ **/
+void report_latencies(const char* name)
+{
+#if LATENCY_HISTOGRAMS
+    static histogram_t merged = {0};
+    double tick = nsecs_per_tick();
+    int type = 0;
+    int i = 0;
+    for (type = 0; type < BENCH_OP_TYPES; type++)
+    {
+        memset(&merged, 0, sizeof(merged));
+        for (i = 0; i < num_of_threads; i++)
+        {
+            histogram_merge(&merged, &(latencies[i][type]));
+        }
+        if (merged.count == 0)
+        {
+            continue;
+        }
+        bench_latency_t* latency = &(phase_result.latencies[type]);
+        *latency = (bench_latency_t) {
+            .count  = merged.count,
+            .p50    = histogram_percentile(&merged, 50) * tick,
+            .p90    = histogram_percentile(&merged, 90) * tick,
+            .p99    = histogram_percentile(&merged, 99) * tick,
+            .p999   = histogram_percentile(&merged, 99.9) * tick,
+            .max    = merged.max * tick,
+        };
+        PERS_PRINT("%s %s latency: %lu ops, p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f nsecs", name,
+                   bench_op_name(type), latency->count, latency->p50, latency->p90, latency->p99, latency->p999,
+                   latency->max);
+    }
+#endif
+}
+
+/**
+ * Prints the hardware counters of the phase's workers, per operation.
+ * @param name: the phase's name.
+ **/
+void report_counters(const char* name)
+{
+    char    line[256]   = {0};
+    size_t  length      = 0;
+    int type = 0;
+    if (phase_result.ops <= 0)
+    {
+        return;
+    }
+    for (type = 0; type < NUM_OF_COUNTERS && length < sizeof(line); type++)
+    {
+        if (!(phase_result.counters.missing & (1 << type)))
+        {
+            length += snprintf(line + length, sizeof(line) - length, " %s %.2f,", counter_name(type),
+                               (double) phase_result.counters.values[type] / phase_result.ops);
+        }
+    }
+    if (length > 0)
+    {
+        // Without the last comma.
+        line[length - 1] = '\0';
+        PERS_PRINT("%s per op:%s", name, line);
+    }
+}
+
+/**
+ * The operations of the benchmarked map: the baseline if one runs, otherwise the ctrie.
+ **/
+int map_insert(int key, int value, thread_args_t* thread_arg)
+{
+    if (baseline != NULL)
+    {
+        return baseline->insert(baseline, key, value, thread_arg);
+    }
+    return ctrie->insert(ctrie, key, value, thread_arg);
+}
+
+int map_lookup(int key, thread_args_t* thread_arg)
+{
+    if (baseline != NULL)
+    {
+        return baseline->lookup(baseline, key, thread_arg);
+    }
+    return ctrie->lookup(ctrie, key, thread_arg);
+}
+
+int map_remove(int key, thread_args_t* thread_arg)
+{
+    if (baseline != NULL)
+    {
+        return baseline->remove(baseline, key, thread_arg);
+    }
+    return ctrie->remove(ctrie, key, thread_arg);
+}
+
 void insert_test_thread(insert_thread_arg_t* insert_thread_arg)
 {
     int i;
@@ -62,7 +265,8 @@ void insert_test_thread(insert_thread_arg_t* insert_thread_arg)
     for (i = 0; i < size; i++)
     {
         insert_t insert = insert_thread_arg->inserts->inserts[offset + i];
-        ctrie->insert(ctrie, insert.key, insert.value, insert_thread_arg->thread_arg);
+        RECORD_LATENCY(LATENCIES(insert_thread_arg->thread_arg, INSERT),
+                       map_insert(insert.key, insert.value, insert_thread_arg->thread_arg));
         PRINT("inserted %d key=%d", i, insert.key);
     }
     PRINT("out of for");
@@ -70,6 +274,35 @@ void insert_test_thread(insert_thread_arg_t* insert_thread_arg)
     PRINT("after release");
 }
 
+/**
+ * Every insert (key, value) moves the value of `key` to the key `value`, atomically.
+ **/
+void move_test_thread(insert_thread_arg_t* insert_thread_arg)
+{
+    int i;
+    int size    = insert_thread_arg->size;
+    int offset  = insert_thread_arg->offset;
+    for (i = 0; i < size; i++)
+    {
+        insert_t insert = insert_thread_arg->inserts->inserts[offset + i];
+        int value = ctrie->lookup(ctrie, insert.key, insert_thread_arg->thread_arg);
+        if (value == NOTFOUND || insert.key == insert.value)
+        {
+            continue;
+        }
+        txn_op_t ops[] = {
+            { .type = TXN_EXPECT, .key = insert.key,   .value = value },
+            { .type = TXN_REMOVE, .key = insert.key },
+            { .type = TXN_INSERT, .key = insert.value, .value = value },
+        };
+        if (ctrie->transaction(ctrie, ops, sizeof(ops) / sizeof(ops[0]), insert_thread_arg->thread_arg) != OK)
+        {
+            PRINT("failed to move %d key=%d to key=%d", i, insert.key, insert.value);
+        }
+    }
+    release_hazard_pointers(insert_thread_arg->thread_arg->hp_lists[insert_thread_arg->thread_arg->index]);
+}
+
 void lookup_test_thread(lookup_thread_arg_t* lookup_thread_arg)
 {
     int i;
@@ -78,7 +311,9 @@ void lookup_test_thread(lookup_thread_arg_t* lookup_thread_arg)
     for (i = 0; i < size; i++)
     {
         lookup_t lookup = lookup_thread_arg->lookups->lookups[offset + i];
-        int ret = ctrie->lookup(ctrie, lookup.key, lookup_thread_arg->thread_arg);
+        int ret = NOTFOUND;
+        RECORD_LATENCY(LATENCIES(lookup_thread_arg->thread_arg, LOOKUP),
+                       ret = map_lookup(lookup.key, lookup_thread_arg->thread_arg));
         PRINT("lookuped %d key=%d ret=%d", i, lookup.key, ret);
         if (ret == NOTFOUND)
         {
@@ -90,6 +325,24 @@ void lookup_test_thread(lookup_thread_arg_t* lookup_thread_arg)
     PRINT("after release");
 }
 
+void frozen_lookup_test_thread(lookup_thread_arg_t* lookup_thread_arg)
+{
+    int i;
+    int size    = lookup_thread_arg->size;
+    int offset  = lookup_thread_arg->offset;
+    for (i = 0; i < size; i++)
+    {
+        lookup_t lookup = lookup_thread_arg->lookups->lookups[offset + i];
+        int ret = NOTFOUND;
+        RECORD_LATENCY(LATENCIES(lookup_thread_arg->thread_arg, LOOKUP), ret = frozen->lookup(frozen, lookup.key));
+        PRINT("lookuped %d key=%d ret=%d", i, lookup.key, ret);
+        if (ret == NOTFOUND)
+        {
+            PERS_PRINT("key: %d not found\n", lookup.key);
+        }
+    }
+}
+
 void remove_test_thread(remove_thread_arg_t* remove_thread_arg)
 {
     int i;
@@ -98,7 +351,8 @@ void remove_test_thread(remove_thread_arg_t* remove_thread_arg)
     for (i = 0; i < size; i++)
     {
         remove_t remove = remove_thread_arg->removes->removes[offset + i];
-        ctrie->remove(ctrie, remove.key, remove_thread_arg->thread_arg);
+        RECORD_LATENCY(LATENCIES(remove_thread_arg->thread_arg, REMOVE),
+                       map_remove(remove.key, remove_thread_arg->thread_arg));
         PRINT("removed %d key=%d", i, remove.key);
     }
     PRINT("out of for");
@@ -106,6 +360,26 @@ void remove_test_thread(remove_thread_arg_t* remove_thread_arg)
     PRINT("after release");
 }
 
+void run_action(action_t* action, thread_args_t* thread_arg)
+{
+    DEBUG("Current Type is: %d", action->type);
+    switch (action->type)
+    {
+    case INSERT:
+        RECORD_LATENCY(LATENCIES(thread_arg, INSERT),
+                       map_insert(action->action.insert.key, action->action.insert.value, thread_arg));
+        break;
+    case LOOKUP:
+        RECORD_LATENCY(LATENCIES(thread_arg, LOOKUP), map_lookup(action->action.insert.key, thread_arg));
+        break;
+    case REMOVE:
+        RECORD_LATENCY(LATENCIES(thread_arg, REMOVE), map_remove(action->action.insert.key, thread_arg));
+        break;
+    default:
+        PRINT("unknown action %d", action->type);
+    }
+}
+
 void action_test_thread(action_thread_arg_t* action_thread_arg)
 {
     int i;
@@ -113,42 +387,88 @@ void action_test_thread(action_thread_arg_t* action_thread_arg)
     int offset  = action_thread_arg->offset;
     for (i = 0; i < size; i++)
     {
-        action_t* curr_action = &(action_thread_arg->actions->actions[offset + i]);
-        DEBUG("Current Type is: %d", curr_action->type);
-        switch (curr_action->type)
-        {
-        case INSERT:
-            ctrie->insert(ctrie, curr_action->action.insert.key, curr_action->action.insert.value, action_thread_arg->thread_arg);
-            break;
-        case LOOKUP:
-            ctrie->lookup(ctrie, curr_action->action.insert.key, action_thread_arg->thread_arg);
-            break;
-        case REMOVE:
-            ctrie->remove(ctrie, curr_action->action.insert.key, action_thread_arg->thread_arg);
-            break;
-        default:
-            PRINT("unknown action %d", curr_action->type);
-        }
+        run_action(&(action_thread_arg->actions->actions[offset + i]), action_thread_arg->thread_arg);
     }
     PRINT("out of for");
     release_hazard_pointers(action_thread_arg->thread_arg->hp_lists[action_thread_arg->thread_arg->index]);
     PRINT("after release");
 }
 
-int64_t insert_test(inserts_t* inserts, thread_args_t threads_args[])
+/**
+ * Generates the thread's share of the workload into the actions, before they are run.
+ **/
+void generate_test_thread(action_thread_arg_t* action_thread_arg)
+{
+    workload_stream_t stream = {0};
+    int i;
+    int size    = action_thread_arg->size;
+    int offset  = action_thread_arg->offset;
+    workload_stream_init(&stream, action_thread_arg->workload, action_thread_arg->thread_arg->index, num_of_threads,
+                         offset);
+    for (i = 0; i < size; i++)
+    {
+        workload_next(&stream, &(action_thread_arg->actions->actions[offset + i]));
+    }
+}
+
+/**
+ * Generates the thread's share of the workload while running it.
+ **/
+void workload_test_thread(action_thread_arg_t* action_thread_arg)
+{
+    workload_stream_t stream = {0};
+    action_t action = {0};
+    int i;
+    int size    = action_thread_arg->size;
+    int offset  = action_thread_arg->offset;
+    workload_stream_init(&stream, action_thread_arg->workload, action_thread_arg->thread_arg->index, num_of_threads,
+                         offset);
+    for (i = 0; i < size; i++)
+    {
+        workload_next(&stream, &action);
+        run_action(&action, action_thread_arg->thread_arg);
+    }
+    release_hazard_pointers(action_thread_arg->thread_arg->hp_lists[action_thread_arg->thread_arg->index]);
+}
+
+/**
+ * Frees the nodes the workers retired during a test, once they are done.
+ * The compactor may still be reading some of the retired nodes, those stay in the free lists.
+ * @param threads_args: the thread arguments of the workers.
+ **/
+void drain_free_lists(thread_args_t threads_args[])
+{
+    int i = 0;
+    if (memory_interval_ms > 0)
+    {
+        for (i = 0; i < num_of_threads; i++)
+        {
+            phase_result.retired += threads_args[i].free_list->length + threads_args[i].free_list->num_of_deferred;
+        }
+        phase_result.heap_bytes = memory_heap_bytes();
+    }
+    for (i = 0; i < num_of_threads; i++)
+    {
+        reclaim_free_list(&(threads_args[i]));
+    }
+}
+
+int64_t insert_test(inserts_t* inserts, thread_args_t threads_args[], void (*test_thread)(insert_thread_arg_t*))
 {
     int i;
     insert_thread_arg_t insert_threads_args[NUM_OF_THREADS] = {0};
 
     int total_actions = inserts->n;
-    int size = total_actions / NUM_OF_THREADS;
+    int offset = 0;
+    int size = 0;
 
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
+        thread_share(total_actions, i, &offset, &size);
         insert_threads_args[i] = (insert_thread_arg_t) {
             .thread_arg = &(threads_args[i]),
             .inserts    = inserts,
-            .offset     = i * size,
+            .offset     = offset,
             .size       = size,
         };
     }
@@ -159,26 +479,17 @@ int64_t insert_test(inserts_t* inserts, thread_args_t threads_args[])
         return -1;
     }
     pthread_t tids[NUM_OF_THREADS];
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
-        pthread_create(&(tids[i]), NULL, (void*(*)(void*))insert_test_thread, &(insert_threads_args[i]));
+        start_worker(&(tids[i]), i, (void*(*)(void*)) test_thread, &(insert_threads_args[i]));
     }
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
         pthread_join(tids[i], NULL);
     }
     int64_t end_time = get_time();
 
-    int j = 0;
-    for (i = 0; i < NUM_OF_THREADS; i++)
-    {
-        for (j = 0; j < threads_args[i].free_list->length; j++)
-        {
-            DEBUG("free %p", threads_args[i].free_list->free_list[j]);
-            free(threads_args[i].free_list->free_list[j]);
-        }
-        threads_args[i].free_list->length = 0;
-    }
+    drain_free_lists(threads_args);
 
     if (end_time == -1)
     {
@@ -187,20 +498,22 @@ int64_t insert_test(inserts_t* inserts, thread_args_t threads_args[])
     return end_time - start_time;
 }
 
-int64_t lookup_test(lookups_t* lookups, thread_args_t threads_args[])
+int64_t lookup_test(lookups_t* lookups, thread_args_t threads_args[], void (*test_thread)(lookup_thread_arg_t*))
 {
     int i;
     lookup_thread_arg_t lookup_threads_args[NUM_OF_THREADS] = {0};
 
     int total_actions = lookups->n;
-    int size = total_actions / NUM_OF_THREADS;
+    int offset = 0;
+    int size = 0;
 
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
+        thread_share(total_actions, i, &offset, &size);
         lookup_threads_args[i] = (lookup_thread_arg_t) {
             .thread_arg = &(threads_args[i]),
             .lookups    = lookups,
-            .offset     = i * size,
+            .offset     = offset,
             .size       = size,
         };
     }
@@ -211,26 +524,17 @@ int64_t lookup_test(lookups_t* lookups, thread_args_t threads_args[])
         return -1;
     }
     pthread_t tids[NUM_OF_THREADS];
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
-        pthread_create(&(tids[i]), NULL, (void*(*)(void*))lookup_test_thread, &(lookup_threads_args[i]));
+        start_worker(&(tids[i]), i, (void*(*)(void*)) test_thread, &(lookup_threads_args[i]));
     }
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
         pthread_join(tids[i], NULL);
     }
     int64_t end_time = get_time();
 
-    int j = 0;
-    for (i = 0; i < NUM_OF_THREADS; i++)
-    {
-        for (j = 0; j < threads_args[i].free_list->length; j++)
-        {
-            DEBUG("free %p", threads_args[i].free_list->free_list[j]);
-            free(threads_args[i].free_list->free_list[j]);
-        }
-        threads_args[i].free_list->length = 0;
-    }
+    drain_free_lists(threads_args);
 
     if (end_time == -1)
     {
@@ -245,14 +549,16 @@ int64_t remove_test(removes_t* removes, thread_args_t threads_args[])
     remove_thread_arg_t remove_threads_args[NUM_OF_THREADS] = {0};
 
     int total_actions = removes->n;
-    int size = total_actions / NUM_OF_THREADS;
+    int offset = 0;
+    int size = 0;
 
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
+        thread_share(total_actions, i, &offset, &size);
         remove_threads_args[i] = (remove_thread_arg_t) {
             .thread_arg = &(threads_args[i]),
             .removes    = removes,
-            .offset     = i * size,
+            .offset     = offset,
             .size       = size,
         };
     }
@@ -263,26 +569,17 @@ int64_t remove_test(removes_t* removes, thread_args_t threads_args[])
         return -1;
     }
     pthread_t tids[NUM_OF_THREADS];
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
-        pthread_create(&(tids[i]), NULL, (void*(*)(void*))remove_test_thread, &(remove_threads_args[i]));
+        start_worker(&(tids[i]), i, (void*(*)(void*)) remove_test_thread, &(remove_threads_args[i]));
     }
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
         pthread_join(tids[i], NULL);
     }
     int64_t end_time = get_time();
 
-    int j = 0;
-    for (i = 0; i < NUM_OF_THREADS; i++)
-    {
-        for (j = 0; j < threads_args[i].free_list->length; j++)
-        {
-            DEBUG("free %p", threads_args[i].free_list->free_list[j]);
-            free(threads_args[i].free_list->free_list[j]);
-        }
-        threads_args[i].free_list->length = 0;
-    }
+    drain_free_lists(threads_args);
 
     if (end_time == -1)
     {
@@ -291,21 +588,25 @@ int64_t remove_test(removes_t* removes, thread_args_t threads_args[])
     return end_time - start_time;
 }
 
-int64_t action_test(actions_t* actions, thread_args_t threads_args[])
+int64_t action_test(actions_t* actions, const workload_t* workload, thread_args_t threads_args[],
+                    void (*test_thread)(action_thread_arg_t*))
 {
     int i;
     action_thread_arg_t action_threads_args[NUM_OF_THREADS] = {0};
 
     int total_actions = actions->n;
-    int size = total_actions / NUM_OF_THREADS;
+    int offset = 0;
+    int size = 0;
 
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
+        thread_share(total_actions, i, &offset, &size);
         action_threads_args[i] = (action_thread_arg_t) {
             .thread_arg = &(threads_args[i]),
             .actions    = actions,
-            .offset     = i * size,
+            .offset     = offset,
             .size       = size,
+            .workload   = workload,
         };
     }
 
@@ -315,26 +616,17 @@ int64_t action_test(actions_t* actions, thread_args_t threads_args[])
         return -1;
     }
     pthread_t tids[NUM_OF_THREADS];
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
-        pthread_create(&(tids[i]), NULL, (void*(*)(void*))action_test_thread, &(action_threads_args[i]));
+        start_worker(&(tids[i]), i, (void*(*)(void*)) test_thread, &(action_threads_args[i]));
     }
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    for (i = 0; i < num_of_threads; i++)
     {
         pthread_join(tids[i], NULL);
     }
     int64_t end_time = get_time();
 
-    int j = 0;
-    for (i = 0; i < NUM_OF_THREADS; i++)
-    {
-        for (j = 0; j < threads_args[i].free_list->length; j++)
-        {
-            DEBUG("free %p", threads_args[i].free_list->free_list[j]);
-            free(threads_args[i].free_list->free_list[j]);
-        }
-        threads_args[i].free_list->length = 0;
-    }
+    drain_free_lists(threads_args);
 
     if (end_time == -1)
     {
@@ -342,202 +634,1307 @@ int64_t action_test(actions_t* actions, thread_args_t threads_args[])
     }
     return end_time - start_time;
 }
-char* read_file(const char* path)
+void print_backoff_stats(const char* name, thread_args_t threads_args[])
 {
-    FILE* fp    = NULL;
-    char* data  = NULL;
+    int i;
+    uint64_t failures   = 0;
+    uint64_t backoffs   = 0;
+    uint64_t spins      = 0;
+    for (i = 0; i < num_of_threads; i++)
+    {
+        failures    += threads_args[i].backoff.failures;
+        backoffs    += threads_args[i].backoff.backoffs;
+        spins       += threads_args[i].backoff.spins;
+        threads_args[i].backoff.failures    = 0;
+        threads_args[i].backoff.backoffs    = 0;
+        threads_args[i].backoff.spins       = 0;
+    }
+    PERS_PRINT("%s had %lu CAS failures, %lu backoffs, %lu spins", name, failures, backoffs, spins);
+    phase_result.cas_failures   = failures;
+    phase_result.backoffs       = backoffs;
+    phase_result.spins          = spins;
+}
 
-    fp = fopen(path, "r");
-    if (fp == NULL)
+/**
+ * Prints why the phase's ctrie operations restarted, and with CONTENTION_HEATMAP where they did.
+ * @param name: the phase's name.
+ * @param threads_args: the threads' arguments, whose counts are reset.
+ **/
+void print_restart_stats(const char* name, thread_args_t threads_args[])
+{
+    char    line[1024]  = {0};
+    size_t  length      = 0;
+    int i, cause;
+    if (ctrie == NULL)
     {
-        FAIL("Failed to fopen %s", path);
+        return;
     }
-    struct stat file_status = {0};
-    if (fstat(fileno(fp), &file_status) < 0)
+    for (cause = 0; cause < NUM_OF_RESTART_CAUSES; cause++)
     {
-        FAIL("Failed to stat file: %s (%d)", path, errno);
+        for (i = 0; i < num_of_threads; i++)
+        {
+            phase_result.restarts[cause] += threads_args[i].contention.restarts[cause];
+        }
+        length += snprintf(line + length, sizeof(line) - length, " %s %lu,", bench_restart_name(cause),
+                           phase_result.restarts[cause]);
     }
-    PRINT("File size is: %d", file_status.st_size);
-    data = malloc(file_status.st_size);
-    if (data == NULL)
+    // Without the last comma.
+    line[length - 1] = '\0';
+    PERS_PRINT("%s restarts:%s", name, line);
+#if CONTENTION_HEATMAP
+    contention_t total = {0};
+    int depth, slot;
+    for (i = 0; i < num_of_threads; i++)
     {
-        FAIL("Failed to allocate %d bytes for data", file_status.st_size);
+        for (depth = 0; depth < MAX_LEVELS; depth++)
+        {
+            total.depths[depth] += threads_args[i].contention.depths[depth];
+        }
+        for (slot = 0; slot < MAX_BRANCHES; slot++)
+        {
+            total.slots[slot] += threads_args[i].contention.slots[slot];
+        }
     }
-    if (fread(data, file_status.st_size, 1, fp) != 1)
+    length = 0;
+    for (depth = 0; depth < MAX_LEVELS; depth++)
     {
-        FAIL("Failed to read %d bytes from fp", file_status.st_size);
+        length += snprintf(line + length, sizeof(line) - length, " %lu", total.depths[depth]);
     }
-
-    fclose(fp);
-    return data;
-
-CLEANUP:
-    
-    if (fp != NULL)
+    PERS_PRINT("%s restarts by depth:%s", name, line);
+    length = 0;
+    for (slot = 0; slot < MAX_BRANCHES && length < sizeof(line); slot++)
     {
-        fclose(fp);
+        length += snprintf(line + length, sizeof(line) - length, " %lu", total.slots[slot]);
     }
-    if (data != NULL)
+    PERS_PRINT("%s restarts by root slot:%s", name, line);
+#endif
+    for (i = 0; i < num_of_threads; i++)
     {
-        free(data);
+        threads_args[i].contention = (contention_t) {0};
     }
-    return NULL;
 }
 
-void handle_insert(const char* path, thread_args_t threads_args[])
+/**
+ * Prints how far the phase's reclamation fell behind: the most retired nodes a free list held, the times a full free
+ * list slept because hazard pointers kept all of its nodes, and the injected preemptions.
+ * @param name: the phase's name.
+ * @param threads_args: the threads' arguments, whose counts are reset.
+ **/
+void print_reclamation_stats(const char* name, thread_args_t threads_args[])
 {
-    char* data = NULL;
-    data = read_file(path);
-    if (data == NULL)
-    {
-        FAIL("Failed to read file");
-    }
-    inserts_t* inserts = (inserts_t*) data;
-    int64_t time = insert_test(inserts, threads_args);
-    PERS_PRINT("Insert took %ld nsecs", time);
-
-CLEANUP:
-    if (data != NULL)
+    uint64_t peak_retired   = 0;
+    uint64_t total_peaks    = 0;
+    int i;
+    for (i = 0; i < num_of_threads; i++)
     {
-        free(data);
+        if ((uint64_t) threads_args[i].free_list->peak_length > peak_retired)
+        {
+            peak_retired = threads_args[i].free_list->peak_length;
+        }
+        total_peaks                 += threads_args[i].free_list->peak_length;
+        phase_result.reclaim_stalls += threads_args[i].free_list->stalls;
+        phase_result.preemptions    += threads_args[i].preemption.preemptions;
+        threads_args[i].free_list->peak_length  = 0;
+        threads_args[i].free_list->stalls       = 0;
+        threads_args[i].preemption.preemptions  = 0;
     }
+    phase_result.peak_retired = peak_retired;
+    PERS_PRINT("%s retired up to %lu of %d nodes per thread (%lu in all), %lu reclamation stalls, %lu preemptions", name,
+               peak_retired, FREE_LIST_SIZE, total_peaks, phase_result.reclaim_stalls, phase_result.preemptions);
 }
 
-void handle_lookup(const char* path, thread_args_t threads_args[])
+void print_eviction_stats(const char* name, thread_args_t threads_args[])
 {
-    char* data = NULL;
-    data = read_file(path);
-    if (data == NULL)
+    int i;
+    uint64_t evictions      = 0;
+    uint64_t second_chances = 0;
+    if (ctrie == NULL || ctrie->config.capacity == 0)
     {
-        FAIL("Failed to read file");
+        return;
     }
-    lookups_t* lookups = (lookups_t*) data;
-    int64_t time = lookup_test(lookups, threads_args);
-    PERS_PRINT("Lookup took %ld nsecs", time);
+    for (i = 0; i < num_of_threads; i++)
+    {
+        evictions       += threads_args[i].eviction.evictions;
+        second_chances  += threads_args[i].eviction.second_chances;
+        threads_args[i].eviction.evictions      = 0;
+        threads_args[i].eviction.second_chances = 0;
+    }
+    PERS_PRINT("%s had %lu evictions, %lu second chances, size ~%ld of %u", name, evictions, second_chances, ctrie->size, ctrie->config.capacity);
+}
 
-CLEANUP:
-    if (data != NULL)
+/**
+ * Prints how long a phase waited for its action file to be read, only a streamed file is waited for.
+ * @param name: the phase's name.
+ * @param input: the phase's action file.
+ **/
+void print_input_stats(const char* name, const input_t* input)
+{
+    if (input->mode == INPUT_STREAM)
     {
-        free(data);
+        PERS_PRINT("%s waited %ld nsecs for %lu chunks of input", name, input->wait_time, input->num_of_chunks);
     }
 }
 
-void handle_remove(const char* path, thread_args_t threads_args[])
+int handle_insert(const char* path, thread_args_t threads_args[])
 {
-    char* data = NULL;
-    data = read_file(path);
-    if (data == NULL)
+    input_t    input   = { .fd = -1 };
+    inserts_t* inserts = NULL;
+    int64_t    time    = 0;
+    int64_t    ops     = 0;
+    int        res     = FAILED;
+
+    if (input_open(&input, path, input_mode, sizeof(insert_t)) != OK)
+    {
+        FAIL("Failed to open file");
+    }
+    reset_latencies();
+    // A streamed file is run chunk by chunk, the others at once.
+    while ((inserts = input_next(&input)) != NULL)
+    {
+        int64_t part = insert_test(inserts, threads_args, insert_test_thread);
+        if (part == -1)
+        {
+            FAIL("Failed to run the inserts");
+        }
+        time    += part;
+        ops     += inserts->n;
+        input_release(&input);
+    }
+    if (input.failed)
     {
         FAIL("Failed to read file");
     }
-    removes_t* removes = (removes_t*) data;
-    int64_t time = remove_test(removes, threads_args);
-    PERS_PRINT("Remove took %ld nsecs", time);
+    PERS_PRINT("Insert took %ld nsecs", time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = ops;
+    report_latencies("Insert");
+    report_counters("Insert");
+    print_backoff_stats("Insert", threads_args);
+    print_restart_stats("Insert", threads_args);
+    print_reclamation_stats("Insert", threads_args);
+    print_eviction_stats("Insert", threads_args);
+    print_input_stats("Insert", &input);
+    res = OK;
 
 CLEANUP:
-    if (data != NULL)
-    {
-        free(data);
-    }
+    input_close(&input);
+    return res;
 }
 
-void handle_action(const char* path, thread_args_t threads_args[])
+int handle_move(const char* path, thread_args_t threads_args[])
 {
-    char* data = NULL;
-    data = read_file(path);
-    if (data == NULL)
+    input_t    input   = { .fd = -1 };
+    inserts_t* inserts = NULL;
+    int64_t    time    = 0;
+    int64_t    ops     = 0;
+    int        res     = FAILED;
+
+    if (input_open(&input, path, input_mode, sizeof(insert_t)) != OK)
+    {
+        FAIL("Failed to open file");
+    }
+    reset_latencies();
+    // A streamed file is run chunk by chunk, the others at once.
+    while ((inserts = input_next(&input)) != NULL)
+    {
+        int64_t part = insert_test(inserts, threads_args, move_test_thread);
+        if (part == -1)
+        {
+            FAIL("Failed to run the moves");
+        }
+        time    += part;
+        ops     += inserts->n;
+        input_release(&input);
+    }
+    if (input.failed)
     {
         FAIL("Failed to read file");
     }
-    actions_t* actions = (actions_t*) data;
-    int64_t time = action_test(actions, threads_args);
-    PERS_PRINT("Action took %ld nsecs", time);
+    PERS_PRINT("Move took %ld nsecs", time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = ops;
+    report_counters("Move");
+    print_backoff_stats("Move", threads_args);
+    print_restart_stats("Move", threads_args);
+    print_reclamation_stats("Move", threads_args);
+    print_input_stats("Move", &input);
+    res = OK;
 
 CLEANUP:
-    if (data != NULL)
-    {
-        free(data);
-    }
+    input_close(&input);
+    return res;
 }
 
-int main(int argc, char* argv[])
+int handle_lookup(const char* path, thread_args_t threads_args[])
 {
-    int i = 0;
+    input_t    input   = { .fd = -1 };
+    lookups_t* lookups = NULL;
+    int64_t    time    = 0;
+    int64_t    ops     = 0;
+    int        res     = FAILED;
 
-    if ((argc & 1) == 0)
+    if (input_open(&input, path, input_mode, sizeof(lookup_t)) != OK)
     {
-        PRINT("Usage: %s [<insert|lookup|remove> <action_file>]*", argv[0]);
-        return -1;
+        FAIL("Failed to open file");
     }
-    
-    PERS_PRINT("Start");
-    PERS_PRINT("Setting up %d threads", NUM_OF_THREADS);
-
-    hp_list_t*  hp_array[NUM_OF_THREADS]    = {0};
-    hp_list_t   hp_lists[NUM_OF_THREADS]    = {0};
-
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    reset_latencies();
+    // A streamed file is run chunk by chunk, the others at once.
+    while ((lookups = input_next(&input)) != NULL)
     {
-        hp_array[i] = &(hp_lists[i]);
+        int64_t part = lookup_test(lookups, threads_args, lookup_test_thread);
+        if (part == -1)
+        {
+            FAIL("Failed to run the lookups");
+        }
+        time    += part;
+        ops     += lookups->n;
+        input_release(&input);
     }
-
-    free_list_t free_lists[NUM_OF_THREADS]      = {0};
-    thread_args_t threads_args[NUM_OF_THREADS]  = {0};
-    for (i = 0; i < NUM_OF_THREADS; i++)
+    if (input.failed)
     {
-        threads_args[i] = (thread_args_t) {
-            .hp_lists   = hp_array,
-            .free_list  = &(free_lists[i]),
-            .index      = i,
-            .num_of_threads = NUM_OF_THREADS,
-        };
+        FAIL("Failed to read file");
     }
+    PERS_PRINT("Lookup took %ld nsecs", time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = ops;
+    report_latencies("Lookup");
+    report_counters("Lookup");
+    print_input_stats("Lookup", &input);
+    res = OK;
 
-    ctrie = create_ctrie();
-    if (ctrie == NULL)
+CLEANUP:
+    input_close(&input);
+    return res;
+}
+
+void stop_compaction()
+{
+    compaction_stats_t stats = {0};
+    if (compactor != NULL)
     {
-        FAIL("Failed to create ctrie");
+        uint64_t passes = compaction_stop(compactor, &stats);
+        compactor = NULL;
+        PERS_PRINT("Compaction: %ld passes, %ld cnodes, %ld entries, %ld resurrected, %ld contracted",
+                   passes, stats.cnodes, stats.entries, stats.resurrected, stats.contracted);
     }
+}
 
-    for (i = 1; i < argc; i += 2)
+/**
+ * Prints the memory of the map after a phase, before and after the nodes its workers retired were freed.
+ * Counting the ctrie's keys requires a quiescent ctrie, so the compactor is stopped.
+ * @param name: the phase's name.
+ * @param threads_args: the thread arguments.
+ * @param sampler: the resident set size samples of the phase.
+ **/
+void report_memory(const char* name, thread_args_t threads_args[], const memory_sampler_t* sampler)
+{
+    static const struct
     {
-        if (strcmp(argv[i], "insert") == 0)
-        {
-            PRINT("Handle insert..");
-            handle_insert(argv[i + 1], threads_args);
-            PRINT("Handled insert");
-        }
-        else if (strcmp(argv[i], "lookup") == 0)
-        {
-            PRINT("Handle lookup..");
-            handle_lookup(argv[i + 1], threads_args);
-            PRINT("Handled lookup");
-        }
-        else if (strcmp(argv[i], "remove") == 0)
+        const char* name;
+        size_t      size;
+    } nodes[] = { { "main_node_t", sizeof(main_node_t) }, { "branch_t", sizeof(branch_t) }, { "lnode_t", sizeof(lnode_t) } };
+    ctrie_shape_t   shape       = {0};
+    memory_usage_t  usage       = {0};
+    uint64_t        unused      = 0;
+    int i = 0;
+    if (ctrie != NULL)
+    {
+        stop_compaction();
+        if (ctrie_inspect(ctrie, &shape, num_of_threads) != OK)
         {
-            PRINT("Handle remove..");
-            handle_remove(argv[i + 1], threads_args);
-            PRINT("Handled remove");
+            FAIL("Failed to count the keys");
         }
-        else if (strcmp(argv[i], "action") == 0)
+        phase_result.keys = shape.entries;
+    }
+    else
+    {
+        phase_result.keys = baseline->size(baseline);
+    }
+    // Only counted with MEMORY_ACCOUNTING, nodes of the same size class are counted together.
+    if (ctrie != NULL && memory_usage(&usage) == OK)
+    {
+        for (i = 0; i < (int) (sizeof(nodes) / sizeof(nodes[0])); i++)
         {
-            PRINT("Handle action..");
-            handle_action(argv[i + 1], threads_args);
-            PRINT("Handled action");
+            int class = memory_class(nodes[i].size);
+            if (class != FAILED)
+            {
+                PERS_PRINT("%s %s (class %d): %ld live, %ld bytes", name, nodes[i].name, class,
+                           usage.allocations[class], usage.bytes[class]);
+            }
         }
-        else
+    }
+    // The phases without workers retire nothing, and the others were drained as their workers were done.
+    for (i = 0; i < num_of_threads; i++)
+    {
+        reclaim_free_list(&(threads_args[i]));
+    }
+    phase_result.drained_heap_bytes = memory_heap_bytes();
+    if (phase_result.heap_bytes == 0)
+    {
+        phase_result.heap_bytes = phase_result.drained_heap_bytes;
+    }
+    phase_result.rss                = sampler->last_rss;
+    phase_result.peak_rss           = sampler->peak_rss;
+    PERS_PRINT("%s memory: %ld keys, heap %lu bytes (%.1f per key) with %lu retired nodes, %lu bytes (%.1f per key) "
+               "once reclaimed, rss %lu bytes, peak %lu bytes in %lu samples", name, phase_result.keys,
+               phase_result.heap_bytes, phase_result.keys > 0 ? (double) phase_result.heap_bytes / phase_result.keys : 0.0,
+               phase_result.retired, phase_result.drained_heap_bytes,
+               phase_result.keys > 0 ? (double) phase_result.drained_heap_bytes / phase_result.keys : 0.0,
+               phase_result.rss, phase_result.peak_rss, sampler->samples);
+    if (ctrie != NULL)
+    {
+        for (i = 0; i <= MAX_BRANCHES; i++)
         {
-            FAIL("Unknown action: %s", argv[i]);
+            unused += shape.fanout[i] * (MAX_BRANCHES - i) * sizeof(branch_t*);
         }
+        PERS_PRINT("%s CNodes: %lu, %lu bytes of their slots are unused", name, shape.nodes[CNODE], unused);
     }
 
 CLEANUP:
+    return;
+}
 
-    if (ctrie != NULL)
+int handle_frozen_lookup(const char* path, thread_args_t threads_args[])
+{
+    input_t    input   = { .fd = -1 };
+    lookups_t* lookups = NULL;
+    int64_t    time    = 0;
+    int64_t    ops     = 0;
+    int        res     = FAILED;
+    // An opened image is looked up as is, otherwise the ctrie is frozen for this action only.
+    uint8_t mapped = frozen != NULL;
+    if (!mapped)
     {
-        ctrie->free(ctrie);
+        int64_t start_time = get_time();
+        // Freezing requires a quiescent ctrie.
+        stop_compaction();
+        frozen = ctrie_freeze(ctrie);
+        if (frozen == NULL)
+        {
+            FAIL("Failed to freeze ctrie");
+        }
+        PERS_PRINT("Freeze took %ld nsecs", get_time() - start_time);
+    }
+    if (input_open(&input, path, input_mode, sizeof(lookup_t)) != OK)
+    {
+        FAIL("Failed to open file");
+    }
+    reset_latencies();
+    while ((lookups = input_next(&input)) != NULL)
+    {
+        int64_t part = lookup_test(lookups, threads_args, frozen_lookup_test_thread);
+        if (part == -1)
+        {
+            FAIL("Failed to run the frozen lookups");
+        }
+        time    += part;
+        ops     += lookups->n;
+        input_release(&input);
+    }
+    if (input.failed)
+    {
+        FAIL("Failed to read file");
+    }
+    PERS_PRINT("Frozen lookup took %ld nsecs", time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = ops;
+    report_latencies("Frozen lookup");
+    report_counters("Frozen lookup");
+    print_input_stats("Frozen lookup", &input);
+    res = OK;
+
+CLEANUP:
+    input_close(&input);
+    // Let the following actions keep building the ctrie.
+    if (frozen != NULL && !mapped)
+    {
+        frozen->free(frozen);
+        frozen = NULL;
+    }
+    ctrie->readonly = 0;
+    return res;
+}
+
+void stop_checkpoints()
+{
+    checkpoint_stats_t stats = {0};
+    if (checkpointer != NULL)
+    {
+        uint32_t num_of_checkpoints = checkpoint_stop(checkpointer, &stats);
+        checkpointer = NULL;
+        PERS_PRINT("Checkpoints: %d, %ld bytes, %ld records, %ld entries, waited %ld nsecs, took %ld nsecs",
+                   num_of_checkpoints, stats.bytes, stats.records, stats.entries, stats.wait_time, stats.time);
+    }
+}
+
+int handle_save(const char* path, thread_args_t threads_args[])
+{
+    int res = FAILED;
+    int64_t start_time = get_time();
+    // Saving requires a quiescent ctrie.
+    stop_compaction();
+    if (ctrie_save(ctrie, path) != OK)
+    {
+        FAIL("Failed to save ctrie to %s", path);
+    }
+    phase_result.nsecs = get_time() - start_time;
+    PERS_PRINT("Save took %ld nsecs", phase_result.nsecs);
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+int handle_open(const char* path, thread_args_t threads_args[])
+{
+    ctrie_t* thawed     = NULL;
+    int64_t  start_time = get_time();
+    int      res        = FAILED;
+    if (frozen != NULL)
+    {
+        frozen->free(frozen);
+    }
+    frozen = ctrie_open_mmap(path);
+    if (frozen == NULL)
+    {
+        FAIL("Failed to open image %s", path);
+    }
+    phase_result.nsecs = get_time() - start_time;
+    PERS_PRINT("Open took %ld nsecs", phase_result.nsecs);
+    // The following actions modify a mutable copy, while flookup keeps using the image.
+    start_time = get_time();
+    thawed = frozen_thaw(frozen);
+    if (thawed == NULL)
+    {
+        FAIL("Failed to thaw image %s", path);
+    }
+    PERS_PRINT("Thaw took %ld nsecs", get_time() - start_time);
+    // The checkpointer and the compactor must not outlive the ctrie they work on.
+    stop_checkpoints();
+    stop_compaction();
+    ctrie->free(ctrie);
+    ctrie = thawed;
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+/**
+ * Dumps the events traced since the last dump, see scripts/trace_to_chrome.py.
+ * @param path: the trace file.
+ * @param threads_args: the thread arguments.
+ * @return OK on success, otherwise FAILED.
+ **/
+int handle_trace(const char* path, thread_args_t threads_args[])
+{
+    // The compactor would record events while they are written.
+    stop_compaction();
+    return trace_dump(path);
+}
+
+int handle_checkpoint(const char* path, thread_args_t threads_args[])
+{
+    checkpoint_config_t config = {
+        .path           = path,
+        .interval_ms    = CHECKPOINT_INTERVAL_MS,
+        .bytes_per_sec  = CHECKPOINT_BYTES_PER_SEC,
+        .full_every     = CHECKPOINT_FULL_EVERY,
+    };
+    int res = FAILED;
+    // The following actions run while the checkpointer writes checkpoints in the background.
+    stop_checkpoints();
+    checkpointer = checkpoint_start(ctrie, &config, &(threads_args[0]));
+    if (checkpointer == NULL)
+    {
+        FAIL("Failed to start checkpointing to %s", path);
+    }
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+int handle_compact(const char* interval_ms, thread_args_t threads_args[])
+{
+    compaction_config_t config = {
+        .interval_ms    = atoi(interval_ms),
+        .cnodes_per_sec = COMPACTION_CNODES_PER_SEC,
+    };
+    compaction_stats_t stats    = {0};
+    uint32_t           cursor   = 0;
+    int                res      = FAILED;
+    stop_compaction();
+    if (config.interval_ms == 0)
+    {
+        // A single pass, right away.
+        int64_t start_time = get_time();
+        ctrie_compact(ctrie, &cursor, COMPACTION_CHUNKS, &(threads_args[COMPACTOR_INDEX]), &stats);
+        phase_result.nsecs = get_time() - start_time;
+        PERS_PRINT("Compaction took %ld nsecs, %ld cnodes, %ld entries, %ld resurrected, %ld contracted",
+                   phase_result.nsecs, stats.cnodes, stats.entries, stats.resurrected, stats.contracted);
+        if (stats.entries > 0)
+        {
+            PERS_PRINT("Average depth %.3f before, %.3f after",
+                       (double) stats.depth_sum / stats.entries,
+                       (double) (stats.depth_sum - stats.resurrected) / stats.entries);
+        }
+        return OK;
+    }
+    // The following actions run while the compactor compacts the ctrie in the background.
+    compactor = compaction_start(ctrie, &config, &(threads_args[COMPACTOR_INDEX]));
+    if (compactor == NULL)
+    {
+        FAIL("Failed to start compaction");
+    }
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+int handle_restore(const char* path, thread_args_t threads_args[])
+{
+    int res = FAILED;
+    int64_t start_time = get_time();
+    if (checkpoint_restore(ctrie, path, &(threads_args[0])) != OK)
+    {
+        FAIL("Failed to restore checkpoint %s", path);
+    }
+    phase_result.nsecs = get_time() - start_time;
+    PERS_PRINT("Restore took %ld nsecs", phase_result.nsecs);
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+int handle_set_op(set_op_t op, const char* path, thread_args_t threads_args[])
+{
+    input_t     input   = { .fd = -1 };
+    inserts_t*  inserts = NULL;
+    ctrie_t*    other   = NULL;
+    ctrie_t*    result  = NULL;
+    int         res     = FAILED;
+    int i = 0;
+
+    if (input_open(&input, path, input_mode, sizeof(insert_t)) != OK)
+    {
+        FAIL("Failed to open file");
+    }
+    other = create_ctrie_with_config(&(ctrie->config));
+    if (other == NULL)
+    {
+        FAIL("Failed to create ctrie");
+    }
+    while ((inserts = input_next(&input)) != NULL)
+    {
+        for (i = 0; i < inserts->n; i++)
+        {
+            other->insert(other, inserts->inserts[i].key, inserts->inserts[i].value, &(threads_args[0]));
+        }
+        input_release(&input);
+    }
+    if (input.failed)
+    {
+        FAIL("Failed to read file");
+    }
+    int64_t start_time = get_time();
+    // Set operations require quiescent ctries.
+    stop_compaction();
+    result = ctrie_set_op(op, ctrie, other, num_of_threads);
+    if (result == NULL)
+    {
+        FAIL("Failed to apply set operation %d", op);
+    }
+    phase_result.nsecs = get_time() - start_time;
+    PERS_PRINT("Set operation %d took %ld nsecs, %ld entries", op, phase_result.nsecs, result->size);
+    stop_checkpoints();
+    ctrie->free(ctrie);
+    ctrie = result;
+    res = OK;
+
+CLEANUP:
+    if (other != NULL)
+    {
+        other->free(other);
+    }
+    input_close(&input);
+    return res;
+}
+
+typedef struct
+{
+    int64_t sum;
+    int64_t count;
+} sum_t;
+
+void sum_reduce(void* accumulator, int key, int value, void* arg)
+{
+    sum_t* sum = accumulator;
+    sum->sum += value;
+    sum->count++;
+}
+
+void sum_combine(void* accumulator, const void* other, void* arg)
+{
+    sum_t*       sum        = accumulator;
+    const sum_t* other_sum  = other;
+    sum->sum   += other_sum->sum;
+    sum->count += other_sum->count;
+}
+
+int handle_reduce(const char* num_of_workers, thread_args_t threads_args[])
+{
+    sum_t sum = {0};
+    int workers = atoi(num_of_workers);
+    int res = FAILED;
+    if (workers <= 0 || workers > NUM_OF_THREADS)
+    {
+        FAIL("Invalid number of workers: %s", num_of_workers);
+    }
+    int64_t start_time = get_time();
+    // Reducing requires a quiescent ctrie.
+    stop_compaction();
+    if (ctrie_parallel_reduce(ctrie, sum_reduce, sum_combine, &sum, sizeof(sum), NULL, threads_args, workers) != OK)
+    {
+        FAIL("Failed to reduce ctrie");
+    }
+    phase_result.nsecs = get_time() - start_time;
+    PERS_PRINT("Reduce took %ld nsecs", phase_result.nsecs);
+    PERS_PRINT("Reduce summed %ld values of %ld entries", sum.sum, sum.count);
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+int handle_inspect(const char* num_of_workers, thread_args_t threads_args[])
+{
+    ctrie_shape_t shape = {0};
+    int workers = atoi(num_of_workers);
+    int i = 0;
+    int res = FAILED;
+    if (workers <= 0 || workers > NUM_OF_THREADS)
+    {
+        FAIL("Invalid number of workers: %s", num_of_workers);
+    }
+    int64_t start_time = get_time();
+    // Inspecting requires a quiescent ctrie.
+    stop_compaction();
+    if (ctrie_inspect(ctrie, &shape, workers) != OK)
+    {
+        FAIL("Failed to inspect ctrie");
+    }
+    phase_result.nsecs = get_time() - start_time;
+    PERS_PRINT("Inspect took %ld nsecs", phase_result.nsecs);
+    PERS_PRINT("Entries %ld, INodes %ld, CNodes %ld, SNodes %ld, TNodes %ld, LNodes %ld, ~%ld bytes (%.1f per entry)",
+               shape.entries, shape.nodes[INODE], shape.nodes[CNODE], shape.nodes[SNODE], shape.nodes[TNODE],
+               shape.nodes[LNODE], shape.bytes, shape.entries > 0 ? (double) shape.bytes / shape.entries : 0.0);
+    for (i = 0; i <= MAX_BRANCHES; i++)
+    {
+        if (shape.fanout[i] > 0)
+        {
+            PERS_PRINT("Fan-out %2d: %ld CNodes", i, shape.fanout[i]);
+        }
+    }
+    for (i = 0; i <= MAX_LEVELS; i++)
+    {
+        if (shape.depth[i] > 0)
+        {
+            PERS_PRINT("Depth %d: %ld entries", i, shape.depth[i]);
+        }
+    }
+    for (i = 0; i <= INSPECT_MAX_CHAIN; i++)
+    {
+        if (shape.chain[i] > 0)
+        {
+            PERS_PRINT("Chain %s%d: %ld lnode-lists", i == INSPECT_MAX_CHAIN ? ">=" : "", i, shape.chain[i]);
+        }
+    }
+    res = OK;
+
+CLEANUP:
+    return res;
+}
+
+int handle_remove(const char* path, thread_args_t threads_args[])
+{
+    input_t    input   = { .fd = -1 };
+    removes_t* removes = NULL;
+    int64_t    time    = 0;
+    int64_t    ops     = 0;
+    int        res     = FAILED;
+
+    if (input_open(&input, path, input_mode, sizeof(remove_t)) != OK)
+    {
+        FAIL("Failed to open file");
+    }
+    reset_latencies();
+    // A streamed file is run chunk by chunk, the others at once.
+    while ((removes = input_next(&input)) != NULL)
+    {
+        int64_t part = remove_test(removes, threads_args);
+        if (part == -1)
+        {
+            FAIL("Failed to run the removes");
+        }
+        time    += part;
+        ops     += removes->n;
+        input_release(&input);
+    }
+    if (input.failed)
+    {
+        FAIL("Failed to read file");
+    }
+    PERS_PRINT("Remove took %ld nsecs", time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = ops;
+    report_latencies("Remove");
+    report_counters("Remove");
+    print_backoff_stats("Remove", threads_args);
+    print_restart_stats("Remove", threads_args);
+    print_reclamation_stats("Remove", threads_args);
+    print_input_stats("Remove", &input);
+    res = OK;
+
+CLEANUP:
+    input_close(&input);
+    return res;
+}
+
+int handle_action(const char* path, thread_args_t threads_args[])
+{
+    input_t    input   = { .fd = -1 };
+    actions_t* actions = NULL;
+    int64_t    time    = 0;
+    int64_t    ops     = 0;
+    int        res     = FAILED;
+
+    if (input_open(&input, path, input_mode, sizeof(action_t)) != OK)
+    {
+        FAIL("Failed to open file");
+    }
+    reset_latencies();
+    // A streamed file is run chunk by chunk, the others at once.
+    while ((actions = input_next(&input)) != NULL)
+    {
+        int64_t part = action_test(actions, NULL, threads_args, action_test_thread);
+        if (part == -1)
+        {
+            FAIL("Failed to run the actions");
+        }
+        time    += part;
+        ops     += actions->n;
+        input_release(&input);
+    }
+    if (input.failed)
+    {
+        FAIL("Failed to read file");
+    }
+    PERS_PRINT("Action took %ld nsecs", time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = ops;
+    report_latencies("Action");
+    report_counters("Action");
+    print_backoff_stats("Action", threads_args);
+    print_restart_stats("Action", threads_args);
+    print_reclamation_stats("Action", threads_args);
+    print_eviction_stats("Action", threads_args);
+    print_input_stats("Action", &input);
+    res = OK;
+
+CLEANUP:
+    input_close(&input);
+    return res;
+}
+
+/**
+ * Runs a generated workload, or with `load` inserts every key of its key space once.
+ * @param spec: the workload's specification, see workload_init.
+ * @param threads_args: the thread arguments.
+ * @param load: whether to load the key space rather than run the workload's operations.
+ * @return OK on success, otherwise FAILED.
+ **/
+int handle_workload(const char* spec, thread_args_t threads_args[], uint8_t load)
+{
+    workload_t  workload    = {0};
+    actions_t*  actions     = NULL;
+    actions_t   on_the_fly  = {0};
+    const char* name        = load ? "Load" : "Workload";
+    int64_t     time        = 0;
+    int         res         = FAILED;
+
+    if (workload_init(&workload, spec) != OK)
+    {
+        FAIL("Invalid workload: %s", spec);
+    }
+    if (load)
+    {
+        workload.config.ops             = workload.config.keys;
+        workload.config.distribution    = DIST_SEQUENTIAL;
+        workload.config.mix[INSERT]     = 100;
+        workload.config.mix[LOOKUP]     = 0;
+        workload.config.mix[REMOVE]     = 0;
+    }
+    if (workload.config.ops > INT32_MAX)
+    {
+        FAIL("Too many operations: %lu", workload.config.ops);
+    }
+    reset_latencies();
+    if (workload.config.on_the_fly)
+    {
+        // Only the number of actions is used.
+        on_the_fly.n = workload.config.ops;
+        time = action_test(&on_the_fly, &workload, threads_args, workload_test_thread);
+    }
+    else
+    {
+        actions = malloc(sizeof(actions_t) + workload.config.ops * sizeof(action_t));
+        if (actions == NULL)
+        {
+            FAIL("Failed to allocate %lu actions", workload.config.ops);
+        }
+        actions->n = workload.config.ops;
+        // The threads generate their own shares, before the timed run.
+        time = action_test(actions, &workload, threads_args, generate_test_thread);
+        PERS_PRINT("Generate took %ld nsecs", time);
+        phase_result.counters = (counter_totals_t) {0};
+        time = action_test(actions, NULL, threads_args, action_test_thread);
+    }
+    PERS_PRINT("%s took %ld nsecs", name, time);
+    phase_result.nsecs  = time;
+    phase_result.ops    = workload.config.ops;
+    report_latencies(name);
+    report_counters(name);
+    print_backoff_stats(name, threads_args);
+    print_restart_stats(name, threads_args);
+    print_reclamation_stats(name, threads_args);
+    print_eviction_stats(name, threads_args);
+    res = OK;
+
+CLEANUP:
+    if (actions != NULL)
+    {
+        free(actions);
+    }
+    return res;
+}
+
+/**
+ * @param action: a phase's action.
+ * @return whether the phase is made of inserts, lookups and removes only (or traces them), which the baseline maps support.
+ **/
+uint8_t is_map_phase(const char* action)
+{
+    static const char* map_phases[] = { "insert", "lookup", "remove", "action", "load", "workload", "trace" };
+    int i = 0;
+    for (i = 0; i < (int) (sizeof(map_phases) / sizeof(map_phases[0])); i++)
+    {
+        if (strcmp(action, map_phases[i]) == 0)
+        {
+            return 1;
+        }
     }
-
-    PERS_PRINT("Done");
     return 0;
 }
+
+/**
+ * Runs a single phase of the benchmark.
+ * @param action: the phase's action, e.g. insert.
+ * @param arg: the action's argument, e.g. the file of the inserts.
+ * @param threads_args: the thread arguments.
+ * @return OK on success, otherwise FAILED (also for an unknown action).
+ **/
+int handle_phase(const char* action, const char* arg, thread_args_t threads_args[])
+{
+    if (baseline != NULL && !is_map_phase(action))
+    {
+        FAIL("A baseline map can't run %s", action);
+    }
+    if (strcmp(action, "insert") == 0)
+    {
+        PRINT("Handle insert..");
+        if (handle_insert(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run insert %s", arg);
+        }
+        PRINT("Handled insert");
+    }
+    else if (strcmp(action, "lookup") == 0)
+    {
+        PRINT("Handle lookup..");
+        if (handle_lookup(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run lookup %s", arg);
+        }
+        PRINT("Handled lookup");
+    }
+    else if (strcmp(action, "flookup") == 0)
+    {
+        PRINT("Handle frozen lookup..");
+        if (handle_frozen_lookup(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run frozen lookup %s", arg);
+        }
+        PRINT("Handled frozen lookup");
+    }
+    else if (strcmp(action, "reduce") == 0)
+    {
+        PRINT("Handle reduce..");
+        if (handle_reduce(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run reduce %s", arg);
+        }
+        PRINT("Handled reduce");
+    }
+    else if (strcmp(action, "inspect") == 0)
+    {
+        PRINT("Handle inspect..");
+        if (handle_inspect(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run inspect %s", arg);
+        }
+        PRINT("Handled inspect");
+    }
+    else if (strcmp(action, "save") == 0)
+    {
+        PRINT("Handle save..");
+        if (handle_save(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run save %s", arg);
+        }
+        PRINT("Handled save");
+    }
+    else if (strcmp(action, "open") == 0)
+    {
+        PRINT("Handle open..");
+        if (handle_open(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run open %s", arg);
+        }
+        PRINT("Handled open");
+    }
+    else if (strcmp(action, "checkpoint") == 0)
+    {
+        PRINT("Handle checkpoint..");
+        if (handle_checkpoint(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run checkpoint %s", arg);
+        }
+        PRINT("Handled checkpoint");
+    }
+    else if (strcmp(action, "compact") == 0)
+    {
+        PRINT("Handle compact..");
+        if (handle_compact(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run compact %s", arg);
+        }
+        PRINT("Handled compact");
+    }
+    else if (strcmp(action, "restore") == 0)
+    {
+        PRINT("Handle restore..");
+        if (handle_restore(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run restore %s", arg);
+        }
+        PRINT("Handled restore");
+    }
+    else if (strcmp(action, "union") == 0 || strcmp(action, "intersect") == 0 || strcmp(action, "diff") == 0)
+    {
+        PRINT("Handle set operation..");
+        if (handle_set_op(action[0] == 'u' ? SET_UNION : action[0] == 'i' ? SET_INTERSECTION : SET_DIFFERENCE,
+                          arg, threads_args) != OK)
+        {
+            FAIL("Failed to run %s %s", action, arg);
+        }
+        PRINT("Handled set operation");
+    }
+    else if (strcmp(action, "remove") == 0)
+    {
+        PRINT("Handle remove..");
+        if (handle_remove(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run remove %s", arg);
+        }
+        PRINT("Handled remove");
+    }
+    else if (strcmp(action, "action") == 0)
+    {
+        PRINT("Handle action..");
+        if (handle_action(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run action %s", arg);
+        }
+        PRINT("Handled action");
+    }
+    else if (strcmp(action, "load") == 0 || strcmp(action, "workload") == 0)
+    {
+        PRINT("Handle workload..");
+        if (handle_workload(arg, threads_args, action[0] == 'l') != OK)
+        {
+            FAIL("Failed to run workload %s", arg);
+        }
+        PRINT("Handled workload");
+    }
+    else if (strcmp(action, "move") == 0)
+    {
+        PRINT("Handle move..");
+        if (handle_move(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run move %s", arg);
+        }
+        PRINT("Handled move");
+    }
+    else if (strcmp(action, "trace") == 0)
+    {
+        PRINT("Handle trace..");
+        if (handle_trace(arg, threads_args) != OK)
+        {
+            FAIL("Failed to run trace %s", arg);
+        }
+        PRINT("Handled trace");
+    }
+    else
+    {
+        FAIL("Unknown action: %s", action);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Creates the map of a run.
+ * @param type: the map's type, the ctrie or a baseline.
+ * @return OK on success, otherwise FAILED.
+ **/
+int create_map(map_type_t type)
+{
+    switch (type)
+    {
+    case MAP_CTRIE:
+        ctrie = create_ctrie();
+        return ctrie == NULL ? FAILED : OK;
+    case MAP_STRIPED:
+        baseline = create_striped_map();
+        break;
+    case MAP_SPLIT_ORDERED:
+        baseline = create_split_ordered_map();
+        break;
+    case MAP_RWLOCK:
+        baseline = create_rwlock_map();
+        break;
+    default:
+        FAIL("Unknown map %d", type);
+    }
+    return baseline == NULL ? FAILED : OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Ends a run of the phases: stops the background threads, frees the retired nodes and the map.
+ * @param threads_args: the thread arguments.
+ **/
+void end_run(thread_args_t threads_args[])
+{
+    int i = 0;
+    stop_checkpoints();
+    stop_compaction();
+    // Nodes retired during the last checkpoint are still deferred.
+    for (i = 0; i < NUM_OF_THREAD_ARGS; i++)
+    {
+        int j = 0;
+        release_deferred(&(threads_args[i]));
+        for (j = 0; j < threads_args[i].free_list->length; j++)
+        {
+            free(threads_args[i].free_list->free_list[j]);
+        }
+        threads_args[i].free_list->length = 0;
+    }
+
+    if (ctrie != NULL)
+    {
+        ctrie->free(ctrie);
+        ctrie = NULL;
+    }
+    if (baseline != NULL)
+    {
+        baseline->free(baseline);
+        baseline = NULL;
+    }
+    if (frozen != NULL)
+    {
+        frozen->free(frozen);
+        frozen = NULL;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bench_config_t config       = {0};
+    bench_report_t report       = {0};
+    int            first_phase  = 0;
+    uint32_t       count        = 0;
+    uint32_t       run          = 0;
+    // Every CPU number takes at most 4 digits and a comma.
+    char           cpu_map[NUM_OF_THREADS * 5 + 1] = {0};
+    memory_sampler_t sampler    = {0};
+    int            res          = OK;
+    int i = 0;
+
+    if (bench_parse_args(argc, argv, &config, &first_phase) != OK || ((argc - first_phase) & 1) != 0)
+    {
+        PRINT("Usage: %s [-t <num_of_threads,..>] [-w <warmups>] [-r <repetitions>] [-f <csv|json>] [-o <results_file>] [-i <read|mmap|populate|stream>] [-p <none|compact|scatter|cores>] [-m <ctrie|striped|split|rwlock>] [-T <trace_file>] [-M <sample_interval_ms>] [-O <threads_per_cpu,..>] [-P <none|yield|sleep>] [<insert|lookup|flookup|remove|action|move> <action_file> | <reduce|inspect> <num_of_workers> | <save|open> <image_file> | <checkpoint|restore> <checkpoint_file> | compact <interval_ms> | <union|intersect|diff> <insert_file> | <load|workload> <workload_spec> | trace <trace_file>]*", argv[0]);
+        return -1;
+    }
+    input_mode = config.input_mode;
+    memory_interval_ms = config.memory_interval_ms;
+    preempt_mode = config.preempt;
+    if (config.oversubscribe)
+    {
+        uint32_t cpus = placement_available_cpus();
+        PERS_PRINT("Oversubscribing %u CPUs", cpus);
+        for (count = 0; count < config.num_of_counts; count++)
+        {
+            config.threads[count] *= cpus;
+            if (config.threads[count] > NUM_OF_THREADS)
+            {
+                PERS_PRINT("Running %d threads instead of %u", NUM_OF_THREADS, config.threads[count]);
+                config.threads[count] = NUM_OF_THREADS;
+            }
+        }
+    }
+#if !PREEMPTION_INJECTION
+    if (preempt_mode != PREEMPT_NONE)
+    {
+        PERS_PRINT("Built without PREEMPTION_INJECTION, the operations aren't preempted");
+    }
+#endif
+    if (placement_init(&placement, config.placement) != OK)
+    {
+        PRINT("Failed to read the CPU topology");
+        return -1;
+    }
+
+    PERS_PRINT("Start");
+    trace_start(config.trace_path);
+    if (counters_available() == 0)
+    {
+        PERS_PRINT("Hardware counters are unavailable, they aren't reported");
+    }
+
+    hp_list_t*  hp_array[NUM_OF_THREAD_ARGS]    = {0};
+    hp_list_t   hp_lists[NUM_OF_THREAD_ARGS]    = {0};
+
+    for (i = 0; i < NUM_OF_THREAD_ARGS; i++)
+    {
+        hp_array[i] = &(hp_lists[i]);
+    }
+
+    free_list_t free_lists[NUM_OF_THREAD_ARGS]      = {0};
+    thread_args_t threads_args[NUM_OF_THREAD_ARGS]  = {0};
+    for (i = 0; i < NUM_OF_THREAD_ARGS; i++)
+    {
+        threads_args[i] = (thread_args_t) {
+            .hp_lists   = hp_array,
+            .free_list  = &(free_lists[i]),
+            .index      = i,
+            .num_of_threads = NUM_OF_THREAD_ARGS,
+        };
+    }
+
+    if (bench_open(&report, &config) != OK)
+    {
+        res = FAILED;
+        FAIL("Failed to open the results");
+    }
+
+    // Every thread count runs the phases `warmups + repetitions` times, each time on a new ctrie.
+    for (count = 0; count < config.num_of_counts; count++)
+    {
+        num_of_threads = config.threads[count];
+        placement_map(&placement, num_of_threads, cpu_map, sizeof(cpu_map));
+        PERS_PRINT("Setting up %d threads", num_of_threads);
+        if (placement.policy != PLACEMENT_NONE)
+        {
+            PERS_PRINT("Pinned to CPUs %s", cpu_map);
+        }
+        if (placement.policy != PLACEMENT_NONE && num_of_threads > placement.num_of_cpus)
+        {
+            PERS_PRINT("More threads than the %u CPUs, some share a CPU", placement.num_of_cpus);
+        }
+        for (run = 0; run < config.warmups + config.repetitions; run++)
+        {
+            // Neither the statistics nor the batched size changes carry over from the previous run.
+            for (i = 0; i < NUM_OF_THREAD_ARGS; i++)
+            {
+                threads_args[i].backoff     = (backoff_t) {0};
+                threads_args[i].eviction    = (eviction_t) {0};
+                threads_args[i].contention  = (contention_t) {0};
+                threads_args[i].preemption  = (preemption_t) {0};
+            }
+
+            if (create_map(config.map) != OK)
+            {
+                res = FAILED;
+                FAIL("Failed to create the map");
+            }
+
+            for (i = first_phase; i < argc; i += 2)
+            {
+                phase_result = (bench_result_t) {
+                    .map        = config.map,
+                    .threads    = num_of_threads,
+                    .placement  = placement.policy,
+                    .cpu_map    = cpu_map,
+                    .repetition = run - config.warmups,
+                    .phase      = (i - first_phase) / 2,
+                    .action     = argv[i],
+                    .arg        = argv[i + 1],
+                    .nsecs      = -1,
+                };
+                if (memory_interval_ms > 0 && memory_sampler_start(&sampler, memory_interval_ms) != OK)
+                {
+                    res = FAILED;
+                    FAIL("Failed to sample the memory");
+                }
+                res = handle_phase(argv[i], argv[i + 1], threads_args);
+                if (memory_interval_ms > 0)
+                {
+                    memory_sampler_stop(&sampler);
+                    report_memory(argv[i], threads_args, &sampler);
+                }
+                if (res != OK)
+                {
+                    // Printed even with NO_PRINT, the results file alone doesn't tell a failed phase from a missing one.
+                    PERS_PRINT("Failed to run phase %s %s", argv[i], argv[i + 1]);
+                    goto CLEANUP;
+                }
+                // Warm-ups and untimed phases (e.g. starting to checkpoint) aren't recorded.
+                if (run >= config.warmups && phase_result.nsecs >= 0)
+                {
+                    bench_record(&report, &phase_result);
+                }
+            }
+            end_run(threads_args);
+        }
+    }
+
+CLEANUP:
+    end_run(threads_args);
+    for (i = 0; i < NUM_OF_THREAD_ARGS; i++)
+    {
+        free(free_lists[i].deferred);
+    }
+    bench_close(&report);
+
+    PERS_PRINT("Done");
+    // A failed sweep must not pass for one whose results are all there.
+    return res == OK ? 0 : -1;
+}
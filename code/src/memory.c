@@ -0,0 +1,245 @@
+#include <errno.h>
+#include <malloc.h>
+#include <time.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "memory.h"
+
+#define STATM_PATH          "/proc/self/statm"
+#define CACHE_LINE_SIZE     (64)
+
+#if MEMORY_ACCOUNTING
+typedef struct
+{
+    memory_usage_t usage;
+} __attribute__((aligned(CACHE_LINE_SIZE))) memory_shard_t;
+
+static memory_shard_t   shards[MEMORY_SHARDS];
+static uint32_t         num_of_threads  = 0;
+// The shard of the calling thread plus 1, 0 until it first allocates.
+static __thread int     shard           = 0;
+
+// glibc's allocator, which the interposed functions count the allocations of.
+void* __libc_malloc  (size_t size);
+void* __libc_calloc  (size_t count, size_t size);
+void* __libc_realloc (void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void  __libc_free    (void* ptr);
+#endif
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+#if MEMORY_ACCOUNTING
+static void     account         (void* ptr, int64_t sign);
+#endif
+static void*    memory_sampler_main(memory_sampler_t* sampler);
+
+#if MEMORY_ACCOUNTING
+/**
+ * Counts an allocation, or a free, in the calling thread's shard.
+ * @param ptr: the allocation, NULL is ignored.
+ * @param sign: 1 for an allocation, -1 for a free.
+ **/
+static void account(void* ptr, int64_t sign)
+{
+    size_t  size    = 0;
+    int     class   = 0;
+    if (ptr == NULL)
+    {
+        return;
+    }
+    if (shard == 0)
+    {
+        shard = __sync_fetch_and_add(&num_of_threads, 1) % MEMORY_SHARDS + 1;
+    }
+    size    = malloc_usable_size(ptr);
+    class   = size / MEMORY_CLASS_BYTES < MEMORY_CLASSES ? size / MEMORY_CLASS_BYTES : MEMORY_CLASSES - 1;
+    __sync_fetch_and_add(&(shards[shard - 1].usage.bytes[class]), sign * (int64_t) size);
+    __sync_fetch_and_add(&(shards[shard - 1].usage.allocations[class]), sign);
+}
+
+void* malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size)
+{
+    void* ptr = __libc_calloc(count, size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    void*   new_ptr     = NULL;
+    // The old allocation is counted as freed before it may be, so no other thread reuses it uncounted.
+    account(ptr, -1);
+    new_ptr = __libc_realloc(ptr, size);
+    if (new_ptr == NULL && size > 0 && ptr != NULL)
+    {
+        // It wasn't freed after all.
+        account(ptr, 1);
+        return NULL;
+    }
+    account(new_ptr, 1);
+    return new_ptr;
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    void* ptr = __libc_memalign(alignment, size);
+    account(ptr, 1);
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+    *ptr = memalign(alignment, size);
+    return *ptr == NULL ? ENOMEM : 0;
+}
+
+void free(void* ptr)
+{
+    account(ptr, -1);
+    __libc_free(ptr);
+}
+#endif
+
+/**
+ * Adds up the live allocations of all the threads, which may allocate meanwhile.
+ * @param usage: an out parameter, set to the live allocations by class.
+ * @return OK, or FAILED if the allocations aren't counted (without MEMORY_ACCOUNTING).
+ **/
+int memory_usage(memory_usage_t* usage)
+{
+    memset(usage, 0, sizeof(*usage));
+#if MEMORY_ACCOUNTING
+    int i, class;
+    for (i = 0; i < MEMORY_SHARDS; i++)
+    {
+        for (class = 0; class < MEMORY_CLASSES; class++)
+        {
+            usage->bytes[class]         += shards[i].usage.bytes[class];
+            usage->allocations[class]   += shards[i].usage.allocations[class];
+        }
+    }
+    return OK;
+#else
+    return FAILED;
+#endif
+}
+
+/**
+ * @param size: the size of an allocation.
+ * @return the class the allocations of `size` bytes are counted in, or FAILED if the allocation failed.
+ **/
+int memory_class(size_t size)
+{
+    void*   ptr     = malloc(size);
+    int     class   = 0;
+    if (ptr == NULL)
+    {
+        return FAILED;
+    }
+    class = malloc_usable_size(ptr) / MEMORY_CLASS_BYTES;
+    free(ptr);
+    return class < MEMORY_CLASSES ? class : MEMORY_CLASSES - 1;
+}
+
+/**
+ * @return the bytes allocated by malloc and not freed yet, by the allocator's own count.
+ **/
+uint64_t memory_heap_bytes()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+/**
+ * @return the resident set size of the process in bytes, 0 if it can't be read.
+ **/
+uint64_t memory_rss()
+{
+    char    buffer[128] = {0};
+    long    size        = 0;
+    long    resident    = 0;
+    ssize_t length      = 0;
+    int     fd          = open(STATM_PATH, O_RDONLY);
+    if (fd == -1)
+    {
+        return 0;
+    }
+    length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0 || sscanf(buffer, "%ld %ld", &size, &resident) != 2)
+    {
+        return 0;
+    }
+    return (uint64_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+static void* memory_sampler_main(memory_sampler_t* sampler)
+{
+    struct timespec interval = { .tv_sec = sampler->interval_ms / 1000, .tv_nsec = (sampler->interval_ms % 1000) * 1000000L };
+    while (!sampler->stop)
+    {
+        sampler->last_rss = memory_rss();
+        if (sampler->last_rss > sampler->peak_rss)
+        {
+            sampler->peak_rss = sampler->last_rss;
+        }
+        sampler->samples++;
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Starts a thread which samples the resident set size every `interval_ms`, until memory_sampler_stop.
+ * @param sampler: the sampler.
+ * @param interval_ms: the interval between the samples.
+ * @return OK on success, otherwise FAILED.
+ **/
+int memory_sampler_start(memory_sampler_t* sampler, uint32_t interval_ms)
+{
+    *sampler = (memory_sampler_t) { .interval_ms = interval_ms };
+    if (pthread_create(&(sampler->tid), NULL, (void*(*)(void*)) memory_sampler_main, sampler) != 0)
+    {
+        FAIL("Failed to start the memory sampler");
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Stops the sampler, the last sample is taken now.
+ * @param sampler: the sampler.
+ **/
+void memory_sampler_stop(memory_sampler_t* sampler)
+{
+    sampler->stop = 1;
+    pthread_join(sampler->tid, NULL);
+    sampler->last_rss = memory_rss();
+    if (sampler->last_rss > sampler->peak_rss)
+    {
+        sampler->peak_rss = sampler->last_rss;
+    }
+    sampler->samples++;
+}
@@ -0,0 +1,378 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "nodes.h"
+#include "common.h"
+#include "ctrie.h"
+#include "backoff.h"
+#include "hazard_pointer.h"
+#include "parallel.h"
+
+/**
+ * A Chase-Lev work-stealing deque of INodes still to be walked.
+ * The owner pushes and pops at the bottom, thieves steal from the top.
+ **/
+typedef struct
+{
+    volatile int64_t    top;
+    volatile int64_t    bottom;
+    inode_t*            tasks[PARALLEL_DEQUE_SIZE];
+} deque_t;
+
+typedef struct parallel_job_t parallel_job_t;
+
+typedef struct
+{
+    parallel_job_t* job;
+    deque_t         deque;
+    void*           accumulator;
+    uint32_t        seed;
+} worker_t;
+
+struct parallel_job_t
+{
+    ctrie_foreach_fn_t  foreach;
+    ctrie_reduce_fn_t   reduce;
+    ctrie_combine_fn_t  combine;
+    void*               arg;
+    worker_t*           workers;
+    int                 num_of_workers;
+    // The number of INodes which were pushed but not walked yet, the walk is over when it drops to 0.
+    volatile int64_t    pending;
+};
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static void     deque_push (deque_t* deque, inode_t* inode);
+static inode_t* deque_pop  (deque_t* deque);
+static inode_t* deque_steal(deque_t* deque);
+
+static void     visit      (worker_t* worker, snode_t* snode);
+static void     walk_inode (worker_t* worker, inode_t* inode);
+static inode_t* next_task  (worker_t* worker);
+static void*    worker_main(worker_t* worker);
+static int      parallel_walk(ctrie_t* ctrie, parallel_job_t* job, void* accumulator, size_t accumulator_size,
+                              thread_args_t threads_args[], int num_of_threads);
+
+/**
+ * Pushes `inode` to the bottom of the deque.
+ * @param deque: the worker's own deque.
+ * @param inode: the inode to push.
+ * @note must only be called by the deque's owner.
+ **/
+static void deque_push(deque_t* deque, inode_t* inode)
+{
+    int64_t bottom = deque->bottom;
+    deque->tasks[bottom & (PARALLEL_DEQUE_SIZE - 1)] = inode;
+    FENCE;
+    deque->bottom = bottom + 1;
+}
+
+/**
+ * Pops the newest inode from the bottom of the deque.
+ * @param deque: the worker's own deque.
+ * @return the popped inode, or NULL if the deque is empty (or its last inode was stolen).
+ * @note must only be called by the deque's owner.
+ **/
+static inode_t* deque_pop(deque_t* deque)
+{
+    int64_t  bottom = deque->bottom - 1;
+    int64_t  top    = 0;
+    inode_t* inode  = NULL;
+
+    deque->bottom = bottom;
+    FENCE;
+    top = deque->top;
+    if (top > bottom)
+    {
+        deque->bottom = bottom + 1;
+        return NULL;
+    }
+    inode = deque->tasks[bottom & (PARALLEL_DEQUE_SIZE - 1)];
+    if (top == bottom)
+    {
+        // The last inode, race the thieves for it.
+        if (!__sync_bool_compare_and_swap(&(deque->top), top, top + 1))
+        {
+            inode = NULL;
+        }
+        deque->bottom = bottom + 1;
+    }
+    return inode;
+}
+
+/**
+ * Steals the oldest inode from the top of another worker's deque.
+ * The oldest inodes are the shallowest, so a thief takes the largest subtrees.
+ * @param deque: the victim's deque.
+ * @return the stolen inode, or NULL if the deque is empty or another thief won.
+ **/
+static inode_t* deque_steal(deque_t* deque)
+{
+    int64_t  top    = deque->top;
+    int64_t  bottom = 0;
+    inode_t* inode  = NULL;
+
+    FENCE;
+    bottom = deque->bottom;
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    inode = deque->tasks[top & (PARALLEL_DEQUE_SIZE - 1)];
+    if (!__sync_bool_compare_and_swap(&(deque->top), top, top + 1))
+    {
+        return NULL;
+    }
+    return inode;
+}
+
+/**
+ * Passes an entry to the job's foreach or reduce function.
+ * @param worker: the worker.
+ * @param snode: the entry.
+ **/
+static void visit(worker_t* worker, snode_t* snode)
+{
+    parallel_job_t* job = worker->job;
+    if (job->foreach != NULL)
+    {
+        job->foreach(snode->key, snode->value, job->arg);
+    }
+    else
+    {
+        job->reduce(worker->accumulator, snode->key, snode->value, job->arg);
+    }
+}
+
+/**
+ * Visits the entries held directly by `inode`, and pushes its child INodes as new tasks.
+ * @param worker: the worker.
+ * @param inode: the inode to walk.
+ **/
+static void walk_inode(worker_t* worker, inode_t* inode)
+{
+    main_node_t* main_node  = inode->main;
+    lnode_t*     lnode      = NULL;
+    cnode_t*     cnode      = NULL;
+    uint32_t     inner      = 0;
+    int i = 0;
+
+    switch (main_node->type)
+    {
+    case CNODE:
+        cnode = &(main_node->node.cnode);
+        for (i = 0; i < MAX_BRANCHES; i++)
+        {
+            if ((cnode->bmp & (1 << i)) && cnode->array[i]->type == INODE)
+            {
+                inner++;
+            }
+        }
+        // Account for the children before they can be stolen, this inode is done once they are pushed.
+        if (inner != 1)
+        {
+            __sync_fetch_and_add(&(worker->job->pending), (int64_t) inner - 1);
+        }
+        for (i = 0; i < MAX_BRANCHES; i++)
+        {
+            if ((cnode->bmp & (1 << i)) == 0)
+            {
+                continue;
+            }
+            if (cnode->array[i]->type == INODE)
+            {
+                deque_push(&(worker->deque), &(cnode->array[i]->node.inode));
+            }
+            else
+            {
+                visit(worker, &(cnode->array[i]->node.snode));
+            }
+        }
+        return;
+    case TNODE:
+        // A tomb is logically an snode of its parent.
+        visit(worker, &(main_node->node.tnode.snode));
+        break;
+    case LNODE:
+        for (lnode = &(main_node->node.lnode); lnode != NULL; lnode = lnode->next)
+        {
+            visit(worker, &(lnode->snode));
+        }
+        break;
+    default:
+        break;
+    }
+    __sync_fetch_and_sub(&(worker->job->pending), 1);
+}
+
+/**
+ * Finds the next task of a worker, from its own deque or by stealing from a random victim.
+ * @param worker: the worker.
+ * @return the next inode to walk, or NULL if the walk is over.
+ **/
+static inode_t* next_task(worker_t* worker)
+{
+    parallel_job_t* job     = worker->job;
+    inode_t*        inode   = deque_pop(&(worker->deque));
+    int             i       = 0;
+
+    while (inode == NULL && job->pending > 0)
+    {
+        int victim = xorshift32(&(worker->seed)) % job->num_of_workers;
+        for (i = 0; i < job->num_of_workers && inode == NULL; i++)
+        {
+            inode = deque_steal(&(job->workers[(victim + i) % job->num_of_workers].deque));
+        }
+        if (inode == NULL)
+        {
+            // Leave the CPU to the workers which still have tasks.
+            CPU_RELAX;
+            sched_yield();
+        }
+    }
+    return inode;
+}
+
+/**
+ * The body of a worker thread.
+ * @param worker: the worker.
+ * @return NULL.
+ **/
+static void* worker_main(worker_t* worker)
+{
+    inode_t* inode = NULL;
+    while ((inode = next_task(worker)) != NULL)
+    {
+        walk_inode(worker, inode);
+    }
+    return NULL;
+}
+
+/**
+ * Walks the whole ctrie with `num_of_threads` work-stealing workers.
+ * The root is the first task, and every walked INode pushes its child INodes as new tasks. Idle workers steal the
+ * shallowest pending INodes, so the walk stays balanced even when the keys are skewed into a few subtrees.
+ * @param ctrie: the ctrie.
+ * @param job: the job, its function and arguments must be set.
+ * @param accumulator: for reduce, the identity accumulator which is set to the result, otherwise NULL.
+ * @param accumulator_size: the size of the accumulator.
+ * @param threads_args: the thread arguments, one per worker.
+ * @param num_of_threads: the number of workers.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int parallel_walk(ctrie_t* ctrie, parallel_job_t* job, void* accumulator, size_t accumulator_size,
+                         thread_args_t threads_args[], int num_of_threads)
+{
+    pthread_t*  tids         = NULL;
+    char*       accumulators = NULL;
+    int         res         = FAILED;
+    int         started     = 0;
+    uint8_t     readonly    = ctrie->readonly;
+    int i = 0;
+
+    job->workers        = calloc(num_of_threads, sizeof(worker_t));
+    tids                = calloc(num_of_threads, sizeof(pthread_t));
+    job->num_of_workers = num_of_threads;
+    job->pending        = 1;
+    if (job->workers == NULL || tids == NULL)
+    {
+        FAIL("Failed to allocate %d workers", num_of_threads);
+    }
+    if (accumulator != NULL)
+    {
+        accumulators = malloc(num_of_threads * accumulator_size);
+        if (accumulators == NULL)
+        {
+            FAIL("Failed to allocate %d accumulators", num_of_threads);
+        }
+    }
+    for (i = 0; i < num_of_threads; i++)
+    {
+        worker_t* worker    = &(job->workers[i]);
+        worker->job         = job;
+        // Knuth's multiplicative hash, so every worker picks different victims.
+        worker->seed        = 2654435761u * (uint32_t) (threads_args[i].index + 1);
+        if (accumulators != NULL)
+        {
+            worker->accumulator = accumulators + i * accumulator_size;
+            memcpy(worker->accumulator, accumulator, accumulator_size);
+        }
+    }
+
+    // Nothing is retired while the ctrie is readonly, so the workers need no hazard pointers.
+    ctrie->readonly = 1;
+    deque_push(&(job->workers[0].deque), ctrie->inode);
+    for (started = 0; started < num_of_threads; started++)
+    {
+        if (pthread_create(&(tids[started]), NULL, (void*(*)(void*)) worker_main, &(job->workers[started])) != 0)
+        {
+            // The started workers can still finish the walk.
+            PRINT("Failed to start worker %d", started);
+            if (started == 0)
+            {
+                goto CLEANUP;
+            }
+            break;
+        }
+    }
+    res = OK;
+
+CLEANUP:
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    ctrie->readonly = readonly;
+    if (res == OK && accumulators != NULL)
+    {
+        for (i = 0; i < num_of_threads; i++)
+        {
+            job->combine(accumulator, job->workers[i].accumulator, job->arg);
+        }
+    }
+    free_them_all(3, tids, accumulators, job->workers);
+    return res;
+}
+
+/**
+ * Calls `foreach` on every entry of the ctrie, in parallel and in no particular order.
+ * @param ctrie: the ctrie.
+ * @param foreach: the function to call, it may be called concurrently from all the workers.
+ * @param arg: an argument passed to `foreach`.
+ * @param threads_args: the thread arguments, one per worker.
+ * @param num_of_threads: the number of workers.
+ * @return OK on success, otherwise FAILED.
+ * @note the ctrie must be quiescent, it is readonly during the walk.
+ **/
+int ctrie_parallel_foreach(ctrie_t* ctrie, ctrie_foreach_fn_t foreach, void* arg, thread_args_t threads_args[], int num_of_threads)
+{
+    parallel_job_t job = { .foreach = foreach, .arg = arg };
+    return parallel_walk(ctrie, &job, NULL, 0, threads_args, num_of_threads);
+}
+
+/**
+ * Reduces all the entries of the ctrie, in parallel.
+ * Every worker folds its entries into its own copy of `accumulator` with `reduce`, and the copies are then folded into
+ * `accumulator` with `combine`, so both should be associative and commutative.
+ * @param ctrie: the ctrie.
+ * @param reduce: folds an entry into a worker's accumulator.
+ * @param combine: folds a worker's accumulator into `accumulator`.
+ * @param accumulator: in-out parameter, the identity accumulator on input and the result on output.
+ * @param accumulator_size: the size of the accumulator.
+ * @param arg: an argument passed to `reduce` and `combine`.
+ * @param threads_args: the thread arguments, one per worker.
+ * @param num_of_threads: the number of workers.
+ * @return OK on success, otherwise FAILED.
+ * @note the ctrie must be quiescent, it is readonly during the walk.
+ **/
+int ctrie_parallel_reduce(ctrie_t* ctrie, ctrie_reduce_fn_t reduce, ctrie_combine_fn_t combine, void* accumulator, size_t accumulator_size,
+                          void* arg, thread_args_t threads_args[], int num_of_threads)
+{
+    parallel_job_t job = { .reduce = reduce, .combine = combine, .arg = arg };
+    return parallel_walk(ctrie, &job, accumulator, accumulator_size, threads_args, num_of_threads);
+}
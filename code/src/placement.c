@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "placement.h"
+
+#define TOPOLOGY_PATH           "/sys/devices/system/cpu/cpu%d/topology/%s"
+// The CPU quota of the process' cgroup, "<quota> <period>" or "max <period>" (v2), or in two files (v1).
+#define CGROUP_CPU_MAX_PATH     "/sys/fs/cgroup/cpu.max"
+#define CGROUP_CFS_QUOTA_PATH   "/sys/fs/cgroup/cpu/cpu.cfs_quota_us"
+#define CGROUP_CFS_PERIOD_PATH  "/sys/fs/cgroup/cpu/cpu.cfs_period_us"
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int  read_topology   (int cpu, const char* name, int missing);
+static int  read_cpu_quota  (long* quota, long* period);
+static int  compare_cpus    (const placement_cpu_t* first, const placement_cpu_t* second, const int keys[3][3]);
+static int  compare_compact (const void* first, const void* second);
+static int  compare_scatter (const void* first, const void* second);
+static int  compare_cores   (const void* first, const void* second);
+
+// The fields the CPUs are ordered by, most significant first: 0 package, 1 core rank, 2 sibling.
+static const int compact_keys[3][3]  = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} };
+static const int scatter_keys[3][3]  = { {0, 0, 1}, {0, 1, 0}, {1, 0, 0} };
+static const int cores_keys[3][3]    = { {0, 0, 1}, {1, 0, 0}, {0, 1, 0} };
+
+/**
+ * Reads a number from the topology of a CPU in sysfs.
+ * @param cpu: the CPU.
+ * @param name: the topology file, e.g. core_id.
+ * @param missing: the number to return if the file can't be read (e.g. outside of Linux' sysfs).
+ * @return the number.
+ **/
+static int read_topology(int cpu, const char* name, int missing)
+{
+    char  path[128] = {0};
+    FILE* fp        = NULL;
+    int   value     = missing;
+    snprintf(path, sizeof(path), TOPOLOGY_PATH, cpu, name);
+    fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return missing;
+    }
+    if (fscanf(fp, "%d", &value) != 1)
+    {
+        value = missing;
+    }
+    fclose(fp);
+    return value;
+}
+
+/**
+ * Reads the CPU quota of the process' cgroup.
+ * @param quota: an out parameter, set to the CPU time the cgroup may use every period.
+ * @param period: an out parameter, set to the period.
+ * @return OK if the cgroup has a quota, otherwise FAILED.
+ **/
+static int read_cpu_quota(long* quota, long* period)
+{
+    FILE* fp = fopen(CGROUP_CPU_MAX_PATH, "r");
+    if (fp != NULL)
+    {
+        // An unlimited cgroup's quota is "max", which isn't read.
+        int res = fscanf(fp, "%ld %ld", quota, period) == 2 ? OK : FAILED;
+        fclose(fp);
+        return res == OK && *quota > 0 && *period > 0 ? OK : FAILED;
+    }
+    fp = fopen(CGROUP_CFS_QUOTA_PATH, "r");
+    if (fp == NULL)
+    {
+        return FAILED;
+    }
+    if (fscanf(fp, "%ld", quota) != 1)
+    {
+        *quota = -1;
+    }
+    fclose(fp);
+    fp = fopen(CGROUP_CFS_PERIOD_PATH, "r");
+    if (fp == NULL)
+    {
+        return FAILED;
+    }
+    if (fscanf(fp, "%ld", period) != 1)
+    {
+        *period = -1;
+    }
+    fclose(fp);
+    return *quota > 0 && *period > 0 ? OK : FAILED;
+}
+
+static int compare_cpus(const placement_cpu_t* first, const placement_cpu_t* second, const int keys[3][3])
+{
+    int i = 0;
+    for (i = 0; i < 3; i++)
+    {
+        int a = keys[i][0] * first->package + keys[i][1] * first->core_rank + keys[i][2] * first->sibling;
+        int b = keys[i][0] * second->package + keys[i][1] * second->core_rank + keys[i][2] * second->sibling;
+        if (a != b)
+        {
+            return a < b ? -1 : 1;
+        }
+    }
+    return first->cpu - second->cpu;
+}
+
+static int compare_compact(const void* first, const void* second)
+{
+    return compare_cpus(first, second, compact_keys);
+}
+
+static int compare_scatter(const void* first, const void* second)
+{
+    return compare_cpus(first, second, scatter_keys);
+}
+
+static int compare_cores(const void* first, const void* second)
+{
+    return compare_cpus(first, second, cores_keys);
+}
+
+/**
+ * Finds the CPUs the process may run on and orders them by a placement policy.
+ * @param placement: the placement.
+ * @param policy: the policy.
+ * @return OK on success, otherwise FAILED.
+ **/
+int placement_init(placement_t* placement, placement_policy_t policy)
+{
+    cpu_set_t allowed = {0};
+    int cpu = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    placement->policy       = policy;
+    placement->num_of_cpus  = 0;
+    if (policy == PLACEMENT_NONE)
+    {
+        return OK;
+    }
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        FAIL("Failed to get the CPUs of the process");
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE && placement->num_of_cpus < PLACEMENT_MAX_CPUS; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+        {
+            continue;
+        }
+        placement->cpus[placement->num_of_cpus++] = (placement_cpu_t) {
+            .cpu        = cpu,
+            .package    = read_topology(cpu, "physical_package_id", 0),
+            // Without a topology every CPU is a core of its own.
+            .core       = read_topology(cpu, "core_id", cpu),
+        };
+    }
+    // CPUs are visited in ascending order, so the siblings before a CPU have lower numbers.
+    for (i = 0; i < placement->num_of_cpus; i++)
+    {
+        placement_cpu_t* current = &(placement->cpus[i]);
+        for (j = 0; j < i; j++)
+        {
+            placement_cpu_t* other = &(placement->cpus[j]);
+            if (other->package == current->package && other->core == current->core)
+            {
+                current->sibling++;
+            }
+        }
+    }
+    for (i = 0; i < placement->num_of_cpus; i++)
+    {
+        placement_cpu_t* current = &(placement->cpus[i]);
+        for (j = 0; j < placement->num_of_cpus; j++)
+        {
+            placement_cpu_t* other = &(placement->cpus[j]);
+            if (other->package == current->package && other->sibling == 0 && other->core < current->core)
+            {
+                current->core_rank++;
+            }
+        }
+    }
+    switch (policy)
+    {
+    case PLACEMENT_COMPACT:
+        qsort(placement->cpus, placement->num_of_cpus, sizeof(placement_cpu_t), compare_compact);
+        break;
+    case PLACEMENT_SCATTER:
+        qsort(placement->cpus, placement->num_of_cpus, sizeof(placement_cpu_t), compare_scatter);
+        break;
+    case PLACEMENT_CORES:
+        qsort(placement->cpus, placement->num_of_cpus, sizeof(placement_cpu_t), compare_cores);
+        break;
+    default:
+        FAIL("Unknown placement policy %d", policy);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * @param placement: the placement.
+ * @param thread: the thread's index.
+ * @return the CPU the thread is placed on, or -1 if it isn't pinned. Threads beyond the CPUs wrap around.
+ **/
+int placement_cpu(const placement_t* placement, uint32_t thread)
+{
+    if (placement->policy == PLACEMENT_NONE || placement->num_of_cpus == 0)
+    {
+        return -1;
+    }
+    return placement->cpus[thread % placement->num_of_cpus].cpu;
+}
+
+/**
+ * Pins the threads created with `attr` to the CPU of a thread.
+ * @param placement: the placement.
+ * @param thread: the thread's index.
+ * @param attr: initialized attributes, left as they are if the thread isn't pinned.
+ * @return OK on success, otherwise FAILED.
+ **/
+int placement_attr(const placement_t* placement, uint32_t thread, pthread_attr_t* attr)
+{
+    cpu_set_t cpus = {0};
+    int cpu = placement_cpu(placement, thread);
+    if (cpu == -1)
+    {
+        return OK;
+    }
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus) != 0)
+    {
+        FAIL("Failed to pin thread %u to CPU %d", thread, cpu);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Counts the CPUs the process can keep busy: those it may run on, or fewer if its cgroup is throttled to fewer.
+ * @return the number of CPUs, at least 1.
+ **/
+uint32_t placement_available_cpus()
+{
+    cpu_set_t allowed   = {0};
+    uint32_t  cpus      = 1;
+    long      quota     = 0;
+    long      period    = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed) > 0)
+    {
+        cpus = CPU_COUNT(&allowed);
+    }
+    if (read_cpu_quota(&quota, &period) == OK && (uint32_t) ((quota + period - 1) / period) < cpus)
+    {
+        // A partial CPU still runs a thread.
+        cpus = (quota + period - 1) / period;
+    }
+    return cpus;
+}
+
+/**
+ * Writes the CPUs of the threads, e.g. "0,2,4,6", or an empty string if they aren't pinned.
+ * @param placement: the placement.
+ * @param num_of_threads: the number of threads.
+ * @param buffer: the buffer, truncated if it's too small.
+ * @param size: the buffer's size.
+ **/
+void placement_map(const placement_t* placement, uint32_t num_of_threads, char* buffer, size_t size)
+{
+    size_t   length = 0;
+    uint32_t i      = 0;
+    if (size == 0)
+    {
+        return;
+    }
+    buffer[0] = '\0';
+    for (i = 0; i < num_of_threads && placement_cpu(placement, i) != -1 && length < size; i++)
+    {
+        length += snprintf(buffer + length, size - length, i == 0 ? "%d" : ",%d", placement_cpu(placement, i));
+    }
+}
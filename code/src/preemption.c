@@ -0,0 +1,36 @@
+#include <sched.h>
+#include <time.h>
+
+#include "common.h"
+#include "preemption.h"
+
+// How the operations are preempted, set before the workers start.
+preempt_mode_t preempt_mode = PREEMPT_NONE;
+
+/**
+ * Preempts the calling thread once in PREEMPTION_ONE_IN calls, at random.
+ * @param preemption: the thread's preemption state.
+ * @param index: the thread's index, seeds its generator on first use.
+ **/
+void preempt(preemption_t* preemption, int index)
+{
+    struct timespec duration = { .tv_sec = 0, .tv_nsec = PREEMPTION_SLEEP_NSECS };
+    if (preemption->seed == 0)
+    {
+        // Knuth's multiplicative hash, so every thread gets a different (non zero) sequence.
+        preemption->seed = 2654435761u * (uint32_t) (index + 1);
+    }
+    if (xorshift32(&(preemption->seed)) % PREEMPTION_ONE_IN != 0)
+    {
+        return;
+    }
+    preemption->preemptions++;
+    if (preempt_mode == PREEMPT_YIELD)
+    {
+        sched_yield();
+    }
+    else
+    {
+        nanosleep(&duration, NULL);
+    }
+}
@@ -0,0 +1,569 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "nodes.h"
+#include "common.h"
+#include "ctrie.h"
+#include "set_ops.h"
+
+#define SIDE_EMPTY(side)    ((side).main == NULL && (side).snode == NULL)
+#define SIDE_CNODE(side)    ((side).main != NULL && (side).main->type == CNODE)
+
+/**
+ * What one ctrie holds at some position: a cnode, an lnode-list, a single entry or nothing.
+ * Tombs are read as the single entry they hold.
+ **/
+typedef struct
+{
+    main_node_t*    main;
+    snode_t*        snode;
+} side_t;
+
+typedef struct
+{
+    set_op_t            op;
+    side_t              left;
+    side_t              right;
+    // The root cnode of the result, every worker fills the positions it takes.
+    cnode_t*            root;
+    volatile int        next_pos;
+    volatile uint8_t    failed;
+} set_job_t;
+
+typedef struct
+{
+    set_job_t*  job;
+    int64_t     size;
+} set_worker_t;
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static side_t       side_of_branch(branch_t* branch);
+static side_t       side_child    (side_t side, int pos, uint32_t lev);
+static int          side_entries  (side_t side, snode_t** entries, int* count);
+
+static int          finish_cnode  (cnode_t* cnode, branch_t** out);
+static int          build         (snode_t* entries, int count, uint32_t lev, branch_t** out, int64_t* size);
+static int          build_lnode   (snode_t* entries, int count, branch_t** out, int64_t* size);
+static int          merge_entries (set_op_t op, side_t left, side_t right, uint32_t lev, branch_t** out, int64_t* size);
+static int          merge         (set_op_t op, side_t left, side_t right, uint32_t lev, branch_t** out, int64_t* size);
+static void*        set_worker_main(set_worker_t* worker);
+
+/**
+ * Reads a branch as a side.
+ * @param branch: the branch.
+ * @return the side the branch holds.
+ **/
+static side_t side_of_branch(branch_t* branch)
+{
+    if (branch->type == SNODE)
+    {
+        return (side_t) { .snode = &(branch->node.snode) };
+    }
+    main_node_t* main_node = branch->node.inode.main;
+    if (main_node->type == TNODE)
+    {
+        return (side_t) { .snode = &(main_node->node.tnode.snode) };
+    }
+    return (side_t) { .main = main_node };
+}
+
+/**
+ * Finds what a side holds at a position of the next level. A single entry is its own child at its hash position.
+ * @param side: a cnode or a single entry.
+ * @param pos: the position.
+ * @param lev: the hash level of the side.
+ * @return the side's child at `pos`.
+ **/
+static side_t side_child(side_t side, int pos, uint32_t lev)
+{
+    side_t empty = {0};
+    if (side.snode != NULL)
+    {
+        return ((ctrie_hash(side.snode->key) >> lev) & 0x1f) == pos ? side : empty;
+    }
+    if (side.main != NULL && (side.main->node.cnode.bmp & (1 << pos)))
+    {
+        return side_of_branch(side.main->node.cnode.array[pos]);
+    }
+    return empty;
+}
+
+/**
+ * Copies the entries of a side which is not a cnode.
+ * @param side: a single entry, an lnode-list or nothing.
+ * @param entries: an out parameter that is set to the allocated entries.
+ * @param count: an out parameter that is set to the number of entries.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int side_entries(side_t side, snode_t** entries, int* count)
+{
+    lnode_t* lnode = NULL;
+    int i = 0;
+
+    *entries = NULL;
+    *count   = 0;
+    if (side.snode != NULL)
+    {
+        *count = 1;
+    }
+    else if (side.main != NULL)
+    {
+        for (lnode = &(side.main->node.lnode); lnode != NULL; lnode = lnode->next)
+        {
+            (*count)++;
+        }
+    }
+    if (*count == 0)
+    {
+        return OK;
+    }
+    *entries = malloc(*count * sizeof(snode_t));
+    if (*entries == NULL)
+    {
+        FAIL("Failed to allocate %d entries", *count);
+    }
+    if (side.snode != NULL)
+    {
+        (*entries)[0] = *(side.snode);
+        return OK;
+    }
+    for (lnode = &(side.main->node.lnode); lnode != NULL; lnode = lnode->next, i++)
+    {
+        (*entries)[i] = lnode->snode;
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Turns a cnode built below the root into a branch, contracted the way the ctrie does: an empty cnode is dropped,
+ * and a cnode with a single entry is replaced by the entry.
+ * @param cnode: the built cnode.
+ * @param out: an out parameter that is set to the branch, or to NULL if the cnode is empty.
+ * @return OK on success, otherwise FAILED (and the cnode's children are leaked).
+ **/
+static int finish_cnode(cnode_t* cnode, branch_t** out)
+{
+    main_node_t* main_node = NULL;
+
+    *out = NULL;
+    if (cnode->length == 0)
+    {
+        return OK;
+    }
+    if (cnode->length == 1 && cnode->array[highest_on_bit(cnode->bmp)]->type == SNODE)
+    {
+        *out = cnode->array[highest_on_bit(cnode->bmp)];
+        return OK;
+    }
+    MALLOC(*out, branch_t);
+    MALLOC(main_node, main_node_t);
+    main_node->type         = CNODE;
+    main_node->node.cnode   = *cnode;
+    (*out)->type            = INODE;
+    (*out)->node.inode.main = main_node;
+    return OK;
+
+CLEANUP:
+    free(*out);
+    *out = NULL;
+    PRINT("Leaked a cnode of %d branches", cnode->length);
+    return FAILED;
+}
+
+/**
+ * Builds the subtree which holds `entries`.
+ * @param entries: the entries, all of them have the hash bits which lead to `lev`.
+ * @param count: the number of entries.
+ * @param lev: the hash level of the subtree.
+ * @param out: an out parameter that is set to the subtree's branch, or to NULL if it is empty.
+ *             On failure it is set to the part that was built, which is a valid subtree.
+ * @param size: in-out parameter, incremented by the number of entries.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int build(snode_t* entries, int count, uint32_t lev, branch_t** out, int64_t* size)
+{
+    snode_t     small[MAX_BRANCHES];
+    snode_t*    group   = NULL;
+    cnode_t     cnode;
+    int         res     = OK;
+    int pos = 0;
+    int i = 0;
+
+    *out = NULL;
+    if (count == 0)
+    {
+        return OK;
+    }
+    if (count == 1)
+    {
+        MALLOC(*out, branch_t);
+        (*out)->type                    = SNODE;
+        (*out)->node.snode              = entries[0];
+        (*out)->node.snode.sealed       = 0;
+        (*out)->node.snode.referenced   = 0;
+        (*size)++;
+        return OK;
+    }
+    if (lev >= MAX_BRANCHES)
+    {
+        return build_lnode(entries, count, out, size);
+    }
+
+    // Most calls end at a single entry, so the cnode is cleared only when it is needed.
+    memset(&cnode, 0, sizeof(cnode));
+    group = count <= MAX_BRANCHES ? small : malloc(count * sizeof(snode_t));
+    if (group == NULL)
+    {
+        FAIL("Failed to allocate %d entries", count);
+    }
+    for (pos = 0; pos < MAX_BRANCHES && res == OK; pos++)
+    {
+        int length = 0;
+        for (i = 0; i < count; i++)
+        {
+            if (((ctrie_hash(entries[i].key) >> lev) & 0x1f) == pos)
+            {
+                group[length] = entries[i];
+                length++;
+            }
+        }
+        if (length == 0)
+        {
+            continue;
+        }
+        res = build(group, length, lev + W, &(cnode.array[pos]), size);
+        if (cnode.array[pos] != NULL)
+        {
+            cnode.bmp |= 1 << pos;
+            cnode.length++;
+        }
+    }
+    if (group != small)
+    {
+        free(group);
+    }
+    // The part that was built is kept on failure too.
+    return finish_cnode(&cnode, out) == OK ? res : FAILED;
+
+CLEANUP:
+    if (group != small)
+    {
+        free(group);
+    }
+    return FAILED;
+}
+
+/**
+ * Builds an lnode-list of entries whose hashes are equal.
+ * @param entries: the entries.
+ * @param count: the number of entries, at least 1.
+ * @param out: an out parameter that is set to the lnode's branch.
+ * @param size: in-out parameter, incremented by the number of entries.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int build_lnode(snode_t* entries, int count, branch_t** out, int64_t* size)
+{
+    main_node_t*    main_node   = NULL;
+    lnode_t*        tail        = NULL;
+    int i = 0;
+
+    MALLOC(*out, branch_t);
+    MALLOC(main_node, main_node_t);
+    (*out)->type                = INODE;
+    (*out)->node.inode.main     = main_node;
+    main_node->type             = LNODE;
+    main_node->node.lnode.snode = entries[0];
+    tail = &(main_node->node.lnode);
+    for (i = 1; i < count; i++)
+    {
+        MALLOC(tail->next, lnode_t);
+        tail = tail->next;
+        tail->snode = entries[i];
+    }
+    *size += count;
+    return OK;
+
+CLEANUP:
+    if (main_node == NULL)
+    {
+        free(*out);
+        *out = NULL;
+    }
+    return FAILED;
+}
+
+/**
+ * Applies the set operation to two sides which are not cnodes, by comparing their (few) entries.
+ * @param op: the set operation.
+ * @param left: the left side.
+ * @param right: the right side.
+ * @param lev: the hash level of the sides.
+ * @param out: an out parameter that is set to the result's branch, see `build`.
+ * @param size: in-out parameter, incremented by the number of entries of the result.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int merge_entries(set_op_t op, side_t left, side_t right, uint32_t lev, branch_t** out, int64_t* size)
+{
+    snode_t     single[3]       = {0};
+    snode_t*    left_entries    = left.snode;
+    snode_t*    right_entries   = right.snode;
+    snode_t*    entries         = single;
+    int         left_count      = left.snode != NULL;
+    int         right_count     = right.snode != NULL;
+    int         count           = 0;
+    int         res             = FAILED;
+    int i = 0;
+    int j = 0;
+
+    *out = NULL;
+    // Only lnode-lists, which are rare, need buffers.
+    if ((left.main != NULL && side_entries(left, &left_entries, &left_count) != OK) ||
+        (right.main != NULL && side_entries(right, &right_entries, &right_count) != OK))
+    {
+        FAIL("Failed to read the entries of level %d", lev);
+    }
+    if (left.main != NULL || right.main != NULL)
+    {
+        entries = malloc((left_count + right_count) * sizeof(snode_t));
+        if (entries == NULL)
+        {
+            FAIL("Failed to allocate %d entries", left_count + right_count);
+        }
+    }
+    if (op == SET_UNION)
+    {
+        for (j = 0; j < right_count; j++)
+        {
+            entries[count] = right_entries[j];
+            count++;
+        }
+    }
+    for (i = 0; i < left_count; i++)
+    {
+        for (j = 0; j < right_count && right_entries[j].key != left_entries[i].key; j++);
+        // Union and difference keep the left entries which are not on the right, intersection keeps the others.
+        if ((j < right_count) == (op == SET_INTERSECTION))
+        {
+            entries[count] = left_entries[i];
+            count++;
+        }
+    }
+    res = build(entries, count, lev, out, size);
+
+CLEANUP:
+    if (left.main != NULL)
+    {
+        free(left_entries);
+    }
+    if (right.main != NULL)
+    {
+        free(right_entries);
+    }
+    if (entries != single)
+    {
+        free(entries);
+    }
+    return res;
+}
+
+/**
+ * Applies the set operation to two subtrees at the same position, walking them side by side.
+ * @param op: the set operation.
+ * @param left: the left subtree.
+ * @param right: the right subtree.
+ * @param lev: the hash level of the subtrees.
+ * @param out: an out parameter that is set to the result's branch, or to NULL if it is empty.
+ *             On failure it is set to the part that was built, which is a valid subtree.
+ * @param size: in-out parameter, incremented by the number of entries of the result.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int merge(set_op_t op, side_t left, side_t right, uint32_t lev, branch_t** out, int64_t* size)
+{
+    cnode_t  cnode;
+    int      res    = OK;
+    int pos = 0;
+
+    *out = NULL;
+    if ((SIDE_EMPTY(left) && op != SET_UNION) || (SIDE_EMPTY(right) && op == SET_INTERSECTION))
+    {
+        return OK;
+    }
+    if (!SIDE_CNODE(left) && !SIDE_CNODE(right))
+    {
+        return merge_entries(op, left, right, lev, out, size);
+    }
+
+    // Below a cnode the other side is a cnode, a single entry or nothing, all of which split by position.
+    memset(&cnode, 0, sizeof(cnode));
+    for (pos = 0; pos < MAX_BRANCHES && res == OK; pos++)
+    {
+        side_t left_child  = side_child(left, pos, lev);
+        side_t right_child = side_child(right, pos, lev);
+        if (SIDE_EMPTY(left_child) && SIDE_EMPTY(right_child))
+        {
+            continue;
+        }
+        res = merge(op, left_child, right_child, lev + W, &(cnode.array[pos]), size);
+        if (cnode.array[pos] != NULL)
+        {
+            cnode.bmp |= 1 << pos;
+            cnode.length++;
+        }
+    }
+    return finish_cnode(&cnode, out) == OK ? res : FAILED;
+}
+
+/**
+ * The body of a set operation worker, which takes root positions until none are left.
+ * @param worker: the worker.
+ * @return NULL.
+ **/
+static void* set_worker_main(set_worker_t* worker)
+{
+    set_job_t* job = worker->job;
+    int pos = 0;
+    while (!job->failed && (pos = __sync_fetch_and_add(&(job->next_pos), 1)) < MAX_BRANCHES)
+    {
+        side_t left  = side_child(job->left, pos, 0);
+        side_t right = side_child(job->right, pos, 0);
+        if ((!SIDE_EMPTY(left) || !SIDE_EMPTY(right)) &&
+            merge(job->op, left, right, W, &(job->root->array[pos]), &(worker->size)) != OK)
+        {
+            job->failed = 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Builds a new ctrie from two ctries, by walking them side by side: subtrees which only one of them has are copied
+ * or skipped as a whole, and only the overlapping subtrees are compared, down to their entries.
+ * The positions of the root are processed in parallel, and the result is built directly, without CASes.
+ * @param op: the set operation.
+ * @param left: the left ctrie, the result has its configuration (with a plain root, as the result is built from the root).
+ * @param right: the right ctrie.
+ * @param num_of_threads: the number of workers, at most MAX_BRANCHES are used.
+ * @return On success the result ctrie is returned, otherwise NULL is returned.
+ * @note both ctries must be quiescent, they are readonly during the operation.
+ **/
+ctrie_t* ctrie_set_op(set_op_t op, ctrie_t* left, ctrie_t* right, int num_of_threads)
+{
+    ctrie_t*        ctrie           = NULL;
+    pthread_t*      tids            = NULL;
+    set_worker_t*   workers         = NULL;
+    uint8_t         left_readonly   = left->readonly;
+    uint8_t         right_readonly  = right->readonly;
+    ctrie_config_t  config          = left->config;
+    set_job_t       job             = {
+        .op     = op,
+        .left   = { .main = left->inode->main },
+        .right  = { .main = right->inode->main },
+    };
+    int started = 0;
+    int pos = 0;
+    int i = 0;
+
+    if (num_of_threads > MAX_BRANCHES)
+    {
+        num_of_threads = MAX_BRANCHES;
+    }
+    config.root_bits = 0;
+    ctrie   = create_ctrie_with_config(&config);
+    tids    = calloc(num_of_threads, sizeof(pthread_t));
+    workers = calloc(num_of_threads, sizeof(set_worker_t));
+    if (ctrie == NULL || tids == NULL || workers == NULL)
+    {
+        FAIL("Failed to allocate %d workers", num_of_threads);
+    }
+    job.root = &(ctrie->inode->main->node.cnode);
+
+    left->readonly  = 1;
+    right->readonly = 1;
+    for (started = 0; started < num_of_threads; started++)
+    {
+        workers[started].job = &job;
+        if (pthread_create(&(tids[started]), NULL, (void*(*)(void*)) set_worker_main, &(workers[started])) != 0)
+        {
+            // The started workers take the remaining positions.
+            PRINT("Failed to start worker %d", started);
+            job.failed = started == 0;
+            break;
+        }
+    }
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+        ctrie->size += workers[i].size;
+    }
+    right->readonly = right_readonly;
+    left->readonly  = left_readonly;
+
+    for (pos = 0; pos < MAX_BRANCHES; pos++)
+    {
+        if (job.root->array[pos] != NULL)
+        {
+            job.root->bmp |= 1 << pos;
+            job.root->length++;
+        }
+    }
+    if (job.failed)
+    {
+        FAIL("Failed to apply set operation %d", op);
+    }
+    free_them_all(2, tids, workers);
+    return ctrie;
+
+CLEANUP:
+    if (ctrie != NULL)
+    {
+        ctrie->free(ctrie);
+    }
+    free_them_all(2, tids, workers);
+    return NULL;
+}
+
+/**
+ * Builds the union of two ctries, the right value wins when a key is in both.
+ * @param left: the left ctrie.
+ * @param right: the right ctrie.
+ * @param num_of_threads: the number of workers.
+ * @return On success the result ctrie is returned, otherwise NULL is returned.
+ * @note both ctries must be quiescent.
+ **/
+ctrie_t* ctrie_union(ctrie_t* left, ctrie_t* right, int num_of_threads)
+{
+    return ctrie_set_op(SET_UNION, left, right, num_of_threads);
+}
+
+/**
+ * Builds the intersection of two ctries, with the left values.
+ * @param left: the left ctrie.
+ * @param right: the right ctrie.
+ * @param num_of_threads: the number of workers.
+ * @return On success the result ctrie is returned, otherwise NULL is returned.
+ * @note both ctries must be quiescent.
+ **/
+ctrie_t* ctrie_intersection(ctrie_t* left, ctrie_t* right, int num_of_threads)
+{
+    return ctrie_set_op(SET_INTERSECTION, left, right, num_of_threads);
+}
+
+/**
+ * Builds the difference of two ctries: the left entries whose keys are not in the right ctrie.
+ * @param left: the left ctrie.
+ * @param right: the right ctrie.
+ * @param num_of_threads: the number of workers.
+ * @return On success the result ctrie is returned, otherwise NULL is returned.
+ * @note both ctries must be quiescent.
+ **/
+ctrie_t* ctrie_difference(ctrie_t* left, ctrie_t* right, int num_of_threads)
+{
+    return ctrie_set_op(SET_DIFFERENCE, left, right, num_of_threads);
+}
@@ -0,0 +1,470 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "baseline.h"
+
+// The buckets are allocated in segments, up to 2^(SEGMENT_BITS + DIRECTORY_BITS) buckets.
+#define SEGMENT_BITS        (12)
+#define SEGMENT_SIZE        (1 << SEGMENT_BITS)
+#define DIRECTORY_BITS      (12)
+#define MAX_BUCKETS         (1U << (SEGMENT_BITS + DIRECTORY_BITS))
+// A thread sums the sizes of all the threads, to check the load factor, once every SIZE_CHECK_INTERVAL new keys.
+#define SIZE_CHECK_INTERVAL (1024)
+#define NUM_OF_SIZES        (NUM_OF_THREADS + 1)
+#define CACHE_LINE_SIZE     (64)
+
+// The value of a removed key, removing a key swaps its value with TOMBSTONE before it's marked.
+#define TOMBSTONE           (INT32_MIN)
+#define IS_MARKED(node)     ((uintptr_t) (node) & 1)
+#define MARK(node)          ((so_node_t*) ((uintptr_t) (node) | 1))
+#define UNMARK(node)        ((so_node_t*) ((uintptr_t) (node) & ~(uintptr_t) 1))
+
+// The path hazard pointers protecting the list's traversal.
+#define HP_NEXT             (0)
+#define HP_CURRENT          (1)
+#define HP_PREVIOUS         (2)
+
+/**
+ * A node of the list, its `next` is marked once it's removed. The nodes of the buckets (dummies) are never removed.
+ **/
+typedef struct so_node_t
+{
+    // The reversed hash, the low bit is set for keys and clear for dummies.
+    uint64_t                    so_key;
+    int                         key;
+    volatile int                value;
+    struct so_node_t* volatile  next;
+} so_node_t;
+
+typedef struct
+{
+    int64_t size;
+} __attribute__((aligned(CACHE_LINE_SIZE))) thread_size_t;
+
+typedef struct
+{
+    map_t                       map;
+    so_node_t* volatile*        volatile directory[1 << DIRECTORY_BITS];
+    volatile uint32_t           num_of_buckets;
+    // The keys every thread added less the keys it removed, by thread index.
+    thread_size_t               sizes[NUM_OF_SIZES];
+} split_ordered_map_t;
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static uint32_t     hash_key        (int key);
+static uint32_t     reverse_bits    (uint32_t bits);
+static so_node_t*   bucket_head     (split_ordered_map_t* split, uint32_t bucket, thread_args_t* thread_args);
+static so_node_t*   init_bucket     (split_ordered_map_t* split, uint32_t bucket, thread_args_t* thread_args);
+static int          list_find       (so_node_t* head, uint64_t so_key, so_node_t** previous, so_node_t** current,
+                                     thread_args_t* thread_args);
+static void         mark_removed    (so_node_t* node);
+static void         count_keys      (split_ordered_map_t* split, int delta, thread_args_t* thread_args);
+static int          split_insert    (map_t* map, int key, int value, thread_args_t* thread_args);
+static int          split_remove    (map_t* map, int key, thread_args_t* thread_args);
+static int          split_lookup    (map_t* map, int key, thread_args_t* thread_args);
+static int64_t      split_size      (map_t* map);
+static void         split_free      (map_t* map);
+
+/**
+ * Mixes the bits of a key (murmur3's finalizer), it's a bijection so keys are equal iff their hashes are.
+ * @param key: the key.
+ * @return the key's hash.
+ **/
+static uint32_t hash_key(int key)
+{
+    uint32_t hash = key;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint32_t reverse_bits(uint32_t bits)
+{
+    bits = ((bits >> 1) & 0x55555555) | ((bits & 0x55555555) << 1);
+    bits = ((bits >> 2) & 0x33333333) | ((bits & 0x33333333) << 2);
+    bits = ((bits >> 4) & 0x0f0f0f0f) | ((bits & 0x0f0f0f0f) << 4);
+    return __builtin_bswap32(bits);
+}
+
+/**
+ * Finds the dummy node of a bucket, adding it to the list if it isn't there yet.
+ * @param split: the map.
+ * @param bucket: the bucket.
+ * @param thread_args: the thread arguments.
+ * @return the dummy node, or NULL if it couldn't be allocated.
+ **/
+static so_node_t* bucket_head(split_ordered_map_t* split, uint32_t bucket, thread_args_t* thread_args)
+{
+    so_node_t* volatile* segment = split->directory[bucket >> SEGMENT_BITS];
+    so_node_t*           head    = NULL;
+    if (segment == NULL)
+    {
+        so_node_t** allocated = calloc(SEGMENT_SIZE, sizeof(so_node_t*));
+        if (allocated == NULL)
+        {
+            FAIL("Failed to allocate a segment of %d buckets", SEGMENT_SIZE);
+        }
+        if (!__sync_bool_compare_and_swap(&(split->directory[bucket >> SEGMENT_BITS]), NULL, allocated))
+        {
+            free(allocated);
+        }
+        segment = split->directory[bucket >> SEGMENT_BITS];
+    }
+    head = segment[bucket & (SEGMENT_SIZE - 1)];
+    if (head == NULL)
+    {
+        head = init_bucket(split, bucket, thread_args);
+    }
+    return head;
+
+CLEANUP:
+    return NULL;
+}
+
+/**
+ * Adds the dummy node of a bucket after its parent's, the bucket without its most significant bit.
+ * @param split: the map.
+ * @param bucket: the bucket, not 0 (which is added when the map is created).
+ * @param thread_args: the thread arguments.
+ * @return the dummy node, or NULL if it couldn't be allocated.
+ **/
+static so_node_t* init_bucket(split_ordered_map_t* split, uint32_t bucket, thread_args_t* thread_args)
+{
+    uint32_t    parent      = bucket & ~(1U << (31 - __builtin_clz(bucket)));
+    so_node_t*  parent_head = bucket_head(split, parent, thread_args);
+    so_node_t*  dummy       = NULL;
+    so_node_t*  previous    = NULL;
+    so_node_t*  current     = NULL;
+    uint64_t    so_key      = (uint64_t) reverse_bits(bucket) << 32;
+
+    if (parent_head == NULL)
+    {
+        FAIL("Failed to find the parent of bucket %u", bucket);
+    }
+    MALLOC(dummy, so_node_t);
+    dummy->so_key = so_key;
+    while (1)
+    {
+        if (list_find(parent_head, so_key, &previous, &current, thread_args))
+        {
+            // Another thread added it first, dummy nodes are never freed so it needs no protection.
+            free(dummy);
+            dummy = current;
+            break;
+        }
+        dummy->next = current;
+        if (__sync_bool_compare_and_swap(&(previous->next), current, dummy))
+        {
+            break;
+        }
+    }
+    split->directory[bucket >> SEGMENT_BITS][bucket & (SEGMENT_SIZE - 1)] = dummy;
+    return dummy;
+
+CLEANUP:
+    return NULL;
+}
+
+/**
+ * Finds the first node of the list, from `head` on, whose split-order key is at least `so_key` (Michael's algorithm).
+ * Unlinks the marked nodes it passes and retires them. On return the previous and current nodes are protected by
+ * hazard pointers.
+ * @param head: the dummy node of the key's bucket.
+ * @param so_key: the split-order key.
+ * @param previous: an out parameter that is set to the node before the current one.
+ * @param current: an out parameter that is set to the node found, or NULL at the end of the list.
+ * @param thread_args: the thread arguments.
+ * @return whether the current node's split-order key is `so_key`.
+ **/
+static int list_find(so_node_t* head, uint64_t so_key, so_node_t** previous, so_node_t** current,
+                     thread_args_t* thread_args)
+{
+    so_node_t*  prev    = NULL;
+    so_node_t*  curr    = NULL;
+    so_node_t*  next    = NULL;
+    uint64_t    key     = 0;
+
+RETRY:
+    prev = head;
+    curr = prev->next;
+    PLACE_PATH_HP(thread_args, HP_CURRENT, curr);
+    if (prev->next != curr)
+    {
+        goto RETRY;
+    }
+    while (curr != NULL)
+    {
+        next = curr->next;
+        PLACE_PATH_HP(thread_args, HP_NEXT, UNMARK(next));
+        if (curr->next != next)
+        {
+            goto RETRY;
+        }
+        PREEMPTION_POINT(thread_args);
+        if (IS_MARKED(next))
+        {
+            if (!__sync_bool_compare_and_swap(&(prev->next), curr, UNMARK(next)))
+            {
+                goto RETRY;
+            }
+            add_to_free_list(thread_args, curr);
+            curr = UNMARK(next);
+            PLACE_PATH_HP(thread_args, HP_CURRENT, curr);
+            continue;
+        }
+        key = curr->so_key;
+        if (prev->next != curr)
+        {
+            goto RETRY;
+        }
+        if (key >= so_key)
+        {
+            break;
+        }
+        prev = curr;
+        PLACE_PATH_HP(thread_args, HP_PREVIOUS, prev);
+        curr = next;
+        PLACE_PATH_HP(thread_args, HP_CURRENT, curr);
+    }
+    *previous   = prev;
+    *current    = curr;
+    return curr != NULL && key == so_key;
+}
+
+/**
+ * Marks a node whose value was swapped with TOMBSTONE, any thread that sees the TOMBSTONE helps.
+ * @param node: the node.
+ **/
+static void mark_removed(so_node_t* node)
+{
+    so_node_t* next = node->next;
+    while (!IS_MARKED(next) && !__sync_bool_compare_and_swap(&(node->next), next, MARK(next)))
+    {
+        next = node->next;
+    }
+}
+
+/**
+ * Counts keys a thread added or removed, and doubles the buckets once there are more than BASELINE_LOAD_FACTOR keys
+ * per bucket. The new buckets are initialized lazily, by the first operation on them.
+ * @param split: the map.
+ * @param delta: the number of keys added, negative for removed keys.
+ * @param thread_args: the thread arguments.
+ **/
+static void count_keys(split_ordered_map_t* split, int delta, thread_args_t* thread_args)
+{
+    thread_size_t*  size            = &(split->sizes[thread_args->index]);
+    uint32_t        num_of_buckets  = split->num_of_buckets;
+    int64_t         total           = 0;
+    int i = 0;
+    size->size += delta;
+    if (delta <= 0 || size->size % SIZE_CHECK_INTERVAL != 0 || num_of_buckets == MAX_BUCKETS)
+    {
+        return;
+    }
+    for (i = 0; i < NUM_OF_SIZES; i++)
+    {
+        total += split->sizes[i].size;
+    }
+    if (total > (int64_t) num_of_buckets * BASELINE_LOAD_FACTOR)
+    {
+        __sync_bool_compare_and_swap(&(split->num_of_buckets), num_of_buckets, num_of_buckets * 2);
+    }
+}
+
+static int split_insert(map_t* map, int key, int value, thread_args_t* thread_args)
+{
+    split_ordered_map_t*    split       = (split_ordered_map_t*) map;
+    uint32_t                hash        = hash_key(key);
+    uint64_t                so_key      = ((uint64_t) reverse_bits(hash) << 32) | 1;
+    so_node_t*              head        = bucket_head(split, hash & (split->num_of_buckets - 1), thread_args);
+    so_node_t*              node        = NULL;
+    so_node_t*              previous    = NULL;
+    so_node_t*              current     = NULL;
+
+    if (head == NULL)
+    {
+        FAIL("Failed to find the bucket of key %d", key);
+    }
+    while (1)
+    {
+        if (list_find(head, so_key, &previous, &current, thread_args))
+        {
+            int old = current->value;
+            if (old == TOMBSTONE)
+            {
+                // Being removed, help unlink it and insert a new node.
+                mark_removed(current);
+                continue;
+            }
+            if (__sync_bool_compare_and_swap(&(current->value), old, value))
+            {
+                free(node);
+                return OK;
+            }
+            continue;
+        }
+        if (node == NULL)
+        {
+            MALLOC(node, so_node_t);
+            node->so_key    = so_key;
+            node->key       = key;
+            node->value     = value;
+        }
+        node->next = current;
+        if (__sync_bool_compare_and_swap(&(previous->next), current, node))
+        {
+            count_keys(split, 1, thread_args);
+            return OK;
+        }
+    }
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Swapping the value with TOMBSTONE removes the key, then its node is marked and unlinked.
+ **/
+static int split_remove(map_t* map, int key, thread_args_t* thread_args)
+{
+    split_ordered_map_t*    split       = (split_ordered_map_t*) map;
+    uint32_t                hash        = hash_key(key);
+    uint64_t                so_key      = ((uint64_t) reverse_bits(hash) << 32) | 1;
+    so_node_t*              head        = bucket_head(split, hash & (split->num_of_buckets - 1), thread_args);
+    so_node_t*              previous    = NULL;
+    so_node_t*              current     = NULL;
+    int                     value       = TOMBSTONE;
+
+    if (head == NULL)
+    {
+        FAIL("Failed to find the bucket of key %d", key);
+    }
+    if (!list_find(head, so_key, &previous, &current, thread_args))
+    {
+        return NOTFOUND;
+    }
+    do
+    {
+        value = current->value;
+    } while (value != TOMBSTONE && !__sync_bool_compare_and_swap(&(current->value), value, TOMBSTONE));
+    mark_removed(current);
+    if (value == TOMBSTONE)
+    {
+        // Removed by another thread first.
+        return NOTFOUND;
+    }
+    count_keys(split, -1, thread_args);
+    // Finding the key unlinks its node, if this CAS fails.
+    if (__sync_bool_compare_and_swap(&(previous->next), current, UNMARK(current->next)))
+    {
+        add_to_free_list(thread_args, current);
+    }
+    else
+    {
+        list_find(head, so_key, &previous, &current, thread_args);
+    }
+    return value;
+
+CLEANUP:
+    return FAILED;
+}
+
+static int split_lookup(map_t* map, int key, thread_args_t* thread_args)
+{
+    split_ordered_map_t*    split       = (split_ordered_map_t*) map;
+    uint32_t                hash        = hash_key(key);
+    uint64_t                so_key      = ((uint64_t) reverse_bits(hash) << 32) | 1;
+    so_node_t*              head        = bucket_head(split, hash & (split->num_of_buckets - 1), thread_args);
+    so_node_t*              previous    = NULL;
+    so_node_t*              current     = NULL;
+    int                     value       = NOTFOUND;
+
+    if (head == NULL)
+    {
+        FAIL("Failed to find the bucket of key %d", key);
+    }
+    if (list_find(head, so_key, &previous, &current, thread_args))
+    {
+        value = current->value;
+    }
+    return value == TOMBSTONE ? NOTFOUND : value;
+
+CLEANUP:
+    return FAILED;
+}
+
+static int64_t split_size(map_t* map)
+{
+    split_ordered_map_t*    split   = (split_ordered_map_t*) map;
+    int64_t                 size    = 0;
+    int i = 0;
+    for (i = 0; i < NUM_OF_SIZES; i++)
+    {
+        size += split->sizes[i].size;
+    }
+    return size;
+}
+
+/**
+ * Frees the map, must be called once no thread uses it. The retired nodes are in the threads' free lists.
+ **/
+static void split_free(map_t* map)
+{
+    split_ordered_map_t*    split   = (split_ordered_map_t*) map;
+    so_node_t*              node    = split->directory[0] == NULL ? NULL : split->directory[0][0];
+    int i = 0;
+    while (node != NULL)
+    {
+        so_node_t* next = UNMARK(node->next);
+        free(node);
+        node = next;
+    }
+    for (i = 0; i < (1 << DIRECTORY_BITS); i++)
+    {
+        free((void*) split->directory[i]);
+    }
+    free(split);
+}
+
+map_t* create_split_ordered_map()
+{
+    split_ordered_map_t*    split   = NULL;
+    so_node_t*              head    = NULL;
+    if (posix_memalign((void**) &split, CACHE_LINE_SIZE, sizeof(split_ordered_map_t)) != 0)
+    {
+        split = NULL;
+        FAIL("Failed to allocate %lu bytes for a split-ordered map", sizeof(split_ordered_map_t));
+    }
+    memset(split, 0, sizeof(split_ordered_map_t));
+    split->map.insert       = split_insert;
+    split->map.remove       = split_remove;
+    split->map.lookup       = split_lookup;
+    split->map.size         = split_size;
+    split->map.free         = split_free;
+    split->num_of_buckets   = BASELINE_INITIAL_BUCKETS;
+    split->directory[0]     = calloc(SEGMENT_SIZE, sizeof(so_node_t*));
+    if (split->directory[0] == NULL)
+    {
+        FAIL("Failed to allocate a segment of %d buckets", SEGMENT_SIZE);
+    }
+    // Bucket 0 starts the list, with split-order key 0.
+    MALLOC(head, so_node_t);
+    split->directory[0][0] = head;
+    return &(split->map);
+
+CLEANUP:
+    if (split != NULL)
+    {
+        split_free(&(split->map));
+    }
+    return NULL;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "trace.h"
+
+#if TRACING
+trace_ring_t trace_rings[TRACE_THREADS];
+#endif
+
+// When tracing started, by the events' ticks and by the monotonic clock.
+static uint64_t     start_ticks = 0;
+static uint64_t     start_nsecs = 0;
+// Where the trace is dumped at exit, if anywhere.
+static const char*  exit_path   = NULL;
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static void dump_at_exit();
+
+static void dump_at_exit()
+{
+    if (trace_dump(exit_path) != OK)
+    {
+        PERS_PRINT("Failed to dump the trace to %s", exit_path);
+    }
+}
+
+/**
+ * Starts tracing, the events are timed from now on.
+ * @param path: where the trace is dumped at exit, NULL if it isn't.
+ **/
+void trace_start(const char* path)
+{
+    start_ticks = trace_ticks();
+    start_nsecs = monotonic_nsecs();
+    if (path != NULL)
+    {
+        if (!TRACING)
+        {
+            PERS_PRINT("Built without TRACING, %s won't be written", path);
+            return;
+        }
+        exit_path = path;
+        atexit(dump_at_exit);
+    }
+}
+
+/**
+ * Writes the events of all the threads and empties their rings, while the threads record no events.
+ * A thread which recorded more than TRACE_RING_EVENTS events only has its last ones written.
+ * @param path: the trace file.
+ * @return OK on success, otherwise FAILED.
+ **/
+int trace_dump(const char* path)
+{
+#if TRACING
+    FILE*           fp      = NULL;
+    uint64_t        nsecs   = monotonic_nsecs() - start_nsecs;
+    trace_header_t  header  = {
+        .event_size     = sizeof(trace_event_t),
+        .num_of_threads = TRACE_THREADS,
+        .ticks_per_nsec = nsecs > 0 ? (double) (trace_ticks() - start_ticks) / nsecs : 1.0,
+        .start_ticks    = start_ticks,
+    };
+    int i = 0;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    for (i = 0; i < TRACE_THREADS; i++)
+    {
+        header.num_of_events += trace_rings[i].next < TRACE_RING_EVENTS ? trace_rings[i].next : TRACE_RING_EVENTS;
+    }
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        FAIL("Failed to fopen %s", path);
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+    {
+        FAIL("Failed to write the trace's header");
+    }
+    for (i = 0; i < TRACE_THREADS; i++)
+    {
+        trace_ring_t* ring  = &(trace_rings[i]);
+        uint64_t      first = ring->next < TRACE_RING_EVENTS ? 0 : ring->next - TRACE_RING_EVENTS;
+        uint64_t      start = first & (TRACE_RING_EVENTS - 1);
+        uint64_t      count = ring->next - first;
+        // The oldest events are at the end of a ring which wrapped around.
+        uint64_t      tail  = start + count > TRACE_RING_EVENTS ? TRACE_RING_EVENTS - start : count;
+        if (fwrite(&(ring->events[start]), sizeof(trace_event_t), tail, fp) != tail ||
+            fwrite(ring->events, sizeof(trace_event_t), count - tail, fp) != count - tail)
+        {
+            FAIL("Failed to write the events of thread %d", i);
+        }
+        ring->next = 0;
+    }
+    if (fclose(fp) != 0)
+    {
+        fp = NULL;
+        FAIL("Failed to fclose %s", path);
+    }
+    PERS_PRINT("Dumped %lu events to %s", header.num_of_events, path);
+    return OK;
+
+CLEANUP:
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    return FAILED;
+#else
+    PERS_PRINT("Built without TRACING, %s isn't written", path);
+    return FAILED;
+#endif
+}
@@ -0,0 +1,372 @@
+#include <math.h>
+
+#include "common.h"
+#include "ctrie.h"
+#include "workload.h"
+
+#define SPEC_SEPARATOR          (',')
+#define MAX_SPEC_ITEM           (64)
+#define GOLDEN_GAMMA            (0x9e3779b97f4a7c15ULL)
+// An odd multiplier, a bijection of the 31 bit ranks.
+#define SCRAMBLE_MULTIPLIER     (0x9e3779b1U)
+#define MAX_KEY                 (0x7fffffffU)
+
+// By distribution_t.
+static const char* distribution_names[] = { "uniform", "zipf", "seq", "hotspot", "latest" };
+// By action_type_t.
+static const char* mix_names[]          = { "insert", "lookup", "remove" };
+
+/*************************
+ * Functions Declaration *
+ *************************/
+
+static int      parse_item   (workload_config_t* config, const char* name, const char* value, uint8_t* mix_given);
+static int      parse_spec   (const char* spec, workload_config_t* config);
+
+static uint64_t next_random  (uint64_t* state);
+static double   next_double  (uint64_t* state);
+static uint64_t next_below   (uint64_t* state, uint64_t bound);
+static uint64_t next_zipfian (workload_stream_t* stream);
+static uint64_t next_rank    (workload_stream_t* stream, action_type_t type);
+
+/**
+ * Sets a field of the workload's configuration.
+ * @param config: the configuration.
+ * @param name: the field's name.
+ * @param value: the field's value.
+ * @param mix_given: set if the field is a percentage of the mix.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int parse_item(workload_config_t* config, const char* name, const char* value, uint8_t* mix_given)
+{
+    char*              end      = NULL;
+    double             fraction = 0.0;
+    unsigned long long number   = 0;
+    int i = 0;
+
+    if (strcmp(name, "dist") == 0)
+    {
+        for (i = 0; i < sizeof(distribution_names) / sizeof(distribution_names[0]); i++)
+        {
+            if (strcmp(value, distribution_names[i]) == 0)
+            {
+                config->distribution = i;
+                return OK;
+            }
+        }
+        FAIL("Unknown distribution: %s", value);
+    }
+    if (strcmp(name, "gen") == 0)
+    {
+        if (strcmp(value, "buffer") != 0 && strcmp(value, "fly") != 0)
+        {
+            FAIL("Unknown generation: %s", value);
+        }
+        config->on_the_fly = strcmp(value, "fly") == 0;
+        return OK;
+    }
+    if (strcmp(name, "theta") == 0 || strcmp(name, "hot") == 0 || strcmp(name, "hot_ops") == 0)
+    {
+        fraction = strtod(value, &end);
+        if (end == value || *end != '\0' || fraction < 0.0 || fraction > 1.0)
+        {
+            FAIL("Invalid %s: %s", name, value);
+        }
+        if (strcmp(name, "theta") == 0)
+        {
+            config->theta = fraction;
+        }
+        else if (strcmp(name, "hot") == 0)
+        {
+            config->hot_keys = fraction;
+        }
+        else
+        {
+            config->hot_ops = fraction;
+        }
+        return OK;
+    }
+
+    number = strtoull(value, &end, 10);
+    if (end == value || *end != '\0')
+    {
+        FAIL("Invalid %s: %s", name, value);
+    }
+    for (i = 0; i <= REMOVE; i++)
+    {
+        if (strcmp(name, mix_names[i]) == 0)
+        {
+            if (number > 100)
+            {
+                FAIL("Invalid percentage of %s: %s", name, value);
+            }
+            config->mix[i] = number;
+            *mix_given = 1;
+            return OK;
+        }
+    }
+    if (strcmp(name, "ops") == 0)
+    {
+        config->ops = number;
+    }
+    else if (strcmp(name, "keys") == 0)
+    {
+        config->keys = number > MAX_KEY ? 0 : number;
+    }
+    else if (strcmp(name, "seed") == 0)
+    {
+        config->seed = number;
+    }
+    else if (strcmp(name, "scramble") == 0)
+    {
+        config->scramble = number != 0;
+    }
+    else
+    {
+        FAIL("Unknown workload field: %s", name);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Parses a workload's specification, comma separated fields such as "ops=1000000,dist=zipf,theta=0.9,lookup=95,insert=5".
+ * Mix percentages that aren't given are 0, unless none is given and the mix is 10% inserts, 80% lookups, 10% removes.
+ * @param spec: the specification.
+ * @param config: an out parameter that is set to the configuration.
+ * @return OK on success, otherwise FAILED.
+ **/
+static int parse_spec(const char* spec, workload_config_t* config)
+{
+    char        item[MAX_SPEC_ITEM] = {0};
+    const char* next        = NULL;
+    char*       value       = NULL;
+    uint8_t     mix_given   = 0;
+
+    *config = (workload_config_t) {
+        .ops        = WORKLOAD_OPS,
+        .keys       = WORKLOAD_KEYS,
+        .theta      = WORKLOAD_THETA,
+        .hot_keys   = WORKLOAD_HOT_KEYS,
+        .hot_ops    = WORKLOAD_HOT_OPS,
+        .seed       = WORKLOAD_SEED,
+        .scramble   = 1,
+    };
+    while (*spec != '\0')
+    {
+        next = strchr(spec, SPEC_SEPARATOR);
+        size_t length = next == NULL ? strlen(spec) : (size_t) (next - spec);
+        if (length >= sizeof(item))
+        {
+            FAIL("Workload field too long: %s", spec);
+        }
+        memcpy(item, spec, length);
+        item[length] = '\0';
+        spec += length + (next != NULL);
+        if (length == 0)
+        {
+            continue;
+        }
+        value = strchr(item, '=');
+        if (value == NULL)
+        {
+            FAIL("Workload field without a value: %s", item);
+        }
+        *value = '\0';
+        if (parse_item(config, item, value + 1, &mix_given) != OK)
+        {
+            FAIL("Invalid workload field: %s", item);
+        }
+    }
+    if (!mix_given)
+    {
+        config->mix[INSERT] = 10;
+        config->mix[LOOKUP] = 80;
+        config->mix[REMOVE] = 10;
+    }
+    if (config->mix[INSERT] + config->mix[LOOKUP] + config->mix[REMOVE] != 100)
+    {
+        FAIL("The mix adds up to %u%%", config->mix[INSERT] + config->mix[LOOKUP] + config->mix[REMOVE]);
+    }
+    if (config->keys == 0 || config->keys > MAX_KEY)
+    {
+        FAIL("Invalid number of keys: %u", config->keys);
+    }
+    if (config->distribution == DIST_LATEST && config->ops > MAX_KEY - config->keys)
+    {
+        FAIL("Too many keys for the latest distribution: %u + %lu", config->keys, config->ops);
+    }
+    if ((config->distribution == DIST_ZIPFIAN || config->distribution == DIST_LATEST) &&
+        (config->theta <= 0.0 || config->theta >= 1.0))
+    {
+        FAIL("The zipfian theta must be in (0, 1): %f", config->theta);
+    }
+    if (config->distribution == DIST_HOTSPOT && (config->hot_keys <= 0.0 || config->hot_keys >= 1.0))
+    {
+        FAIL("The hot keys must be in (0, 1): %f", config->hot_keys);
+    }
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Parses a workload's specification, and prepares its generators.
+ * @param workload: the workload.
+ * @param spec: the workload's specification, see parse_spec.
+ * @return OK on success, otherwise FAILED.
+ **/
+int workload_init(workload_t* workload, const char* spec)
+{
+    workload_config_t* config = &(workload->config);
+    uint64_t i = 0;
+    memset(workload, 0, sizeof(*workload));
+    if (parse_spec(spec, config) != OK)
+    {
+        FAIL("Invalid workload: %s", spec);
+    }
+    if (config->distribution != DIST_ZIPFIAN && config->distribution != DIST_LATEST)
+    {
+        return OK;
+    }
+    // Gray et al., "Quickly Generating Billion-Record Synthetic Databases", as in YCSB.
+    for (i = 1; i <= config->keys; i++)
+    {
+        workload->zeta_n += pow(i, -config->theta);
+    }
+    workload->half_pow_theta    = pow(0.5, config->theta);
+    workload->alpha             = 1.0 / (1.0 - config->theta);
+    workload->eta               = (1.0 - pow(2.0 / config->keys, 1.0 - config->theta)) /
+                                  (1.0 - (1.0 + workload->half_pow_theta) / workload->zeta_n);
+    return OK;
+
+CLEANUP:
+    return FAILED;
+}
+
+/**
+ * Advances a splitmix64 pseudo random generator.
+ * @param state: the generator's state.
+ * @return the next pseudo random number.
+ **/
+static uint64_t next_random(uint64_t* state)
+{
+    uint64_t z = (*state += GOLDEN_GAMMA);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double next_double(uint64_t* state)
+{
+    return (next_random(state) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static uint64_t next_below(uint64_t* state, uint64_t bound)
+{
+    return ((__uint128_t) next_random(state) * bound) >> 64;
+}
+
+/**
+ * @param stream: the generator.
+ * @return a zipfian rank in [0, keys), 0 is the most popular.
+ **/
+static uint64_t next_zipfian(workload_stream_t* stream)
+{
+    const workload_t* workload = stream->workload;
+    double   u      = next_double(&(stream->state));
+    double   uz     = u * workload->zeta_n;
+    uint64_t rank   = 0;
+    if (uz < 1.0)
+    {
+        return 0;
+    }
+    if (uz < 1.0 + workload->half_pow_theta)
+    {
+        return 1;
+    }
+    rank = workload->config.keys * pow(workload->eta * u - workload->eta + 1.0, workload->alpha);
+    return rank < workload->config.keys ? rank : workload->config.keys - 1;
+}
+
+/**
+ * Picks the rank of the key of the next operation.
+ * @param stream: the generator.
+ * @param type: the operation's type.
+ * @return the key's rank.
+ **/
+static uint64_t next_rank(workload_stream_t* stream, action_type_t type)
+{
+    const workload_config_t* config = &(stream->workload->config);
+    uint64_t hot    = 0;
+    uint64_t newest = 0;
+    switch (config->distribution)
+    {
+    case DIST_ZIPFIAN:
+        return next_zipfian(stream);
+    case DIST_SEQUENTIAL:
+        return stream->op % config->keys;
+    case DIST_HOTSPOT:
+        hot = config->hot_keys * config->keys;
+        hot = hot == 0 ? 1 : hot;
+        if (hot == config->keys || next_double(&(stream->state)) < config->hot_ops)
+        {
+            return next_below(&(stream->state), hot);
+        }
+        return hot + next_below(&(stream->state), config->keys - hot);
+    case DIST_LATEST:
+        // The threads insert new keys in turns, so the newest key is about as new for all of them.
+        newest = config->keys - 1 + stream->inserted * stream->num_of_threads;
+        if (type == INSERT)
+        {
+            stream->inserted++;
+            return newest + 1 + stream->thread;
+        }
+        return newest - next_zipfian(stream);
+    case DIST_UNIFORM:
+    default:
+        return next_below(&(stream->state), config->keys);
+    }
+}
+
+/**
+ * Starts a thread's generator of operations.
+ * @param stream: the generator.
+ * @param workload: the workload.
+ * @param thread: the thread's index, which picks its random stream.
+ * @param num_of_threads: the number of threads generating the workload.
+ * @param first_op: the index of the thread's first operation in the whole workload.
+ **/
+void workload_stream_init(workload_stream_t* stream, const workload_t* workload, uint32_t thread,
+                          uint32_t num_of_threads, uint64_t first_op)
+{
+    uint64_t seed = workload->config.seed ^ ((uint64_t) (thread + 1) << 32);
+    *stream = (workload_stream_t) {
+        .workload       = workload,
+        .state          = next_random(&seed),
+        .op             = first_op,
+        .num_of_threads = num_of_threads,
+        .thread         = thread,
+    };
+}
+
+/**
+ * Generates the next operation of a thread.
+ * @param stream: the thread's generator.
+ * @param action: an out parameter that is set to the operation.
+ **/
+void workload_next(workload_stream_t* stream, action_t* action)
+{
+    const workload_config_t* config = &(stream->workload->config);
+    uint32_t      percent   = next_below(&(stream->state), 100);
+    action_type_t type      = percent < config->mix[INSERT] ? INSERT :
+                              percent < config->mix[INSERT] + config->mix[LOOKUP] ? LOOKUP : REMOVE;
+    uint32_t      rank      = next_rank(stream, type);
+    action->type                = type;
+    action->action.insert.key   = config->scramble ? (rank * SCRAMBLE_MULTIPLIER) & MAX_KEY : rank;
+    action->action.insert.value = stream->op & MAX_KEY;
+    stream->op++;
+}
@@ -0,0 +1,142 @@
+#include <pthread.h>
+
+#include "hazard_pointer.h"
+#include "nodes.h"
+#include "common.h"
+#include "ctrie.h"
+
+#define CAPACITY        (1000)
+#define NUM_OF_KEYS     (100000)
+#define NUM_OF_WORKERS  (4)
+
+typedef struct {
+    ctrie_t*        ctrie;
+    thread_args_t*  thread_args;
+    int             stride;
+} worker_args_t;
+
+/*** Functions Declaration ***/
+
+static void* insert_keys(void* arg);
+static int   check_capacity(int stride);
+
+/**
+ * Inserts the worker's share of the keys, looking some of the older ones up so they get second chances.
+ * @param arg: the worker's arguments.
+ * @return NULL.
+ **/
+static void* insert_keys(void* arg)
+{
+    worker_args_t*  args        = (worker_args_t*) arg;
+    thread_args_t*  thread_args = args->thread_args;
+    int             i           = 0;
+    for (i = thread_args->index; i < NUM_OF_KEYS; i += NUM_OF_WORKERS)
+    {
+        args->ctrie->insert(args->ctrie, i * args->stride, i, thread_args);
+        if (i % 3 == 0)
+        {
+            args->ctrie->lookup(args->ctrie, (i / 2) * args->stride, thread_args);
+        }
+    }
+    release_hazard_pointers(thread_args->hp_lists[thread_args->index]);
+    return NULL;
+}
+
+/**
+ * Fills a capacity bounded ctrie with keys `stride` apart and checks that it stays within its capacity.
+ * The hash is key / 10, so with a stride under 10 the keys collide into LNodes, and evicting from them leaves tombs.
+ * @param stride: the distance between consecutive keys.
+ * @return OK if the ctrie stayed within its capacity, otherwise FAILED.
+ **/
+static int check_capacity(int stride)
+{
+    int             res                             = FAILED;
+    int             i                               = 0;
+    int             found                           = 0;
+    int             bound                           = CAPACITY + NUM_OF_WORKERS * CACHE_SIZE_BATCH;
+    ctrie_t*        ctrie                           = NULL;
+    pthread_t       threads[NUM_OF_WORKERS]         = {0};
+    worker_args_t   workers_args[NUM_OF_WORKERS]    = {0};
+    hp_list_t*      hp_array[NUM_OF_THREADS]        = {0};
+    hp_list_t       hp_lists[NUM_OF_WORKERS]        = {0};
+    free_list_t     free_lists[NUM_OF_WORKERS]      = {0};
+    thread_args_t   threads_args[NUM_OF_WORKERS]    = {0};
+    ctrie_config_t  config                          = { .capacity = CAPACITY };
+
+    ctrie = create_ctrie_with_config(&config);
+    if (ctrie == NULL)
+    {
+        FAIL("failed to create a ctrie");
+    }
+    for (i = 0; i < NUM_OF_WORKERS; i++)
+    {
+        hp_array[i] = &(hp_lists[i]);
+    }
+    for (i = 0; i < NUM_OF_WORKERS; i++)
+    {
+        threads_args[i] = (thread_args_t) { .hp_lists = hp_array, .free_list = &(free_lists[i]), .index = i, .num_of_threads = NUM_OF_WORKERS };
+        workers_args[i] = (worker_args_t) { .ctrie = ctrie, .thread_args = &(threads_args[i]), .stride = stride };
+        if (pthread_create(&(threads[i]), NULL, insert_keys, &(workers_args[i])) != 0)
+        {
+            FAIL("failed to create worker %d", i);
+        }
+    }
+    for (i = 0; i < NUM_OF_WORKERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        threads[i] = 0;
+    }
+    for (i = 0; i < NUM_OF_KEYS; i++)
+    {
+        if (ctrie->lookup(ctrie, i * stride, &(threads_args[0])) != NOTFOUND)
+        {
+            found++;
+        }
+    }
+    release_hazard_pointers(&(hp_lists[0]));
+    PERS_PRINT("stride %d: %d entries, size ~%ld of %d", stride, found, ctrie->size, CAPACITY);
+    if (found > bound)
+    {
+        FAIL("stride %d: %d entries are over the bound of %d", stride, found, bound);
+    }
+    res = OK;
+
+CLEANUP:
+    for (i = 0; i < NUM_OF_WORKERS; i++)
+    {
+        if (threads[i] != 0)
+        {
+            pthread_join(threads[i], NULL);
+            threads[i] = 0;
+        }
+    }
+    for (i = 0; i < NUM_OF_WORKERS; i++)
+    {
+        int j = 0;
+        for (j = 0; j < free_lists[i].length; j++)
+        {
+            free(free_lists[i].free_list[j]);
+        }
+    }
+    if (ctrie != NULL)
+    {
+        ctrie->free(ctrie);
+    }
+    return res;
+}
+
+int main()
+{
+    // Colliding keys (1 and 7) leave tombs behind, distinct hashes (10) don't.
+    int strides[]   = { 1, 7, 10 };
+    int res         = OK;
+    int i           = 0;
+    for (i = 0; i < sizeof(strides) / sizeof(strides[0]); i++)
+    {
+        if (check_capacity(strides[i]) != OK)
+        {
+            res = FAILED;
+        }
+    }
+    return res == OK ? 0 : -1;
+}